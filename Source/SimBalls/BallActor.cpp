@@ -17,6 +17,14 @@ namespace
 	constexpr TCHAR Param_Dissolve[] = TEXT("Dissolve");
 }
 
+static bool bShowBallDebugStrings = true;
+static FAutoConsoleVariableRef CVarShowBallDebugStrings(
+		TEXT("Sim.BallDebugStrings"),
+		bShowBallDebugStrings,
+		TEXT("Draws HP and current action above every ball."),
+		ECVF_Cheat
+	);
+
 ABallActor::ABallActor()
 {
 	PrimaryActorTick.bCanEverTick = false;
@@ -51,7 +59,12 @@ void ABallActor::InitBall(const FBallSimulatedState& InState)
 	DesiredLocation = Grid->GridToWorld(InState.GridPosition);
 	PrevLocation = DesiredLocation;
 	
-	const FLinearColor TeamColor = InState.Team == EBallTeamColor::Red ? FLinearColor::Red : FLinearColor::Blue;
+	// Teams after Red and Blue spread over the hue circle
+	FLinearColor TeamColor = FLinearColor::MakeFromHSV8(static_cast<uint8>(static_cast<int32>(InState.Team) * 73), 255, 255);
+	if (InState.Team == EBallTeamColor::Red || InState.Team == EBallTeamColor::Blue)
+	{
+		TeamColor = InState.Team == EBallTeamColor::Red ? FLinearColor::Red : FLinearColor::Blue;
+	}
 	
 	BallMaterial = BallMesh->CreateDynamicMaterialInstance(0);
 	BallMaterial->SetVectorParameterValue(Param_Color, TeamColor);
@@ -181,6 +194,11 @@ void ABallActor::UpdateVisuals(float DeltaTime)
 		}
 	}
 
+	if (!bShowBallDebugStrings)
+	{
+		return;
+	}
+
 	if (SimulatedState.bIsDead)
 	{
 		DebugState.Append("\nDead");
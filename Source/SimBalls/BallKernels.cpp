@@ -0,0 +1,155 @@
+#include "BallKernels.h"
+
+#include "Math/VectorRegister.h"
+
+namespace
+{
+	constexpr int32 VectorWidth = 4;
+
+	void ScanClosest(const int32* X, const int32* Y, int32 Begin, int32 End, const FIntPoint& From, int32& InOutIndex, int32& InOutDistance)
+	{
+		for (int32 Index = Begin; Index < End; ++Index)
+		{
+			const int32 Dist = FMath::Abs(X[Index] - From.X) + FMath::Abs(Y[Index] - From.Y);
+			if (Dist < InOutDistance)
+			{
+				InOutDistance = Dist;
+				InOutIndex = Index;
+			}
+		}
+	}
+
+	void ClampDamage(int32* HP, const int32* Damage, int32 Begin, int32 End)
+	{
+		for (int32 Index = Begin; Index < End; ++Index)
+		{
+			HP[Index] = FMath::Max(0, HP[Index] - Damage[Index]);
+		}
+	}
+
+	void RestartTimers(int32* StepsToAttack, int32 Begin, int32 End, int32 Interval)
+	{
+		for (int32 Index = Begin; Index < End; ++Index)
+		{
+			if (StepsToAttack[Index] == 0)
+			{
+				StepsToAttack[Index] = Interval;
+			}
+		}
+	}
+}
+
+int32 FBallKernels::FindClosestScalar(const int32* X, const int32* Y, int32 Num, const FIntPoint& From, int32& OutDistance)
+{
+	int32 Closest = INDEX_NONE;
+	OutDistance = MAX_int32;
+
+	ScanClosest(X, Y, 0, Num, From, Closest, OutDistance);
+
+	return Closest;
+}
+
+int32 FBallKernels::FindClosest(const int32* X, const int32* Y, int32 Num, const FIntPoint& From, int32& OutDistance)
+{
+#if PLATFORM_ENABLE_VECTORINTRINSICS
+	const int32 NumVectorized = Num - Num % VectorWidth;
+
+	const VectorRegister4Int FromX = VectorIntSet1(From.X);
+	const VectorRegister4Int FromY = VectorIntSet1(From.Y);
+	const VectorRegister4Int Step = VectorIntSet1(VectorWidth);
+
+	// Each lane keeps its own best, lanes see increasing indices so the strict comparison keeps the lowest one
+	VectorRegister4Int BestDistance = VectorIntSet1(MAX_int32);
+	VectorRegister4Int BestIndex = VectorIntSet1(INDEX_NONE);
+	VectorRegister4Int LaneIndex = MakeVectorRegisterInt(0, 1, 2, 3);
+
+	for (int32 Index = 0; Index < NumVectorized; Index += VectorWidth)
+	{
+		const VectorRegister4Int DeltaX = VectorIntAbs(VectorIntSubtract(VectorIntLoad(X + Index), FromX));
+		const VectorRegister4Int DeltaY = VectorIntAbs(VectorIntSubtract(VectorIntLoad(Y + Index), FromY));
+		const VectorRegister4Int Dist = VectorIntAdd(DeltaX, DeltaY);
+
+		const VectorRegister4Int bCloser = VectorIntCompareGT(BestDistance, Dist);
+		BestDistance = VectorIntSelect(bCloser, Dist, BestDistance);
+		BestIndex = VectorIntSelect(bCloser, LaneIndex, BestIndex);
+
+		LaneIndex = VectorIntAdd(LaneIndex, Step);
+	}
+
+	alignas(16) int32 LaneDistances[VectorWidth];
+	alignas(16) int32 LaneIndices[VectorWidth];
+	VectorIntStoreAligned(BestDistance, LaneDistances);
+	VectorIntStoreAligned(BestIndex, LaneIndices);
+
+	int32 Closest = INDEX_NONE;
+	OutDistance = MAX_int32;
+
+	for (int32 Lane = 0; Lane < VectorWidth; ++Lane)
+	{
+		if (LaneIndices[Lane] == INDEX_NONE)
+		{
+			continue;
+		}
+
+		if (LaneDistances[Lane] < OutDistance || (LaneDistances[Lane] == OutDistance && LaneIndices[Lane] < Closest))
+		{
+			OutDistance = LaneDistances[Lane];
+			Closest = LaneIndices[Lane];
+		}
+	}
+
+	// Tail indices are higher than all vectorized ones, a strict comparison keeps ties correct
+	ScanClosest(X, Y, NumVectorized, Num, From, Closest, OutDistance);
+
+	return Closest;
+#else
+	return FindClosestScalar(X, Y, Num, From, OutDistance);
+#endif
+}
+
+void FBallKernels::ResolveDamageScalar(int32* HP, const int32* Damage, int32 Num)
+{
+	ClampDamage(HP, Damage, 0, Num);
+}
+
+void FBallKernels::ResolveDamage(int32* HP, const int32* Damage, int32 Num)
+{
+#if PLATFORM_ENABLE_VECTORINTRINSICS
+	const int32 NumVectorized = Num - Num % VectorWidth;
+	const VectorRegister4Int Zero = VectorIntSet1(0);
+
+	for (int32 Index = 0; Index < NumVectorized; Index += VectorWidth)
+	{
+		const VectorRegister4Int Remaining = VectorIntSubtract(VectorIntLoad(HP + Index), VectorIntLoad(Damage + Index));
+		VectorIntStore(VectorIntMax(Remaining, Zero), HP + Index);
+	}
+
+	ClampDamage(HP, Damage, NumVectorized, Num);
+#else
+	ResolveDamageScalar(HP, Damage, Num);
+#endif
+}
+
+void FBallKernels::ResetAttackTimersScalar(int32* StepsToAttack, int32 Num, int32 Interval)
+{
+	RestartTimers(StepsToAttack, 0, Num, Interval);
+}
+
+void FBallKernels::ResetAttackTimers(int32* StepsToAttack, int32 Num, int32 Interval)
+{
+#if PLATFORM_ENABLE_VECTORINTRINSICS
+	const int32 NumVectorized = Num - Num % VectorWidth;
+	const VectorRegister4Int Zero = VectorIntSet1(0);
+	const VectorRegister4Int Restart = VectorIntSet1(Interval);
+
+	for (int32 Index = 0; Index < NumVectorized; Index += VectorWidth)
+	{
+		const VectorRegister4Int Steps = VectorIntLoad(StepsToAttack + Index);
+		VectorIntStore(VectorIntSelect(VectorIntCompareEQ(Steps, Zero), Restart, Steps), StepsToAttack + Index);
+	}
+
+	RestartTimers(StepsToAttack, NumVectorized, Num, Interval);
+#else
+	ResetAttackTimersScalar(StepsToAttack, Num, Interval);
+#endif
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Batch kernels over structure of arrays copies of the ball fields that every ball reads each step.
+ * Vector versions use the engine int vector intrinsics (SSE/NEON) and return exactly what the scalar ones do.
+ */
+struct SIMBALLS_API FBallKernels
+{
+	/**
+	 * Finds the closest of all given balls by manhattan distance, for arrays that hold only valid targets (one hostile team partition).
+	 * Ties go to the lowest index, same as a linear scan with a strict comparison.
+	 * @param X, Y - Per ball arrays of Num elements
+	 * @param From - Cell distances are measured from
+	 * @param OutDistance - Distance to the returned ball, MAX_int32 when none was found
+	 * @return Index of the closest ball or INDEX_NONE
+	 */
+	static int32 FindClosest(const int32* X, const int32* Y, int32 Num, const FIntPoint& From, int32& OutDistance);
+
+	// Reference implementation, used for the tail of the vector version and for comparison in the benchmark
+	static int32 FindClosestScalar(const int32* X, const int32* Y, int32 Num, const FIntPoint& From, int32& OutDistance);
+
+	/**
+	 * Applies the damage taken this step, HP does not go below 0.
+	 * Not used by the step, the ball states are AoS and copying the fields out costs more than the kernel saves.
+	 * -Kernels times it to show what a structure of arrays layout would gain.
+	 * @param HP, Damage - Per ball arrays of Num elements, HP is updated in place
+	 */
+	static void ResolveDamage(int32* HP, const int32* Damage, int32 Num);
+
+	static void ResolveDamageScalar(int32* HP, const int32* Damage, int32 Num);
+
+	/**
+	 * Starts the next attack countdown for balls that attacked in the last step, not used by the step like ResolveDamage.
+	 * @param StepsToAttack - Per ball array of Num elements, zeros are set to Interval
+	 */
+	static void ResetAttackTimers(int32* StepsToAttack, int32 Num, int32 Interval);
+
+	static void ResetAttackTimersScalar(int32* StepsToAttack, int32 Num, int32 Interval);
+};
@@ -0,0 +1,913 @@
+#include "BallSimulation.h"
+
+#include "BallKernels.h"
+#include "LandmarkTable.h"
+#include "SimulationConfig.h"
+#include "SimulationGrid.h"
+#include "SimulationRandom.h"
+#include "SimBalls.h"
+#include "StaticObstacleMap.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogBallSimulation, Log, All)
+
+DECLARE_DWORD_COUNTER_STAT(TEXT("Queued Path Requests"), STAT_SimPathRequests, STATGROUP_SimBalls);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Applied Commands"), STAT_SimAppliedCommands, STATGROUP_SimBalls);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Sleeping Balls"), STAT_SimSleepingBalls, STATGROUP_SimBalls);
+
+namespace
+{
+	// Smallest number of balls handed to a worker in parallel sweeps
+	constexpr int32 ParallelBatchSize = 1024;
+
+	// Random cells tried before searching the grid for a free one
+	constexpr int32 MaxSpawnAttempts = 16;
+
+	// Fewest bytes a ball takes in a saved state without its path, bounds the ball count read from an archive
+	constexpr int64 MinSavedStateSize = 48;
+}
+
+void FBallSimulation::Initialize(const USimulationConfig* InConfig, FSimulationGrid& InGrid)
+{
+	Config = InConfig;
+	Grid = &InGrid;
+	Grid->Initialize(Config->GridSize);
+	Grid->GetPathCache().SetCapacity(Config->PathCacheSize);
+	TSharedPtr<const FStaticObstacleMap> StaticObstacleMap = FStaticObstacleMap::FindOrLoad(Config->StaticObstacleMap);
+	Grid->SetStaticObstacleMap(StaticObstacleMap);
+	Grid->SetLandmarkTable(FLandmarkTable::FindOrBuild(StaticObstacleMap, Config->NumLandmarks));
+
+	BuildTeamRelations();
+
+	// Common settings get a step with constant move rate and attack range
+	if (Config->MoveRate == 1 && Config->AttackRange == 1)
+	{
+		SimulateBallStatesFunc = &FBallSimulation::SimulateBallStates<1, 1>;
+	}
+	else if (Config->MoveRate == 1 && Config->AttackRange == 2)
+	{
+		SimulateBallStatesFunc = &FBallSimulation::SimulateBallStates<1, 2>;
+	}
+	else
+	{
+		SimulateBallStatesFunc = &FBallSimulation::SimulateBallStates<0, 0>;
+	}
+
+	//Note: setting the Seed from config, but this should come from server
+	Seed = Config->Seed;
+	BallStates.Reset();
+	PathRequests.Reset();
+	HasPathRequest.Reset();
+	PathSearch.Reset();
+	SearchingBallID = INDEX_NONE;
+	CommandQueue.Empty();
+	ScheduledCommands.Reset();
+	AppliedCommands.Reset();
+	CommandObstacles.Reset();
+	AttackingBalls.Reset();
+	CurrentStep = 0;
+}
+
+void FBallSimulation::InitializeBalls()
+{
+	BallStates.Reserve(Config->NumBalls);
+
+	// Initialize all the states based on random seed value
+	for (int32 Index = 0; Index < Config->NumBalls; ++Index)
+	{
+		CreateBallState(Index);
+	}
+}
+
+FBallSimulatedState& FBallSimulation::CreateBallState(int32 StateID)
+{
+	// Draws depend only on the ball and the step, not on how many balls spawned before it
+	FSimulationRandom HPRandom(Seed, StateID, CurrentStep, ESimulationRandomPurpose::SpawnHP);
+	FSimulationRandom CellRandom(Seed, StateID, CurrentStep, ESimulationRandomPurpose::SpawnCell);
+
+	const int32 HP = HPRandom.RandRange(Config->MinHP, Config->MaxHP);
+	const FIntPoint GridPosition = SampleFreeCell(CellRandom);
+	// Respawns keep their team, it may have been picked by a spawn command
+	const EBallTeamColor Team = BallStates.IsValidIndex(StateID) ? BallStates[StateID].Team : static_cast<EBallTeamColor>(StateID % TeamPartitions.Num());
+
+	FBallSimulatedState State(StateID, INDEX_NONE, HP, Config->AttackInterval, GridPosition, Team);
+	
+	if (!BallStates.IsValidIndex(StateID))
+	{
+		Grid->AddObstacle(GridPosition);
+		BallStates.Add(MoveTemp(State));
+	}
+	else
+	{
+		FBallSimulatedState& PrevState = GetMutableBallState(StateID);
+		SetActivity(PrevState, EBallActivity::Active);
+		WakeBallsNear(PrevState.GridPosition, PrevState.Team);
+
+		// Free the cell of the previous state so later spawns can use it
+		Grid->UpdateObstacle(PrevState.GridPosition, GridPosition);
+		State.PathRevision = PrevState.PathRevision + 1;
+		PrevState = State;
+	}
+
+	WakeBallsNear(GridPosition, Team);
+
+	return GetMutableBallState(StateID);
+}
+
+FIntPoint FBallSimulation::SampleFreeCell(FSimulationRandom& Random)
+{
+	const int32 GridMax = Config->GridSize - 1;
+
+	FIntPoint Cell = FIntPoint::ZeroValue;
+	for (int32 Attempt = 0; Attempt < MaxSpawnAttempts; ++Attempt)
+	{
+		Cell = FIntPoint(Random.RandRange(0, GridMax), Random.RandRange(0, GridMax));
+		if (!Grid->IsBlocked(Cell))
+		{
+			return Cell;
+		}
+	}
+
+	// Crowded grid - walk from the last sample to the next free cell
+	const int64 NumCells = static_cast<int64>(Config->GridSize) * Config->GridSize;
+	const int64 StartIndex = Grid->GridPositionToIndex(Cell);
+	for (int64 Probe = 1; Probe < NumCells; ++Probe)
+	{
+		const FIntPoint Candidate = Grid->IndexToGridPosition((StartIndex + Probe) % NumCells);
+		if (!Grid->IsBlocked(Candidate))
+		{
+			return Candidate;
+		}
+	}
+
+	// Grid is full - share the cell
+	return Cell;
+}
+
+void FBallSimulation::AdvanceSimulation(double Timestamp)
+{
+	// Step temporaries come from the arena, released at the end of the step
+	FSimulationArena::FScope ArenaScope(Arena);
+
+	// Cells changed from here on are stamped with this step
+	Grid->SetCurrentStep(CurrentStep);
+
+	// Inputs first, the whole step sees their result
+	ApplyCommands();
+
+	// Reset and prepare states for new simulation step (e.g. reset Damage)
+	PrepareBallStates(Timestamp);
+
+	// Paths queued by previous steps, before anyone moves so they start at the current positions
+	ProcessPathRequests();
+	
+	// Balls see the moves of the ones simulated before them - has to run in order
+	(this->*SimulateBallStatesFunc)();
+
+	// Resolve attack/damage
+	ParallelFor(TEXT("SimBalls.ResolveDamage"), BallStates.Num(), ParallelBatchSize, [this](int32 Index)
+	{
+		FBallSimulatedState& State = BallStates[Index];
+		State.HP = FMath::Max(0, State.HP - State.Damage);
+		State.bIsDead = State.HP <= 0;
+	}, GetParallelForFlags());
+
+	CurrentStep++;
+
+	Arena.Reset();
+}
+
+void FBallSimulation::SubmitCommand(FSimulationCommand Command)
+{
+	Command.Sequence = NextCommandSequence.fetch_add(1, std::memory_order_relaxed);
+	CommandQueue.Enqueue(MoveTemp(Command));
+}
+
+void FBallSimulation::ApplyCommands()
+{
+	AppliedCommands.Reset();
+
+	FSimulationCommand Command;
+	while (CommandQueue.Dequeue(Command))
+	{
+		if (Command.TargetStep < CurrentStep)
+		{
+			UE_CLOG(Command.TargetStep != INDEX_NONE, LogBallSimulation, Verbose, TEXT("%s command for step %d applied late at step %d"),
+				LexToString(Command.Type), Command.TargetStep, CurrentStep);
+			Command.TargetStep = CurrentStep;
+		}
+		ScheduledCommands.Add(Command);
+	}
+
+	if (ScheduledCommands.IsEmpty())
+	{
+		SET_DWORD_STAT(STAT_SimAppliedCommands, 0);
+		return;
+	}
+
+	// Producers may enqueue out of order, the sequence restores the submission order
+	ScheduledCommands.Sort([](const FSimulationCommand& A, const FSimulationCommand& B)
+	{
+		return A.TargetStep != B.TargetStep ? A.TargetStep < B.TargetStep : A.Sequence < B.Sequence;
+	});
+
+	int32 NumDue = 0;
+	while (NumDue < ScheduledCommands.Num() && ScheduledCommands[NumDue].TargetStep <= CurrentStep)
+	{
+		ApplyCommand(ScheduledCommands[NumDue]);
+		AppliedCommands.Add(ScheduledCommands[NumDue]);
+		NumDue++;
+	}
+	ScheduledCommands.RemoveAt(0, NumDue, EAllowShrinking::No);
+
+	SET_DWORD_STAT(STAT_SimAppliedCommands, AppliedCommands.Num());
+}
+
+void FBallSimulation::ApplyCommand(const FSimulationCommand& Command)
+{
+	switch (Command.Type)
+	{
+	case ESimulationCommandType::SpawnBall:
+		{
+			FBallSimulatedState& State = CreateBallState(BallStates.Num());
+			if (static_cast<int32>(Command.Team) < TeamPartitions.Num())
+			{
+				State.Team = Command.Team;
+			}
+			if (Grid->IsInside(Command.Cell) && !Grid->IsBlocked(Command.Cell))
+			{
+				Grid->UpdateObstacle(State.GridPosition, Command.Cell);
+				State.GridPosition = Command.Cell;
+			}
+			WakeBallsNear(State.GridPosition, State.Team);
+			OnBallSpawned.ExecuteIfBound(State);
+		}
+		break;
+
+	case ESimulationCommandType::KillBall:
+		if (BallStates.IsValidIndex(Command.BallID) && !GetBallState(Command.BallID).bIsDead)
+		{
+			FBallSimulatedState& State = GetMutableBallState(Command.BallID);
+			State.HP = 0;
+			State.bIsDead = true;
+		}
+		break;
+
+	case ESimulationCommandType::ForceTarget:
+		if (BallStates.IsValidIndex(Command.BallID) && Command.BallID != Command.OtherBallID
+			&& (Command.OtherBallID == INDEX_NONE || BallStates.IsValidIndex(Command.OtherBallID)))
+		{
+			FBallSimulatedState& State = GetMutableBallState(Command.BallID);
+			State.ForcedTargetID = Command.OtherBallID;
+			SetActivity(State, EBallActivity::Active);
+		}
+		break;
+
+	case ESimulationCommandType::AddObstacle:
+		if (Grid->IsInside(Command.Cell))
+		{
+			Grid->SetStaticObstacle(Command.Cell, true);
+			CommandObstacles.Add(Command.Cell);
+		}
+		break;
+
+	case ESimulationCommandType::RemoveObstacle:
+		if (CommandObstacles.Remove(Command.Cell) > 0)
+		{
+			Grid->SetStaticObstacle(Command.Cell, false);
+		}
+		break;
+
+	default:
+		break;
+	}
+}
+
+void FBallSimulation::PrepareBallStates(double Timestamp)
+{
+	// Respawns take free cells - keep them in ID order, their random draws do not depend on it
+	for (FBallSimulatedState& State : BallStates)
+	{
+		// Respawn after death
+		if (State.bIsDead && Timestamp - State.Timestamp > Config->DyingDuration)
+		{
+			OnBallRespawned.ExecuteIfBound(CreateBallState(State.ID));
+			State.Timestamp = Timestamp;
+		}
+	}
+
+	ParallelFor(TEXT("SimBalls.PrepareBallStates"), BallStates.Num(), ParallelBatchSize, [this, Timestamp](int32 Index)
+	{
+		FBallSimulatedState& State = BallStates[Index];
+		if (!State.bIsDead)
+		{
+			State.Timestamp = Timestamp;	
+		}
+
+		// Reset trackers before entering next simulation step
+		State.Damage = 0;
+		State.MoveSteps = 0;
+		// Reset attack if reached attack interval
+		if (State.StepsToAttack == 0)
+		{
+			State.StepsToAttack = Config->AttackInterval;	
+		}
+	}, GetParallelForFlags());
+
+	BuildTeamPartitions();
+
+	Grid->ResetObstacles();
+	
+	for (const FBallSimulatedState& State : BallStates)
+	{
+		Grid->AddObstacle(State.GridPosition);
+	}
+
+	Grid->CommitObstacles();
+}
+
+FORCEINLINE int32 FBallSimulation::GetMoveRate(int32 FixedMoveRate) const
+{
+	return FixedMoveRate > 0 ? FixedMoveRate : Config->MoveRate;
+}
+
+FORCEINLINE int32 FBallSimulation::GetAttackRange(int32 FixedAttackRange) const
+{
+	return FixedAttackRange > 0 ? FixedAttackRange : Config->AttackRange;
+}
+
+template<int32 FixedMoveRate, int32 FixedAttackRange>
+void FBallSimulation::SimulateBallStates()
+{
+	int32 NumSleeping = 0;
+	for (FBallSimulatedState& State : BallStates)
+	{
+		SimulateBallState<FixedMoveRate, FixedAttackRange>(State);
+		NumSleeping += State.Activity != EBallActivity::Active ? 1 : 0;
+	}
+
+	SET_DWORD_STAT(STAT_SimSleepingBalls, NumSleeping);
+}
+
+template<int32 FixedMoveRate, int32 FixedAttackRange>
+void FBallSimulation::SimulateBallState(FBallSimulatedState& State)
+{
+	if (State.bIsDead)
+	{
+		SetActivity(State, EBallActivity::Active);
+		return;
+	}
+
+	// Sleeping balls repeat their last step until woken
+	if (State.Activity == EBallActivity::Attacking)
+	{
+		// Nothing entered or left the range since - the target is still the closest enemy
+		FBallSimulatedState& Target = GetMutableBallState(State.TargetID);
+		if (!Target.bIsDead)
+		{
+			if (--State.StepsToAttack == 0)
+			{
+				ApplyDamage(State, Target);
+			}
+			return;
+		}
+		SetActivity(State, EBallActivity::Active);
+	}
+	else if (State.Activity == EBallActivity::Idle)
+	{
+		if (!HasAliveEnemies(State.Team))
+		{
+			State.StepsToAttack = Config->AttackInterval;
+			return;
+		}
+		SetActivity(State, EBallActivity::Active);
+	}
+
+	if (!ProcessCombatState<FixedAttackRange>(State))
+	{
+		ProcessMovementState<FixedMoveRate, FixedAttackRange>(State);
+
+		// reset attack timer when no longer in combat
+		State.StepsToAttack = Config->AttackInterval;
+	}
+}
+
+template<int32 FixedAttackRange>
+bool FBallSimulation::ProcessCombatState(FBallSimulatedState& State)
+{
+	int32 EnemyDistance = 0;
+	if (State.ForcedTargetID != INDEX_NONE && !GetBallState(State.ForcedTargetID).bIsDead)
+	{
+		const FIntPoint& TargetPosition = GetBallState(State.ForcedTargetID).GridPosition;
+		State.TargetID = State.ForcedTargetID;
+		EnemyDistance = FMath::Abs(TargetPosition.X - State.GridPosition.X) + FMath::Abs(TargetPosition.Y - State.GridPosition.Y);
+	}
+	else
+	{
+		// Forced target died - back to the closest enemy
+		State.ForcedTargetID = INDEX_NONE;
+
+		if (!FindClosestEnemy(State, State.TargetID, EnemyDistance))
+		{
+			if (bSleepingEnabled)
+			{
+				SetActivity(State, EBallActivity::Idle);
+			}
+			return false;	
+		}
+	}
+
+	// Enter fighting mode at range - this will stop movement
+	if (EnemyDistance <= GetAttackRange(FixedAttackRange))
+	{
+		// Forced targets may walk away without an enemy moving near
+		if (bSleepingEnabled && State.ForcedTargetID == INDEX_NONE)
+		{
+			SetActivity(State, EBallActivity::Attacking);
+		}
+
+		// Apply damage according to expected time step
+		if (--State.StepsToAttack == 0)
+		{
+			ApplyDamage(State, GetMutableBallState(State.TargetID));
+		}
+		
+		return true;
+	}
+	
+	return false;
+}
+
+template<int32 FixedMoveRate, int32 FixedAttackRange>
+bool FBallSimulation::ProcessMovementState(FBallSimulatedState& State)
+{
+	if (!State.IsTargetValid())
+	{
+		return false;
+	}
+	
+	// Stays on the cell its stopped search started from
+	if (State.ID == SearchingBallID)
+	{
+		return true;
+	}
+
+	const FIntPoint& TargetPosition = GetBallState(State.TargetID).GridPosition;
+
+	// We cache the path and generate when anything changed only
+	// Note: should be done in Async task
+	const EPathRegenReason RegenReason = Grid->ShouldRegeneratePath(State.GridPosition, TargetPosition, State.GridPath, State.PathIndex, State.PathValidatedStep, GetAttackRange(FixedAttackRange));
+	if (RegenReason == EPathRegenReason::None)
+	{
+		// Next check only looks at cells changed from now on
+		State.PathValidatedStep = CurrentStep;
+	}
+	else if (ShouldRegenerate(RegenReason))
+	{
+		if (Config->PathExpansionBudget > 0)
+		{
+			RequestPath(State, RegenReason);
+
+			// Last path still leads from the current cell - walk it until the request is served
+			if (RegenReason == EPathRegenReason::GoalChanged || RegenReason == EPathRegenReason::Obstacle)
+			{
+				ApplyMovement<FixedMoveRate, FixedAttackRange>(State, true);
+			}
+			return true;
+		}
+
+		State.PathIndex = 0;
+		State.PathValidatedStep = INDEX_NONE;
+		Grid->FindPathAStar(State.GridPosition, TargetPosition, State.GridPath, RegenReason);
+		State.PathRevision++;
+	}
+
+	ApplyMovement<FixedMoveRate, FixedAttackRange>(State);
+
+	return true;
+}
+
+void FBallSimulation::RequestPath(FBallSimulatedState& State, EPathRegenReason Reason)
+{
+	if (HasPathRequest.Num() <= State.ID)
+	{
+		HasPathRequest.Add(false, State.ID + 1 - HasPathRequest.Num());
+	}
+
+	if (HasPathRequest[State.ID])
+	{
+		return;
+	}
+
+	const FIntPoint& TargetPosition = GetBallState(State.TargetID).GridPosition;
+	const int32 Distance = FMath::Abs(TargetPosition.X - State.GridPosition.X) + FMath::Abs(TargetPosition.Y - State.GridPosition.Y);
+	const bool bHasUsablePath = Reason == EPathRegenReason::GoalChanged || Reason == EPathRegenReason::Obstacle;
+
+	FPathRequest Request;
+	Request.BallID = State.ID;
+	Request.Priority = (bHasUsablePath ? (1 << 30) : 0) + FMath::Min(Distance, (1 << 30) - 1);
+	Request.Reason = Reason;
+
+	PathRequests.HeapPush(Request);
+	HasPathRequest[State.ID] = true;
+}
+
+void FBallSimulation::ProcessPathRequests()
+{
+	int32 ExpansionsLeft = Config->PathExpansionBudget;
+
+	// Search stopped at the budget last step goes first, its ball did not move since it started
+	if (SearchingBallID != INDEX_NONE && ExpansionsLeft > 0)
+	{
+		FBallSimulatedState& State = GetMutableBallState(SearchingBallID);
+		int32 Expansions = 0;
+		if (State.bIsDead || State.GridPosition != PathSearch.Start)
+		{
+			// Respawned or moved by a command, the ball asks again when it needs a path
+			PathSearch.Reset();
+		}
+		else if (Grid->ContinuePathSearch(PathSearch, ExpansionsLeft, State.GridPath, SearchReason, Expansions))
+		{
+			State.PathIndex = 0;
+			State.PathValidatedStep = INDEX_NONE;
+			State.PathRevision++;
+		}
+
+		if (!PathSearch.IsActive())
+		{
+			HasPathRequest[SearchingBallID] = false;
+			SearchingBallID = INDEX_NONE;
+		}
+		ExpansionsLeft -= Expansions;
+	}
+
+	// Searches stop when the budget runs out, the request keeps its search for the next step
+	while (PathRequests.Num() > 0 && ExpansionsLeft > 0 && SearchingBallID == INDEX_NONE)
+	{
+		FPathRequest Request;
+		PathRequests.HeapPop(Request, EAllowShrinking::No);
+
+		FBallSimulatedState& State = GetMutableBallState(Request.BallID);
+		if (State.bIsDead || !State.IsTargetValid())
+		{
+			HasPathRequest[Request.BallID] = false;
+			continue;
+		}
+
+		int32 Expansions = 0;
+		if (!Grid->StartPathSearch(PathSearch, State.GridPosition, GetBallState(State.TargetID).GridPosition, ExpansionsLeft, State.GridPath, Request.Reason, Expansions))
+		{
+			SearchingBallID = Request.BallID;
+			SearchReason = Request.Reason;
+			break;
+		}
+
+		HasPathRequest[Request.BallID] = false;
+		State.PathIndex = 0;
+		State.PathValidatedStep = INDEX_NONE;
+		State.PathRevision++;
+
+		ExpansionsLeft -= FMath::Max(Expansions, 1);
+	}
+
+	SET_DWORD_STAT(STAT_SimPathRequests, PathRequests.Num());
+}
+
+template<int32 FixedMoveRate, int32 FixedAttackRange>
+void FBallSimulation::ApplyMovement(FBallSimulatedState& State, bool bStopAtObstacle)
+{
+	const FIntPoint PrevPosition = State.GridPosition;
+	const int32 MoveRate = GetMoveRate(FixedMoveRate);
+	const int32 AttackRange = GetAttackRange(FixedAttackRange);
+	
+	while (State.MoveSteps < MoveRate && State.PathIndex < State.GridPath.Num() - 1 - AttackRange)
+	{
+		if (bStopAtObstacle && Grid->IsBlocked(State.GridPath[State.PathIndex + 1]))
+		{
+			break;
+		}
+
+		State.MoveSteps++;
+		// start from the next grid position and move until MoveStep or Goal is reached
+		State.GridPosition = State.GridPath[++State.PathIndex];
+	}
+	
+	// prevent other state finding the same goal position
+	Grid->UpdateObstacle(PrevPosition, State.GridPosition);
+
+	if (PrevPosition != State.GridPosition)
+	{
+		WakeBallsNear(PrevPosition, State.Team);
+		WakeBallsNear(State.GridPosition, State.Team);
+	}
+
+	// Balls simulated after this one have to see the new position
+	FTeamPartition& Partition = TeamPartitions[static_cast<int32>(State.Team)];
+	const int32 Slot = PartitionSlots[State.ID];
+	Partition.X[Slot] = State.GridPosition.X;
+	Partition.Y[Slot] = State.GridPosition.Y;
+}
+
+void FBallSimulation::ApplyDamage(FBallSimulatedState& Attacker, FBallSimulatedState& Receiver)
+{
+	// accumulate damage and set at the end of simulation
+	//Note: Attacker could provide Damage size
+	Receiver.Damage++;
+}
+
+bool FBallSimulation::FindClosestEnemy(const FBallSimulatedState& State, int32& OutEnemy, int32& OutDistance)
+{
+	OutEnemy = INDEX_NONE;
+	OutDistance = MAX_int32;
+
+	// Partitions hold living balls only, no filtering inside the scan
+	for (uint32 Teams = HostileTeams[static_cast<int32>(State.Team)] & AliveTeams; Teams != 0; Teams &= Teams - 1)
+	{
+		const FTeamPartition& Partition = TeamPartitions[FMath::CountTrailingZeros(Teams)];
+
+		int32 Distance = 0;
+		const int32 Slot = FBallKernels::FindClosest(Partition.X.GetData(), Partition.Y.GetData(), Partition.X.Num(), State.GridPosition, Distance);
+
+		// Partitions are in ID order, so ties go to the lowest ID like a single scan over all balls
+		if (Slot != INDEX_NONE && (Distance < OutDistance || (Distance == OutDistance && Partition.BallIDs[Slot] < OutEnemy)))
+		{
+			OutDistance = Distance;
+			OutEnemy = Partition.BallIDs[Slot];
+		}
+	}
+
+	return OutEnemy != INDEX_NONE;
+}
+
+void FBallSimulation::BuildTeamRelations()
+{
+	const int32 NumTeams = FMath::Clamp(Config->NumTeams, 1, MaxBallTeams);
+	const uint32 AllTeams = NumTeams == MaxBallTeams ? MAX_uint32 : (1u << NumTeams) - 1;
+
+	FMemory::Memzero(HostileTeams);
+	for (int32 Team = 0; Team < NumTeams; ++Team)
+	{
+		uint32 FriendlyTeams = 1u << Team;
+		for (const int32 Alliance : Config->TeamAlliances)
+		{
+			if (static_cast<uint32>(Alliance) & (1u << Team))
+			{
+				FriendlyTeams |= static_cast<uint32>(Alliance);
+			}
+		}
+		HostileTeams[Team] = AllTeams & ~FriendlyTeams;
+	}
+
+	TeamPartitions.SetNum(NumTeams);
+}
+
+void FBallSimulation::BuildTeamPartitions()
+{
+	for (FTeamPartition& Partition : TeamPartitions)
+	{
+		Partition.X.Reset();
+		Partition.Y.Reset();
+		Partition.BallIDs.Reset();
+	}
+
+	PartitionSlots.SetNumUninitialized(BallStates.Num());
+	AliveTeams = 0;
+
+	for (const FBallSimulatedState& State : BallStates)
+	{
+		if (State.bIsDead)
+		{
+			PartitionSlots[State.ID] = INDEX_NONE;
+			continue;
+		}
+
+		const int32 Team = static_cast<int32>(State.Team);
+		FTeamPartition& Partition = TeamPartitions[Team];
+		PartitionSlots[State.ID] = Partition.BallIDs.Add(State.ID);
+		Partition.X.Add(State.GridPosition.X);
+		Partition.Y.Add(State.GridPosition.Y);
+		AliveTeams |= 1u << Team;
+	}
+}
+
+void FBallSimulation::SetSleepingEnabled(bool bInSleepingEnabled)
+{
+	if (bSleepingEnabled && !bInSleepingEnabled)
+	{
+		for (FBallSimulatedState& State : BallStates)
+		{
+			SetActivity(State, EBallActivity::Active);
+		}
+	}
+
+	bSleepingEnabled = bInSleepingEnabled;
+}
+
+void FBallSimulation::SetActivity(FBallSimulatedState& State, EBallActivity Activity)
+{
+	if (State.Activity == Activity)
+	{
+		return;
+	}
+
+	if (State.Activity == EBallActivity::Attacking)
+	{
+		AttackingBalls.Remove(State.GridPosition);
+	}
+
+	State.Activity = Activity;
+
+	if (Activity == EBallActivity::Attacking)
+	{
+		// Cells are shared on a full grid only, the second ball stays awake
+		if (AttackingBalls.Contains(State.GridPosition))
+		{
+			State.Activity = EBallActivity::Active;
+		}
+		else
+		{
+			AttackingBalls.Add(State.GridPosition, State.ID);
+		}
+	}
+}
+
+void FBallSimulation::WakeBallsNear(const FIntPoint& Cell, EBallTeamColor Team)
+{
+	if (AttackingBalls.IsEmpty())
+	{
+		return;
+	}
+
+	// Sleepers are at most attack range away from their target
+	const int32 AttackRange = Config->AttackRange;
+	for (int32 DeltaX = -AttackRange; DeltaX <= AttackRange; ++DeltaX)
+	{
+		const int32 RangeY = AttackRange - FMath::Abs(DeltaX);
+		for (int32 DeltaY = -RangeY; DeltaY <= RangeY; ++DeltaY)
+		{
+			const int32* BallID = AttackingBalls.Find(Cell + FIntPoint(DeltaX, DeltaY));
+			if (BallID && IsHostile(GetBallState(*BallID).Team, Team))
+			{
+				SetActivity(GetMutableBallState(*BallID), EBallActivity::Active);
+			}
+		}
+	}
+}
+
+SIZE_T FBallSimulation::GetAllocatedSize() const
+{
+	SIZE_T Size = BallStates.GetAllocatedSize() + Arena.GetCapacity();
+	Size += TeamPartitions.GetAllocatedSize() + PartitionSlots.GetAllocatedSize();
+	for (const FTeamPartition& Partition : TeamPartitions)
+	{
+		Size += Partition.X.GetAllocatedSize() + Partition.Y.GetAllocatedSize() + Partition.BallIDs.GetAllocatedSize();
+	}
+	Size += AttackingBalls.GetAllocatedSize() + PathRequests.GetAllocatedSize() + PathSearch.GetAllocatedSize();
+	for (const FBallSimulatedState& State : BallStates)
+	{
+		Size += State.GridPath.GetAllocatedSize();
+	}
+	return Size;
+}
+
+uint32 FBallSimulation::ComputeStateHash() const
+{
+	uint32 Hash = FCrc::MemCrc32(&CurrentStep, sizeof(CurrentStep));
+
+	for (const FBallSimulatedState& State : BallStates)
+	{
+		const int32 Fields[] =
+		{
+			State.ID, State.TargetID, State.ForcedTargetID, State.HP, State.StepsToAttack, State.PathIndex, State.MoveSteps,
+			State.GridPosition.X, State.GridPosition.Y, static_cast<int32>(State.Team), State.bIsDead ? 1 : 0
+		};
+		Hash = FCrc::MemCrc32(Fields, sizeof(Fields), Hash);
+	}
+
+	return Hash;
+}
+
+void FBallSimulation::SerializeState(FArchive& Ar, bool bWithPaths)
+{
+	// Set order depends on its history, saved in a fixed one
+	TArray<FIntPoint> SavedObstacles = CommandObstacles.Array();
+	SavedObstacles.Sort([](const FIntPoint& A, const FIntPoint& B)
+	{
+		return A.X != B.X ? A.X < B.X : A.Y < B.Y;
+	});
+
+	// Same layout as serializing the array, paths may be left out
+	int32 NumStates = BallStates.Num();
+	Ar << CurrentStep;
+	Ar << NumStates;
+	if (Ar.IsLoading())
+	{
+		// Count comes from the archive, it has to fit in what is left of it
+		const int64 TotalSize = Ar.TotalSize();
+		if (NumStates < 0 || (TotalSize >= 0 && NumStates > (TotalSize - Ar.Tell()) / MinSavedStateSize))
+		{
+			Ar.SetError();
+			NumStates = 0;
+		}
+		BallStates.Reset();
+		BallStates.SetNum(NumStates);
+	}
+	for (FBallSimulatedState& State : BallStates)
+	{
+		State.Serialize(Ar, bWithPaths);
+	}
+	Ar << PathRequests;
+	Ar << SearchingBallID << SearchReason << PathSearch;
+	Ar << SavedObstacles;
+
+	if (Ar.IsLoading())
+	{
+		if (Ar.IsError() || !IsLoadedStateValid())
+		{
+			UE_LOG(LogBallSimulation, Error, TEXT("Failed to load simulation state from %s at step %d"), *Ar.GetArchiveName(), CurrentStep);
+			Ar.SetError();
+
+			// Nothing of the archive is kept, the simulation is left without balls
+			BallStates.Reset();
+			PathRequests.Reset();
+			HasPathRequest.Reset();
+			PathSearch.Reset();
+			SearchingBallID = INDEX_NONE;
+			AttackingBalls.Reset();
+			BuildTeamPartitions();
+			return;
+		}
+
+		// Grid may still have obstacles added after the save
+		for (const FIntPoint& Cell : CommandObstacles)
+		{
+			Grid->SetStaticObstacle(Cell, false);
+		}
+		CommandObstacles.Reset();
+
+		for (const FIntPoint& Cell : SavedObstacles)
+		{
+			Grid->SetStaticObstacle(Cell, true);
+			CommandObstacles.Add(Cell);
+		}
+
+		// Loaded states are awake
+		AttackingBalls.Reset();
+
+		HasPathRequest.Init(false, BallStates.Num());
+		for (const FPathRequest& Request : PathRequests)
+		{
+			HasPathRequest[Request.BallID] = true;
+		}
+		if (SearchingBallID != INDEX_NONE)
+		{
+			HasPathRequest[SearchingBallID] = true;
+		}
+
+		// Grid still holds the occupancy of whatever ran before, the next respawns sample free cells from it
+		Grid->SetCurrentStep(CurrentStep);
+		Grid->ResetObstacles();
+		for (const FBallSimulatedState& State : BallStates)
+		{
+			Grid->AddObstacle(State.GridPosition);
+		}
+		Grid->CommitObstacles();
+
+		BuildTeamPartitions();
+	}
+}
+
+bool FBallSimulation::IsLoadedStateValid() const
+{
+	const int32 NumStates = BallStates.Num();
+	auto IsBallID = [NumStates](int32 BallID) { return BallID >= 0 && BallID < NumStates; };
+
+	for (int32 Index = 0; Index < NumStates; ++Index)
+	{
+		// IDs index the states
+		const FBallSimulatedState& State = BallStates[Index];
+		if (State.ID != Index || static_cast<int32>(State.Team) >= TeamPartitions.Num() || State.PathIndex < 0
+			|| (State.TargetID != INDEX_NONE && !IsBallID(State.TargetID))
+			|| (State.ForcedTargetID != INDEX_NONE && !IsBallID(State.ForcedTargetID)))
+		{
+			return false;
+		}
+	}
+
+	// At most one request per ball
+	TBitArray<> RequestedIDs(false, NumStates);
+	for (const FPathRequest& Request : PathRequests)
+	{
+		if (!IsBallID(Request.BallID) || RequestedIDs[Request.BallID])
+		{
+			return false;
+		}
+		RequestedIDs[Request.BallID] = true;
+	}
+
+	// The stopped search belongs to a ball that is not queued as well
+	if (SearchingBallID == INDEX_NONE)
+	{
+		return !PathSearch.IsActive();
+	}
+	return IsBallID(SearchingBallID) && !RequestedIDs[SearchingBallID] && PathSearch.IsActive();
+}
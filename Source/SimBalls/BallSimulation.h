@@ -0,0 +1,299 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "BallsTypes.h"
+#include "PathTelemetry.h"
+#include "SimulationArena.h"
+#include "SimulationCommand.h"
+#include "SimulationGrid.h"
+#include "Async/ParallelFor.h"
+#include "Containers/Queue.h"
+
+#include <atomic>
+
+struct FSimulationRandom;
+class USimulationConfig;
+
+DECLARE_DELEGATE_OneParam(FOnBallRespawned, const FBallSimulatedState& /*State*/);
+
+/**
+ * Deterministic ball simulation, independent of the world and visual actors.
+ * Owned by ASimBallsGameState in game and created directly by headless tools.
+ */
+class SIMBALLS_API FBallSimulation
+{
+public:
+	/**
+	 * Binds the simulation to its settings and grid and takes the random seed from the settings.
+	 * @param InConfig - Simulation settings, must outlive the simulation
+	 * @param InGrid - Grid used for obstacles and path finding, must outlive the simulation
+	 */
+	void Initialize(const USimulationConfig* InConfig, FSimulationGrid& InGrid);
+	/**
+	 * Initializes all ball states with random team assignments, each on its own free cell.
+	 */
+	void InitializeBalls();
+	/**
+	 * Advances the simulation by one time step.
+	 * @param Timestamp - The current simulation time
+	 */
+	void AdvanceSimulation(double Timestamp);
+	/**
+	 * Queues a command for the step it targets, callable from any thread without waiting for a running step.
+	 * Commands are stamped with their submission order and applied in it at the start of their step,
+	 * the applied ones are available from GetAppliedCommands() for recording.
+	 */
+	void SubmitCommand(FSimulationCommand Command);
+
+	// All ball states, indexed by ball ID
+	const TArray<FBallSimulatedState>& GetBallStates() const { return BallStates; }
+	const FBallSimulatedState& GetBallState(int32 BallID) const { return BallStates[BallID]; }
+	// Ball IDs go from 0 to the number of balls
+	int32 GetNumBalls() const { return BallStates.Num(); }
+
+	// Number of steps advanced since initialization
+	int32 GetCurrentStep() const { return CurrentStep; }
+
+	// Path requests waiting for expansion budget
+	int32 GetNumPathRequests() const { return PathRequests.Num(); }
+
+	// Commands applied by the last step, stamped with the step they were applied at
+	const TArray<FSimulationCommand>& GetAppliedCommands() const { return AppliedCommands; }
+
+	/**
+	 * Enables spreading the order independent sweeps of a step over worker threads.
+	 * Results are identical either way.
+	 */
+	void SetParallel(bool bInParallel) { bParallel = bInParallel; }
+	bool IsParallel() const { return bParallel; }
+
+	/**
+	 * Lets balls in range of their target or without enemies skip the enemy scan until an event wakes them, see EBallActivity.
+	 * Results are identical either way.
+	 */
+	void SetSleepingEnabled(bool bInSleepingEnabled);
+	bool IsSleepingEnabled() const { return bSleepingEnabled; }
+
+	/**
+	 * Hash of the gameplay relevant part of all ball states, used to detect divergence.
+	 */
+	uint32 ComputeStateHash() const;
+	/**
+	 * Saves or restores the complete simulation state (balls, cached paths, queued path requests and obstacles added by commands).
+	 * Settings and grid are not included, they have to match the ones used when saving.
+	 * Commands not applied yet are not included either, a recording has them in the steps that applied them.
+	 * Loading rebuilds the ball occupancy of the grid and the team partitions from the loaded balls.
+	 * Counts and IDs read from the archive are checked, on a broken archive it is set to error and the simulation is left without balls.
+	 * @param bWithPaths - false leaves the cached paths out, they have to be restored with RestoreBallPath() before the next step
+	 */
+	void SerializeState(FArchive& Ar, bool bWithPaths = true);
+	// Sets the cached path of a ball loaded without paths
+	void RestoreBallPath(int32 BallID, const TArray<FIntPoint>& Path) { GetMutableBallState(BallID).GridPath = Path; }
+
+	/**
+	 * Memory owned by the simulation (ball states, their cached paths and the step arena).
+	 */
+	SIZE_T GetAllocatedSize() const;
+
+	// Step temporaries, counters describe the last step
+	const FSimulationArena& GetArena() const { return Arena; }
+
+	// Called when a dead ball is brought back with a new state
+	FOnBallRespawned OnBallRespawned;
+
+	// Called when a command adds a ball
+	FOnBallRespawned OnBallSpawned;
+
+private:
+	/**
+	 * Path regeneration waiting for the per step expansion budget.
+	 */
+	struct FPathRequest
+	{
+		int32 BallID = INDEX_NONE;
+		// Lower goes first - balls without a usable path, then the ones closest to their target
+		int32 Priority = 0;
+		EPathRegenReason Reason = EPathRegenReason::None;
+
+		bool operator<(const FPathRequest& Other) const
+		{
+			return Priority != Other.Priority ? Priority < Other.Priority : BallID < Other.BallID;
+		}
+
+		friend FArchive& operator<<(FArchive& Ar, FPathRequest& Request)
+		{
+			return Ar << Request.BallID << Request.Priority << Request.Reason;
+		}
+	};
+
+	/**
+	 * Moves submitted commands to the schedule and applies the ones due at the current step.
+	 */
+	void ApplyCommands();
+	void ApplyCommand(const FSimulationCommand& Command);
+	/**
+	 * Checks the ball IDs, teams and path requests read by SerializeState() before anything indexes with them.
+	 */
+	bool IsLoadedStateValid() const;
+	FBallSimulatedState& GetMutableBallState(int32 BallID) { return BallStates[BallID]; }
+	/**
+	 * Prepares all ball states for a new simulation step.
+	 * Resets temporary flags.
+	 */
+	void PrepareBallStates(double Timestamp);
+	/**
+	 * Runs the order dependent part of a step, every ball sees the moves of the ones simulated before it.
+	 * Templates take MoveRate and AttackRange as constants for common settings, 0 reads them from the config.
+	 * The instance matching the settings is picked once in Initialize().
+	 */
+	template<int32 FixedMoveRate, int32 FixedAttackRange>
+	void SimulateBallStates();
+	/**
+	 * Simulates a single ball's behavior for the current time step.
+	 */
+	template<int32 FixedMoveRate, int32 FixedAttackRange>
+	void SimulateBallState(FBallSimulatedState& State);
+	/**
+	 * Processes combat logic for a ball (attacking and damage).
+	 * @return true if combat occurred, false otherwise
+	 */
+	template<int32 FixedAttackRange>
+	bool ProcessCombatState(FBallSimulatedState& State);
+	/**
+	 * Processes movement logic for a ball.
+	 * @param State - The ball state to process (will be modified)
+	 * @return true if movement occurred, false otherwise
+	 */
+	template<int32 FixedMoveRate, int32 FixedAttackRange>
+	bool ProcessMovementState(FBallSimulatedState& State);
+	/**
+	 * Queues a path regeneration, the ball keeps walking the free part of its last path meanwhile.
+	 */
+	void RequestPath(FBallSimulatedState& State, EPathRegenReason Reason);
+	/**
+	 * Solves queued path requests in priority order until the step expansion budget is used up.
+	 */
+	void ProcessPathRequests();
+	/**
+	 * Applies movement to a ball state based on its current path.
+	 * @param bStopAtObstacle - Stop before blocked cells, for paths that are no longer valid
+	 */
+	template<int32 FixedMoveRate, int32 FixedAttackRange>
+	void ApplyMovement(FBallSimulatedState& State, bool bStopAtObstacle = false);
+	/**
+	 * Applies damage from an attacker to a receiver.
+	 * @param Attacker - The attacking ball state
+	 * @param Receiver - The receiving ball state (will be modified)
+	 */
+	void ApplyDamage(FBallSimulatedState& Attacker, FBallSimulatedState& Receiver);
+	/**
+	 * Finds the closest enemy for a given ball state.
+	 * @return true if an enemy was found, false otherwise
+	 */
+	bool FindClosestEnemy(const FBallSimulatedState& State, int32& OutEnemy, int32& OutDistance);
+	/**
+	 * Creates a new ball state with and appends to BallStates.
+	 * @param StateID - Unique identifier for the new ball
+	 * @return Reference to the newly created ball state
+	 */
+	FBallSimulatedState& CreateBallState(int32 StateID);
+	/**
+	 * Picks a random cell not occupied by another ball.
+	 * Falls back to the next free cell after the last sample when random picks keep hitting occupied ones.
+	 */
+	FIntPoint SampleFreeCell(FSimulationRandom& Random);
+	/**
+	 * Builds the hostile team masks from the team count and alliances of the config.
+	 */
+	void BuildTeamRelations();
+	/**
+	 * Sorts the living balls into their team partitions, in ID order.
+	 */
+	void BuildTeamPartitions();
+	/**
+	 * Moves a ball between activities, keeping the cells of attacking ones.
+	 */
+	void SetActivity(FBallSimulatedState& State, EBallActivity Activity);
+	/**
+	 * Wakes attacking balls of other teams within attack range of a cell a ball entered or left, their closest enemy may have changed.
+	 */
+	void WakeBallsNear(const FIntPoint& Cell, EBallTeamColor Team);
+	bool IsHostile(EBallTeamColor Team, EBallTeamColor OtherTeam) const { return (HostileTeams[static_cast<int32>(Team)] >> static_cast<int32>(OtherTeam)) & 1; }
+	bool HasAliveEnemies(EBallTeamColor Team) const { return (HostileTeams[static_cast<int32>(Team)] & AliveTeams) != 0; }
+
+	int32 GetMoveRate(int32 FixedMoveRate) const;
+	int32 GetAttackRange(int32 FixedAttackRange) const;
+
+	EParallelForFlags GetParallelForFlags() const { return bParallel ? EParallelForFlags::None : EParallelForFlags::ForceSingleThread; }
+
+	// Cached Simulation settings
+	const USimulationConfig* Config = nullptr;
+
+	// Grid system for path finding
+	FSimulationGrid* Grid = nullptr;
+
+	// Collection of all ball simulation states, indexed and simulated in ID order
+	TArray<FBallSimulatedState> BallStates;
+
+	/**
+	 * Living balls of one team as structure of arrays for the closest enemy scan, in ID order.
+	 * Rebuilt every step after respawns, positions follow movement during the step.
+	 */
+	struct FTeamPartition
+	{
+		TArray<int32> X;
+		TArray<int32> Y;
+		TArray<int32> BallIDs;
+	};
+
+	// Partition per team, enemy scans only visit the hostile ones
+	TArray<FTeamPartition> TeamPartitions;
+	// Slot of each ball in its team partition, INDEX_NONE for dead ones
+	TArray<int32> PartitionSlots;
+
+	// Mask of the teams each team fights, the relationship matrix as rows of bits
+	uint32 HostileTeams[MaxBallTeams] = {};
+	// Teams with living balls at the start of the step
+	uint32 AliveTeams = 0;
+
+	// Seed of the counter based random numbers, every draw is derived from it, the ball and the step
+	int32 Seed = 0;
+
+	// SimulateBallStates instance for the current settings
+	void (FBallSimulation::*SimulateBallStatesFunc)() = nullptr;
+
+	// Temporaries of the current step
+	FSimulationArena Arena;
+
+	// Commands submitted from any thread, only the simulation consumes them
+	TQueue<FSimulationCommand, EQueueMode::Mpsc> CommandQueue;
+	std::atomic<uint32> NextCommandSequence = 0;
+
+	// Drained commands waiting for their step, ordered by step and submission
+	TArray<FSimulationCommand> ScheduledCommands;
+	TArray<FSimulationCommand> AppliedCommands;
+
+	// Cells blocked by AddObstacle commands
+	TSet<FIntPoint> CommandObstacles;
+
+	// Sleeping attacking balls by cell
+	TMap<FIntPoint, int32> AttackingBalls;
+
+	// Heap of queued path requests, at most one per ball
+	TArray<FPathRequest> PathRequests;
+	TBitArray<> HasPathRequest;
+
+	// Served request whose search stopped at the budget, continued first next step while its ball waits
+	FPathSearch PathSearch;
+	int32 SearchingBallID = INDEX_NONE;
+	EPathRegenReason SearchReason = EPathRegenReason::None;
+
+	// Steps advanced since initialization
+	int32 CurrentStep = 0;
+
+	// Run order independent sweeps on worker threads
+	bool bParallel = false;
+
+	// Let balls with nothing to do sleep
+	bool bSleepingEnabled = true;
+};
@@ -3,12 +3,31 @@
 
 #include "CoreMinimal.h"
 
+/**
+ * Team of a ball. Matches have USimulationConfig::NumTeams teams, the ones after Blue are only numbered.
+ */
 enum class EBallTeamColor : uint8
 {
 	Red,
 	Blue,
 	
-	Max_None,
+	Max_None = 32,
+};
+
+// Teams fit the bits of a uint32 team mask
+constexpr int32 MaxBallTeams = static_cast<int32>(EBallTeamColor::Max_None);
+
+/**
+ * What a living ball needs from a step. Sleeping balls skip the enemy scan and path checks until an event wakes them.
+ */
+enum class EBallActivity : uint8
+{
+	// Scans for the closest enemy and moves
+	Active,
+	// In range of the closest enemy, only counts down to the next attack until an enemy moves within range or the target dies
+	Attacking,
+	// No enemy alive, waits until one spawns
+	Idle,
 };
 
 struct FBallSimulatedState
@@ -18,14 +37,22 @@ struct FBallSimulatedState
 	
 	int32 ID = INDEX_NONE;
 	int32 TargetID = INDEX_NONE;
+	// Target set by a command, attacked instead of the closest enemy while alive
+	int32 ForcedTargetID = INDEX_NONE;
 	int32 HP = INDEX_NONE;
 	int32 StepsToAttack = INDEX_NONE;
 	int32 PathIndex = 0;
+	// Step GridPath was last found free at, INDEX_NONE to check the whole path. Not saved, loaded paths are checked again
+	int32 PathValidatedStep = INDEX_NONE;
 	int32 MoveSteps = 0;
 	int32 Damage = 0;
+	// Bumped whenever GridPath is replaced, lets observers copy paths only when they changed. Not saved
+	uint32 PathRevision = 0;
 	
 	FIntPoint GridPosition = FIntPoint::ZeroValue;
 	EBallTeamColor Team = EBallTeamColor::Max_None;
+	// Derived from the state, not saved
+	EBallActivity Activity = EBallActivity::Active;
 	
 	bool bIsDead = false;
 	
@@ -49,6 +76,39 @@ struct FBallSimulatedState
 	{
 		return !(ID == INDEX_NONE || HP == INDEX_NONE || StepsToAttack == INDEX_NONE || Team == EBallTeamColor::Max_None);
 	}
+
+	/**
+	 * @param bWithPath - false leaves GridPath out, loading then leaves it empty
+	 */
+	void Serialize(FArchive& Ar, bool bWithPath = true)
+	{
+		uint8 SavedTeam = static_cast<uint8>(Team);
+
+		if (bWithPath)
+		{
+			Ar << GridPath;
+		}
+		else if (Ar.IsLoading())
+		{
+			GridPath.Reset();
+		}
+		Ar << Timestamp;
+		Ar << ID << TargetID << ForcedTargetID << HP << StepsToAttack << PathIndex << MoveSteps << Damage;
+		Ar << GridPosition << SavedTeam << bIsDead;
+
+		Team = static_cast<EBallTeamColor>(SavedTeam);
+		if (Ar.IsLoading())
+		{
+			PathValidatedStep = INDEX_NONE;
+			Activity = EBallActivity::Active;
+		}
+	}
+
+	friend FArchive& operator<<(FArchive& Ar, FBallSimulatedState& State)
+	{
+		State.Serialize(Ar);
+		return Ar;
+	}
 };
 
 struct FBallTimedAction
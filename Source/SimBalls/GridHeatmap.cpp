@@ -0,0 +1,84 @@
+#include "GridHeatmap.h"
+
+namespace
+{
+	// Path counts are shown on a log2 scale up to this many paths per texel
+	constexpr float MaxPathDensityLog2 = 16.0f;
+}
+
+void FGridHeatmap::Initialize(int32 InGridSize)
+{
+	CellsPerTexel = FMath::DivideAndRoundUp(FMath::Max(InGridSize, 1), MaxResolution);
+	Resolution = FMath::DivideAndRoundUp(FMath::Max(InGridSize, 1), CellsPerTexel);
+
+	Values.Reset();
+	Values.SetNumZeroed(Resolution * Resolution);
+	MarkAllDirty();
+}
+
+void FGridHeatmap::SetMode(EGridHeatmapMode InMode)
+{
+	Mode = InMode;
+
+	FMemory::Memzero(Values.GetData(), Values.Num() * Values.GetTypeSize());
+	MarkAllDirty();
+}
+
+void FGridHeatmap::AddValue(const FIntPoint& Cell, int32 Delta)
+{
+	const int32 Column = Cell.X / CellsPerTexel;
+	const int32 Row = Cell.Y / CellsPerTexel;
+	if (Cell.X < 0 || Cell.Y < 0 || Column >= Resolution || Row >= Resolution)
+	{
+		return;
+	}
+
+	Values[Row * Resolution + Column] += Delta;
+
+	DirtyMinRow = FMath::Min(DirtyMinRow, Row);
+	DirtyMaxRow = FMath::Max(DirtyMaxRow, Row);
+}
+
+FColor FGridHeatmap::ToColor(int32 Value) const
+{
+	if (Value <= 0)
+	{
+		return FColor::Transparent;
+	}
+
+	const float Heat = Mode == EGridHeatmapMode::Occupancy
+		? FMath::Clamp(static_cast<float>(Value) / (CellsPerTexel * CellsPerTexel), 0.0f, 1.0f)
+		: FMath::Clamp(FMath::Log2(1.0f + Value) / MaxPathDensityLog2, 0.0f, 1.0f);
+
+	FLinearColor Color = FLinearColor::LerpUsingHSV(FLinearColor::Blue, FLinearColor::Red, Heat);
+	Color.A = 0.35f + 0.65f * Heat;
+	return Color.ToFColor(false);
+}
+
+void FGridHeatmap::MarkAllDirty()
+{
+	DirtyMinRow = 0;
+	DirtyMaxRow = Resolution - 1;
+}
+
+bool FGridHeatmap::ConsumeDirtyRows(TArray<FColor>& OutColors, int32& OutFirstRow, int32& OutNumRows)
+{
+	if (DirtyMaxRow < DirtyMinRow || Values.IsEmpty())
+	{
+		return false;
+	}
+
+	OutFirstRow = DirtyMinRow;
+	OutNumRows = DirtyMaxRow - DirtyMinRow + 1;
+
+	OutColors.SetNumUninitialized(OutNumRows * Resolution);
+	for (int32 Index = 0; Index < OutColors.Num(); ++Index)
+	{
+		OutColors[Index] = ToColor(Values[OutFirstRow * Resolution + Index]);
+	}
+
+	DirtyMinRow = MAX_int32;
+	DirtyMaxRow = INDEX_NONE;
+
+	return true;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+enum class EGridHeatmapMode : uint8
+{
+	None,
+	// Balls per texel
+	Occupancy,
+	// Cells covered by computed paths since the heatmap was enabled
+	PathDensity,
+};
+
+/**
+ * Per-texel counters fed by the simulation grid as cells change, converted to colors only for rows touched since the last upload.
+ * Grids larger than the resolution fold several cells into one texel.
+ */
+class SIMBALLS_API FGridHeatmap
+{
+public:
+	static constexpr int32 MaxResolution = 512;
+
+	/**
+	 * Sizes the heatmap for the grid and clears all values.
+	 */
+	void Initialize(int32 InGridSize);
+
+	/**
+	 * Switches what is counted, clearing all values.
+	 */
+	void SetMode(EGridHeatmapMode InMode);
+	EGridHeatmapMode GetMode() const { return Mode; }
+
+	void AddOccupancy(const FIntPoint& Cell, int32 Delta)
+	{
+		if (Mode == EGridHeatmapMode::Occupancy)
+		{
+			AddValue(Cell, Delta);
+		}
+	}
+
+	void AddPath(TConstArrayView<FIntPoint> Path)
+	{
+		if (Mode == EGridHeatmapMode::PathDensity)
+		{
+			for (const FIntPoint& Cell : Path)
+			{
+				AddValue(Cell, 1);
+			}
+		}
+	}
+
+	int32 GetResolution() const { return Resolution; }
+
+	/**
+	 * Converts the rows changed since the last call to colors, Resolution colors per row.
+	 * @return false when nothing changed
+	 */
+	bool ConsumeDirtyRows(TArray<FColor>& OutColors, int32& OutFirstRow, int32& OutNumRows);
+
+private:
+	void AddValue(const FIntPoint& Cell, int32 Delta);
+	FColor ToColor(int32 Value) const;
+	void MarkAllDirty();
+
+	TArray<int32> Values;
+
+	EGridHeatmapMode Mode = EGridHeatmapMode::None;
+
+	int32 Resolution = 1;
+	int32 CellsPerTexel = 1;
+
+	// Inclusive range of rows changed since the last upload
+	int32 DirtyMinRow = MAX_int32;
+	int32 DirtyMaxRow = INDEX_NONE;
+};
@@ -1,10 +1,23 @@
 
 #include "GridManager.h"
+#include "CanvasItem.h"
 #include "EngineUtils.h"
-#include <queue>
 #include "SimulationConfig.h"
+#include "TextureResource.h"
+#include "Components/LineBatchComponent.h"
+#include "Debug/DebugDrawService.h"
+#include "Engine/Canvas.h"
+#include "Engine/Texture2D.h"
 
-DEFINE_LOG_CATEGORY_STATIC(LogGrid, Log, All)
+namespace
+{
+	// Huge grids draw every Nth line, a line per cell would not be visible anyway
+	constexpr int32 MaxGridLinesPerAxis = 2048;
+
+	// Heatmap overlay size relative to the smaller viewport side
+	constexpr float HeatmapScreenFraction = 0.35f;
+	constexpr float HeatmapScreenMargin = 16.f;
+}
 
 static bool bShowDebugGrid = false;
 static FAutoConsoleVariableRef CVarShowDebugGrid(
@@ -14,6 +27,37 @@ static FAutoConsoleVariableRef CVarShowDebugGrid(
 		ECVF_Cheat
 	);
 
+static int32 DebugHeatmapMode = 0;
+static FAutoConsoleVariableRef CVarDebugHeatmap(
+		TEXT("Sim.DebugHeatmap"),
+		DebugHeatmapMode,
+		TEXT("Shows a grid heatmap overlay. 0: off, 1: ball occupancy, 2: path density since enabled."),
+		ECVF_Cheat
+	);
+
+static FAutoConsoleCommandWithWorldArgsAndOutputDevice CmdPathStats(
+		TEXT("Sim.PathStats"),
+		TEXT("Prints path regeneration counters and histograms by reason and path cache hits. Use 'Sim.PathStats reset' to clear them."),
+		FConsoleCommandWithWorldArgsAndOutputDeviceDelegate::CreateStatic([](const TArray<FString>& Args, UWorld* World, FOutputDevice& Ar)
+		{
+			if (AGridManager* Grid = AGridManager::FindOrSpawnGrid(World))
+			{
+				FPathTelemetry& Telemetry = Grid->GetSimulationGrid().GetTelemetry();
+				FPathCache& PathCache = Grid->GetSimulationGrid().GetPathCache();
+				if (Args.Num() > 0 && Args[0] == TEXT("reset"))
+				{
+					Telemetry.Reset();
+					PathCache.ResetCounters();
+				}
+				else
+				{
+					Telemetry.Dump(Ar);
+					PathCache.Dump(Ar);
+				}
+			}
+		})
+	);
+
 TWeakObjectPtr<AGridManager> AGridManager::GridManager = nullptr;
 
 AGridManager::AGridManager()
@@ -21,307 +65,182 @@ AGridManager::AGridManager()
 	PrimaryActorTick.bCanEverTick = true;
 	PrimaryActorTick.bStartWithTickEnabled = true;
 	PrimaryActorTick.bTickEvenWhenPaused = true;
+
+	GridLines = CreateDefaultSubobject<ULineBatchComponent>(TEXT("GridLines"));
+	GridLines->SetVisibility(false);
+	RootComponent = GridLines;
 }
 
 AGridManager* AGridManager::FindOrSpawnGrid(const UObject* WorldContextObject)
 {
-	// Already cached - return
-	if (AGridManager* FoundGrid = GridManager.Get())
+	UWorld* World = GEngine ? GEngine->GetWorldFromContextObject(WorldContextObject, EGetWorldErrorMode::LogAndReturnNull) : nullptr;
+	if (!World)
+	{
+		return nullptr;
+	}
+
+	// Already cached - return, unless it belongs to another world (e.g. other PIE instance)
+	if (AGridManager* FoundGrid = GridManager.Get(); FoundGrid && FoundGrid->GetWorld() == World)
 	{
 		return FoundGrid;
 	}
 	
-	if (UWorld* World = GEngine ? GEngine->GetWorldFromContextObject(WorldContextObject, EGetWorldErrorMode::LogAndReturnNull) : nullptr)
+	// Try to find GridManager in level
+	for (TActorIterator<AGridManager> It(World); It; ++It)
 	{
-		// Try to find GridManager in level
-		for (TActorIterator<AGridManager> It(World); It; ++It)
-		{
-			GridManager = *It;
-			return *It;
-		}
-
-		// There was no Grid placed in level - spawn new
-		FActorSpawnParameters Params;
-		AGridManager* NewGrid = World->SpawnActor<AGridManager>(Params);
-		GridManager = NewGrid;
-		return NewGrid;
-		
+		GridManager = *It;
+		return *It;
 	}
-	
-	return nullptr;
+
+	// There was no Grid placed in level - spawn new
+	FActorSpawnParameters Params;
+	AGridManager* NewGrid = World->SpawnActor<AGridManager>(Params);
+	GridManager = NewGrid;
+	return NewGrid;
 }
 
-TArray<FIntPoint> AGridManager::FindPathAStar(const FIntPoint& Start, const FIntPoint& Goal)
+void AGridManager::BeginPlay()
 {
-	struct FPathNode
-	{
-		FIntPoint Pos;
-		int32 G = 0;
-		int32 F = 0;
-		int32 ParentIndex = INDEX_NONE;
+	Super::BeginPlay();
 
-		FPathNode() {}
-		FPathNode(FIntPoint InPos, int32 InG, int32 InF, int32 InParent) 
-			: Pos(InPos), G(InG), F(InF), ParentIndex(InParent) {}
+	ApplyConfig(USimulationConfig::Get());
 
-		// lowest final score gets highest priority
-		bool operator<(const FPathNode& Other) const { return F > Other.F; } // min-heap
-	};
+	DrawHeatmapHandle = UDebugDrawService::Register(TEXT("Game"), FDebugDrawDelegate::CreateUObject(this, &AGridManager::DrawHeatmap));
+}
 
-	TArray<FIntPoint> Path;
+void AGridManager::ApplyConfig(const USimulationConfig* Config)
+{
+	GridSize = Config->GridSize;
+	CellSize = Config->CellSize;
+	Heatmap.Initialize(GridSize);
+	SimulationGrid.Initialize(GridSize);
+}
 
-	if (Start == Goal)
-	{
-		return Path;
-	}
-	
-	// Unblock the start and goal so we can generate the path to ball target that by default is not walkable
-	TSet<FIntPoint> TempObstacles = Obstacles;
-	TempObstacles.Remove(Start);
-	TempObstacles.Remove(Goal);
-	
-	TArray<FPathNode> NodePool;
-	TMap<FIntPoint, int32> PosToIndex;
-	TSet<FIntPoint> ClosedSet;
-	std::priority_queue<FPathNode> OpenQueue;
+void AGridManager::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	Super::EndPlay(EndPlayReason);
 
-	// manhatan heuristic (4 directions)
-	auto Heuristic = [](const FIntPoint& A, const FIntPoint& B)
-	{
-		return FMath::Abs(A.X - B.X) + FMath::Abs(A.Y - B.Y);
-	};
+	UDebugDrawService::Unregister(DrawHeatmapHandle);
+	SimulationGrid.SetHeatmap(nullptr);
 
-	// Initial node
-	NodePool.Add(FPathNode(Start, 0, Heuristic(Start, Goal), INDEX_NONE));
-	PosToIndex.Add(Start, 0);
-	OpenQueue.push(NodePool[0]);
-	
-	static const TArray<FIntPoint> Directions = { {1,0}, {-1,0}, {0,1}, {0,-1} };
-	
-	while (!OpenQueue.empty())
+	if (GridManager.Get() == this)
 	{
-		FPathNode CurrentNode = OpenQueue.top();
-		OpenQueue.pop();
-
-		const int32* CurrentIndexPtr = PosToIndex.Find(CurrentNode.Pos);
-		// should never happen
-		if (!CurrentIndexPtr)
-		{
-			continue;
-		}
-		
-		const int32 CurrentIndex = *CurrentIndexPtr;
-		
-		if (CurrentNode.Pos == Goal)
-		{
-			// Reconstruct path
-			int32 TraceIndex = CurrentIndex;
-			while (TraceIndex != INDEX_NONE)
-			{
-				int32 NextIndex = NodePool[TraceIndex].ParentIndex;
-				Path.Add(NodePool[TraceIndex].Pos);
-				TraceIndex = NextIndex;
-			}
-			
-			Algo::Reverse(Path);
-			
-			return Path;
-		}
-		
-		ClosedSet.Add(CurrentNode.Pos);
-
-		for (const FIntPoint& Dir : Directions)
-		{
-			FIntPoint Neighbor = CurrentNode.Pos + Dir;
-            
-			// Boundary check
-			if (Neighbor.X < 0 || Neighbor.Y < 0 || Neighbor.X >= GridSize || Neighbor.Y >= GridSize)
-			{
-				continue;	
-			}
-			
-			// Obstacle/closed set check
-			if (TempObstacles.Contains(Neighbor) || ClosedSet.Contains(Neighbor))
-			{
-				continue;
-			}
-			
-			const int32 GScore = CurrentNode.G + 1;
-
-			if (const int32* ExistingIndex = PosToIndex.Find(Neighbor))
-			{
-				FPathNode& ExistingNode = NodePool[*ExistingIndex];
-				
-				// Existing node - check if this path is better
-				if (GScore < ExistingNode.G)
-				{
-					ExistingNode.G = GScore;
-					ExistingNode.F = GScore + Heuristic(Neighbor, Goal);
-					ExistingNode.ParentIndex = CurrentIndex;
-					OpenQueue.push(ExistingNode);
-				}
-			}
-			else
-			{
-				// New node
-				const int32 NewIndex = NodePool.Add(FPathNode(Neighbor, GScore, GScore + Heuristic(Neighbor, Goal), CurrentIndex));
-				PosToIndex.Add(Neighbor, NewIndex);
-				OpenQueue.push(NodePool[NewIndex]);
-			}
-		}
+		GridManager.Reset();
 	}
-
-	// No path found
-	return Path;
 }
 
-TArray<FIntPoint> AGridManager::FindPathSimple(const FIntPoint& Start, const FIntPoint& Goal)
+// Called every frame
+void AGridManager::Tick(float DeltaTime)
 {
-	TArray<FIntPoint> Path;
-	Path.Reserve(FMath::Abs(Start.X - Goal.X) + FMath::Abs(Start.Y - Goal.Y));
-	Path.Add(Start);
-	
-	FIntPoint NextPathPoint = Start;
+	Super::Tick(DeltaTime);
+
+	// Lines stay in the batch while hidden, toggling only flips visibility
+	GridLines->SetVisibility(bShowDebugGrid);
 	
-	while (NextPathPoint != Goal)
+	if (bShowDebugGrid)
 	{
-		if (NextPathPoint.X < Goal.X)
-		{
-			Path.Add(++NextPathPoint.X);
-		}
-		else if (NextPathPoint.X > Goal.X)
-		{
-			Path.Add(--NextPathPoint.X);
-		}
-		else if (NextPathPoint.Y < Goal.Y)
-		{
-			Path.Add(++NextPathPoint.Y);
-		}
-		else if (NextPathPoint.Y > Goal.Y)
-		{
-			Path.Add(--NextPathPoint.Y);
-		}
+		DebugDrawGrid(DeltaTime);	
 	}
 
-	return Path;
+	UpdateHeatmap();
 }
 
-bool AGridManager::ShouldRegeneratePath(const FIntPoint& Start, const FIntPoint& Goal, const TArray<FIntPoint>& InPath, int32 Range) const
+void AGridManager::DebugDrawGrid(float DeltaTime)
 {
-	if (InPath.IsEmpty())
+	if (GridLinesSize != GridSize || GridLinesCellSize != CellSize || !GridLinesOrigin.Equals(GetActorLocation()))
 	{
-		UE_LOG(LogGrid, Verbose, TEXT("[%hs] Regenerate - Path Empty"), __func__);
-		return true;
+		BuildGridLines();
 	}
+}
 
-	// Reached end already
-	if (IsAtRange(Start, Goal, Range))
-	{
-		UE_LOG(LogGrid, Verbose, TEXT("[%hs] Skip - Goal Reached"), __func__);
-		return false;
-	}
-	
-	// Goal changed - other ball moved away
-	if (Goal != InPath.Last())
+void AGridManager::BuildGridLines()
+{
+	GridLines->Flush();
+
+	GridLinesSize = GridSize;
+	GridLinesCellSize = CellSize;
+	GridLinesOrigin = GetActorLocation();
+
+	const double HalfGridSize = GridSize * static_cast<double>(CellSize) * 0.5;
+	const FVector Origin = GridLinesOrigin + FVector(0.f, 0.f, -80.f);
+	const int32 Stride = FMath::DivideAndRoundUp(FMath::Max(GridSize, 1), MaxGridLinesPerAxis);
+
+	auto DrawLinesAt = [this, HalfGridSize, &Origin](int32 Line)
 	{
-		
-		UE_LOG(LogGrid, Verbose, TEXT("[%hs] Regenerate - Goal changed"), __func__);
-		return true;
-	}
-	
-	//Ignore Start/End for obstacle testing
-	TSet<FIntPoint> TempObstacles = Obstacles;
-	TempObstacles.Remove(Start);
-	TempObstacles.Remove(Goal);
+		const double Pos = -HalfGridSize + Line * static_cast<double>(CellSize);
 
-	bool bFoundStart = false;
-	
-	for (const FIntPoint& Pos : InPath)
+		// Negative life time keeps the lines until the next Flush
+		GridLines->DrawLine(Origin + FVector(Pos, -HalfGridSize, 0.f), Origin + FVector(Pos, HalfGridSize, 0.f), FColor::Green, SDPG_World, 2.f, -1.f);
+		GridLines->DrawLine(Origin + FVector(-HalfGridSize, Pos, 0.f), Origin + FVector(HalfGridSize, Pos, 0.f), FColor::Green, SDPG_World, 2.f, -1.f);
+	};
+
+	for (int32 Line = 0; Line <= GridSize; Line += Stride)
 	{
-		if (!bFoundStart)
-		{
-			bFoundStart = Start == Pos;
-			continue;
-		}
-		
-		if (TempObstacles.Contains(Pos))
-		{
-			UE_LOG(LogGrid, Verbose, TEXT("[%hs] Regenerate - Obstacle"), __func__)
-			return true;
-		}
+		DrawLinesAt(Line);
 	}
 
-	if (!bFoundStart)
+	// Close the outer border skipped by the stride
+	if (GridSize % Stride != 0)
 	{
-		UE_LOG(LogGrid, Verbose, TEXT("[%hs] Regenerate - No Start Found"), __func__)
-		return true;
+		DrawLinesAt(GridSize);
 	}
-	
-	UE_LOG(LogGrid, Verbose, TEXT("[%hs] Skip - Path is the same"), __func__)
-	return false;
-
 }
 
-void AGridManager::SetObstacles(const TSet<FIntPoint>& InObstacles)
+void AGridManager::UpdateHeatmap()
 {
-	Obstacles = InObstacles;
-}
+	const EGridHeatmapMode Mode = static_cast<EGridHeatmapMode>(FMath::Clamp(DebugHeatmapMode, 0, static_cast<int32>(EGridHeatmapMode::PathDensity)));
+	if (Mode != Heatmap.GetMode())
+	{
+		Heatmap.SetMode(Mode);
+		// Unhooked while off so the simulation pays nothing for it
+		SimulationGrid.SetHeatmap(Mode != EGridHeatmapMode::None ? &Heatmap : nullptr);
+	}
 
-void AGridManager::UpdateObstacle(const FIntPoint& PrevObstacle, const FIntPoint& NewObstacle)
-{
-	if (PrevObstacle == NewObstacle)
+	if (Mode == EGridHeatmapMode::None)
 	{
 		return;
 	}
 
-	Obstacles.Remove(PrevObstacle);
-	Obstacles.Add(NewObstacle);
-}
-
-void AGridManager::BeginPlay()
-{
-	Super::BeginPlay();
+	const int32 Resolution = Heatmap.GetResolution();
+	if (!HeatmapTexture || HeatmapTexture->GetSizeX() != Resolution)
+	{
+		HeatmapTexture = UTexture2D::CreateTransient(Resolution, Resolution, PF_B8G8R8A8);
+		HeatmapTexture->SRGB = false;
+		HeatmapTexture->Filter = TF_Nearest;
+		HeatmapTexture->UpdateResource();
+	}
 
-	GridSize = USimulationConfig::Get()->GridSize;
-	CellSize = USimulationConfig::Get()->CellSize;
-}
+	int32 FirstRow = 0;
+	int32 NumRows = 0;
+	if (!Heatmap.ConsumeDirtyRows(HeatmapColors, FirstRow, NumRows))
+	{
+		return;
+	}
 
-void AGridManager::EndPlay(const EEndPlayReason::Type EndPlayReason)
-{
-	Super::EndPlay(EndPlayReason);
+	// Released by the render thread once copied to the texture
+	const int32 NumBytes = HeatmapColors.Num() * sizeof(FColor);
+	uint8* Pixels = static_cast<uint8*>(FMemory::Malloc(NumBytes));
+	FMemory::Memcpy(Pixels, HeatmapColors.GetData(), NumBytes);
+	FUpdateTextureRegion2D* Region = new FUpdateTextureRegion2D(0, FirstRow, 0, 0, Resolution, NumRows);
 
-	GridManager.Reset();
+	HeatmapTexture->UpdateTextureRegions(0, 1, Region, Resolution * sizeof(FColor), sizeof(FColor), Pixels,
+		[](uint8* SrcData, const FUpdateTextureRegion2D* Regions)
+		{
+			FMemory::Free(SrcData);
+			delete Regions;
+		});
 }
 
-// Called every frame
-void AGridManager::Tick(float DeltaTime)
+void AGridManager::DrawHeatmap(UCanvas* Canvas, APlayerController* PlayerController)
 {
-	Super::Tick(DeltaTime);
-
-	if (bShowDebugGrid)
+	if (!HeatmapTexture || Heatmap.GetMode() == EGridHeatmapMode::None || !HeatmapTexture->GetResource())
 	{
-		DebugDrawGrid(DeltaTime);	
+		return;
 	}
-}
 
-void AGridManager::DebugDrawGrid(float DeltaTime)
-{
-	const float HalfGridSize = GridSize * CellSize * 0.5f;
-	const float GridZ = -80.f;
-	
-	for (int32 X = 0; X <= GridSize; ++X)
-	{
-		const float XPos = -HalfGridSize + X * CellSize;
-		const FVector Start = FVector(XPos, -HalfGridSize, GridZ);
-		const FVector End = FVector(XPos, HalfGridSize, GridZ);
-		DrawDebugLine(GetWorld(), Start, End, FColor::Green, false, 0, 0, 2);
-	}
-	
-	for (int32 Y = 0; Y <= GridSize; ++Y)
-	{
-		const float YPos = -HalfGridSize + Y * CellSize;
-		const FVector Start = FVector(-HalfGridSize, YPos, GridZ);
-		const FVector End = FVector(HalfGridSize, YPos, GridZ);
-		DrawDebugLine(GetWorld(), Start, End, FColor::Green, false, 0, 0, 2);
-	}
+	// Grid X goes right, Y goes down
+	const float Size = FMath::Min(Canvas->ClipX, Canvas->ClipY) * HeatmapScreenFraction;
+	FCanvasTileItem Tile(FVector2D(Canvas->ClipX - Size - HeatmapScreenMargin, HeatmapScreenMargin), HeatmapTexture->GetResource(), FVector2D(Size, Size), FLinearColor::White);
+	Tile.BlendMode = SE_BLEND_Translucent;
+	Canvas->DrawItem(Tile);
 }
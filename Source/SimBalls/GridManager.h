@@ -4,8 +4,16 @@
 
 #include "CoreMinimal.h"
 #include "GameFramework/Actor.h"
+#include "GridHeatmap.h"
+#include "SimulationGrid.h"
 #include "GridManager.generated.h"
 
+class APlayerController;
+class UCanvas;
+class ULineBatchComponent;
+class USimulationConfig;
+class UTexture2D;
+
 UCLASS()
 class SIMBALLS_API AGridManager : public AActor
 {
@@ -16,19 +24,13 @@ public:
 
 	static AGridManager* FindOrSpawnGrid(const UObject* WorldContextObject);
 	
-	TArray<FIntPoint> FindPathAStar(const FIntPoint& Start, const FIntPoint& Goal);
-	TArray<FIntPoint> FindPathSimple(const FIntPoint& Start, const FIntPoint& Goal);
-	
-	bool ShouldRegeneratePath(const FIntPoint& Start, const FIntPoint& Goal, const TArray<FIntPoint>& InPath, int32 Range) const;
-	
-	void SetObstacles(const TSet<FIntPoint>& InObstacles);
-	void UpdateObstacle(const FIntPoint& PrevObstacle, const FIntPoint& NewObstacle);
+	FSimulationGrid& GetSimulationGrid() { return SimulationGrid; }
+
+	// Takes grid dimensions from the simulation settings
+	void ApplyConfig(const USimulationConfig* Config);
 	
 	// Helper methods
-	inline int32 GridPositionToIndex(const FIntPoint& GridPos) const;
-	inline FIntPoint IndexToGridPosition(int32 Index) const;
 	inline FVector GridToWorld(const FIntPoint& GridPos) const;
-	inline bool IsAtRange(const FIntPoint& A, const FIntPoint& B, int32 Range) const;
 
 protected:
 	// Begin Base class Interface
@@ -41,7 +43,27 @@ private:
 	
 	static TWeakObjectPtr<AGridManager> GridManager;
 
-	TSet<FIntPoint> Obstacles;
+	// Obstacles and path finding used by the simulation
+	FSimulationGrid SimulationGrid;
+
+	// Persistent grid lines, rebuilt only when the grid dimensions change
+	UPROPERTY(VisibleAnywhere)
+	TObjectPtr<ULineBatchComponent> GridLines;
+
+	UPROPERTY(Transient)
+	TObjectPtr<UTexture2D> HeatmapTexture;
+
+	FGridHeatmap Heatmap;
+
+	// Colors uploaded to HeatmapTexture, kept to avoid reallocating every frame
+	TArray<FColor> HeatmapColors;
+
+	FDelegateHandle DrawHeatmapHandle;
+
+	// Dimensions GridLines were built with
+	int32 GridLinesSize = INDEX_NONE;
+	int32 GridLinesCellSize = INDEX_NONE;
+	FVector GridLinesOrigin = FVector::ZeroVector;
 	
 	UPROPERTY(EditAnywhere)
 	int32 GridSize = 100;
@@ -50,25 +72,14 @@ private:
 	int32 CellSize = 100;
 	
 	void DebugDrawGrid(float DeltaTime);
-};
-
-int32 AGridManager::GridPositionToIndex(const FIntPoint& GridPos) const
-{
-	return FMath::Clamp(GridPos.X, 0, GridSize - 1) * GridSize + FMath::Clamp(GridPos.Y, 0, GridSize - 1);
-}
+	void BuildGridLines();
 
-FIntPoint AGridManager::IndexToGridPosition(int32 Index) const
-{
-	return FIntPoint(Index / GridSize, Index % GridSize);
-}
+	void UpdateHeatmap();
+	void DrawHeatmap(UCanvas* Canvas, APlayerController* PlayerController);
+};
 
 FVector AGridManager::GridToWorld(const FIntPoint& GridPos) const
 {
 	const float HalfSize = GridSize * CellSize * 0.5;
 	return GetActorLocation() + FVector(GridPos.X * CellSize + CellSize * 0.5 - HalfSize, GridPos.Y * CellSize + CellSize * 0.5 - HalfSize, 0.f);
-}
-
-bool AGridManager::IsAtRange(const FIntPoint& A, const FIntPoint& B, int32 Range) const
-{
-	return FMath::Abs(A.X - B.X) + FMath::Abs(A.Y - B.Y) <= Range;
 }
\ No newline at end of file
@@ -0,0 +1,301 @@
+#include "LandmarkTable.h"
+
+#include "StaticObstacleMap.h"
+#include "Async/MappedFileHandle.h"
+#include "HAL/FileManager.h"
+#include "HAL/PlatformFileManager.h"
+#include "Misc/Paths.h"
+#include "Misc/ScopeLock.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogLandmarks, Log, All)
+
+namespace
+{
+	constexpr uint32 LandmarkMagic = 0x4D4C4253; // 'SBLM'
+	constexpr uint32 LandmarkVersion = 1;
+
+	// Larger tables cost more to build than they save on searches
+	constexpr int64 MaxTableBytes = 1024ll * 1024 * 1024;
+
+	constexpr int64 DistancesAlignment = 16;
+
+	struct FLandmarkHeader
+	{
+		uint32 Magic = 0;
+		uint32 Version = 0;
+		int32 GridSize = 0;
+		int32 NumLandmarks = 0;
+		// Identify the obstacle map the table was built from
+		int64 MapFileSize = 0;
+		int64 MapTimestamp = 0;
+		int64 DistancesOffset = 0;
+	};
+
+	FArchive& operator<<(FArchive& Ar, FLandmarkHeader& Header)
+	{
+		Ar << Header.Magic << Header.Version << Header.GridSize << Header.NumLandmarks;
+		Ar << Header.MapFileSize << Header.MapTimestamp << Header.DistancesOffset;
+		return Ar;
+	}
+
+	void GetMapFileStamp(const FStaticObstacleMap& Map, int64& OutFileSize, int64& OutTimestamp)
+	{
+		OutFileSize = IFileManager::Get().FileSize(*Map.GetFilename());
+		OutTimestamp = IFileManager::Get().GetTimeStamp(*Map.GetFilename()).GetTicks();
+	}
+
+	FString GetCachePath(const FStaticObstacleMap& Map, int32 NumLandmarks)
+	{
+		return FPaths::ProjectSavedDir() / TEXT("Landmarks") / FString::Printf(TEXT("%s_%08x_%d.alt"),
+			*FPaths::GetBaseFilename(Map.GetFilename()), GetTypeHash(Map.GetFilename()), NumLandmarks);
+	}
+
+	/**
+	 * Breadth first distances from Source over cells free of terrain, saturated below Unreachable.
+	 */
+	void ComputeDistances(const FStaticObstacleMap& Map, const FIntPoint& Source, TArray64<uint16>& OutDistances, TArray64<int64>& Queue)
+	{
+		const int32 GridSize = Map.GetGridSize();
+
+		OutDistances.Init(FLandmarkTable::Unreachable, static_cast<int64>(GridSize) * GridSize);
+		Queue.Reset();
+
+		const int64 SourceIndex = static_cast<int64>(Source.X) * GridSize + Source.Y;
+		OutDistances[SourceIndex] = 0;
+		Queue.Add(SourceIndex);
+
+		static const FIntPoint Directions[] = { {1,0}, {-1,0}, {0,1}, {0,-1} };
+
+		for (int64 Head = 0; Head < Queue.Num(); ++Head)
+		{
+			const int64 Index = Queue[Head];
+			const FIntPoint Cell(static_cast<int32>(Index / GridSize), static_cast<int32>(Index % GridSize));
+			const uint16 NextDistance = FMath::Min<uint16>(OutDistances[Index] + 1, FLandmarkTable::Unreachable - 1);
+
+			for (const FIntPoint& Dir : Directions)
+			{
+				const FIntPoint Neighbor = Cell + Dir;
+				if (Neighbor.X < 0 || Neighbor.Y < 0 || Neighbor.X >= GridSize || Neighbor.Y >= GridSize || Map.IsBlocked(Neighbor))
+				{
+					continue;
+				}
+
+				const int64 NeighborIndex = static_cast<int64>(Neighbor.X) * GridSize + Neighbor.Y;
+				if (OutDistances[NeighborIndex] == FLandmarkTable::Unreachable)
+				{
+					OutDistances[NeighborIndex] = NextDistance;
+					Queue.Add(NeighborIndex);
+				}
+			}
+		}
+	}
+
+	// Tables shared by all grids, keyed by cache path
+	FCriticalSection LoadedTablesLock;
+	TMap<FString, TWeakPtr<const FLandmarkTable>> LoadedTables;
+}
+
+FLandmarkTable::~FLandmarkTable()
+{
+	MappedRegion.Reset();
+	MappedHandle.Reset();
+}
+
+TSharedPtr<const FLandmarkTable> FLandmarkTable::FindOrBuild(const TSharedPtr<const FStaticObstacleMap>& Map, int32 NumLandmarks)
+{
+	if (!Map || NumLandmarks <= 0)
+	{
+		return nullptr;
+	}
+
+	NumLandmarks = FMath::Min(NumLandmarks, MaxLandmarks);
+
+	const int64 TableBytes = static_cast<int64>(Map->GetGridSize()) * Map->GetGridSize() * NumLandmarks * sizeof(uint16);
+	if (TableBytes > MaxTableBytes)
+	{
+		UE_LOG(LogLandmarks, Warning, TEXT("Skipping landmarks for %s, %d landmarks need %lld MB"), *Map->GetFilename(), NumLandmarks, TableBytes >> 20);
+		return nullptr;
+	}
+
+	const FString CachePath = GetCachePath(*Map, NumLandmarks);
+
+	FScopeLock Lock(&LoadedTablesLock);
+
+	if (TSharedPtr<const FLandmarkTable> Existing = LoadedTables.FindRef(CachePath).Pin())
+	{
+		return Existing;
+	}
+
+	TSharedPtr<FLandmarkTable> Table = MakeShared<FLandmarkTable>();
+	if (!Table->Load(CachePath, *Map))
+	{
+		Table = MakeShared<FLandmarkTable>();
+		if (!Build(CachePath, *Map, NumLandmarks) || !Table->Load(CachePath, *Map))
+		{
+			return nullptr;
+		}
+	}
+
+	LoadedTables.Add(CachePath, Table);
+	return Table;
+}
+
+bool FLandmarkTable::Load(const FString& InFilename, const FStaticObstacleMap& Map)
+{
+	IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+	if (!PlatformFile.FileExists(*InFilename))
+	{
+		return false;
+	}
+
+	MappedHandle.Reset(PlatformFile.OpenMapped(*InFilename));
+	if (!MappedHandle)
+	{
+		return false;
+	}
+
+	const int64 FileSize = MappedHandle->GetFileSize();
+	if (FileSize < static_cast<int64>(sizeof(FLandmarkHeader)))
+	{
+		return false;
+	}
+
+	MappedRegion.Reset(MappedHandle->MapRegion(0, FileSize));
+	if (!MappedRegion)
+	{
+		return false;
+	}
+
+	const uint8* Data = MappedRegion->GetMappedPtr();
+
+	FLandmarkHeader Header;
+	FMemory::Memcpy(&Header, Data, sizeof(FLandmarkHeader));
+
+	int64 MapFileSize = 0;
+	int64 MapTimestamp = 0;
+	GetMapFileStamp(Map, MapFileSize, MapTimestamp);
+
+	const int64 LandmarksSize = Header.NumLandmarks * static_cast<int64>(sizeof(FIntPoint));
+	const int64 DistancesSize = static_cast<int64>(Header.GridSize) * Header.GridSize * Header.NumLandmarks * sizeof(uint16);
+
+	if (Header.Magic != LandmarkMagic || Header.Version != LandmarkVersion || Header.GridSize != Map.GetGridSize()
+		|| Header.NumLandmarks <= 0 || Header.NumLandmarks > MaxLandmarks
+		|| Header.MapFileSize != MapFileSize || Header.MapTimestamp != MapTimestamp
+		|| sizeof(FLandmarkHeader) + LandmarksSize > Header.DistancesOffset || Header.DistancesOffset + DistancesSize > FileSize)
+	{
+		UE_LOG(LogLandmarks, Log, TEXT("Landmark cache %s is out of date"), *InFilename);
+		MappedRegion.Reset();
+		MappedHandle.Reset();
+		return false;
+	}
+
+	GridSize = Header.GridSize;
+	NumLandmarks = Header.NumLandmarks;
+	Landmarks.SetNumUninitialized(NumLandmarks);
+	FMemory::Memcpy(Landmarks.GetData(), Data + sizeof(FLandmarkHeader), LandmarksSize);
+	Distances = reinterpret_cast<const uint16*>(Data + Header.DistancesOffset);
+
+	return true;
+}
+
+bool FLandmarkTable::Build(const FString& InFilename, const FStaticObstacleMap& Map, int32 InNumLandmarks)
+{
+	const uint64 StartCycles = FPlatformTime::Cycles64();
+
+	const int32 MapSize = Map.GetGridSize();
+	const int64 NumCells = static_cast<int64>(MapSize) * MapSize;
+
+	TArray64<uint16> Table;
+	Table.Init(Unreachable, NumCells * InNumLandmarks);
+
+	// Distance to the closest landmark chosen so far, MAX_int32 for cells no landmark reaches
+	TArray64<int32> ClosestDistance;
+	ClosestDistance.Init(MAX_int32, NumCells);
+
+	TArray64<uint16> LandmarkDistances;
+	TArray64<int64> Queue;
+	TArray<FIntPoint> ChosenLandmarks;
+
+	for (int32 LandmarkIndex = 0; LandmarkIndex < InNumLandmarks; ++LandmarkIndex)
+	{
+		// Farthest free cell from the chosen landmarks, cells in regions not reached yet come first
+		int64 BestIndex = INDEX_NONE;
+		int32 BestDistance = 0;
+		for (int64 Index = 0; Index < NumCells; ++Index)
+		{
+			if (ClosestDistance[Index] > BestDistance && !Map.IsBlocked(FIntPoint(static_cast<int32>(Index / MapSize), static_cast<int32>(Index % MapSize))))
+			{
+				BestIndex = Index;
+				BestDistance = ClosestDistance[Index];
+			}
+		}
+
+		if (BestIndex == INDEX_NONE)
+		{
+			break;
+		}
+
+		const FIntPoint Landmark(static_cast<int32>(BestIndex / MapSize), static_cast<int32>(BestIndex % MapSize));
+		ComputeDistances(Map, Landmark, LandmarkDistances, Queue);
+
+		for (int64 Index = 0; Index < NumCells; ++Index)
+		{
+			const uint16 Distance = LandmarkDistances[Index];
+			Table[Index * InNumLandmarks + LandmarkIndex] = Distance;
+
+			if (Distance != Unreachable)
+			{
+				ClosestDistance[Index] = ClosestDistance[Index] == MAX_int32 ? Distance : FMath::Min<int32>(ClosestDistance[Index], Distance);
+			}
+		}
+
+		ChosenLandmarks.Add(Landmark);
+	}
+
+	if (ChosenLandmarks.IsEmpty())
+	{
+		UE_LOG(LogLandmarks, Warning, TEXT("%s has no free cells for landmarks"), *Map.GetFilename());
+		return false;
+	}
+
+	TUniquePtr<FArchive> Writer(IFileManager::Get().CreateFileWriter(*InFilename));
+	if (!Writer)
+	{
+		UE_LOG(LogLandmarks, Error, TEXT("Failed to create landmark cache %s"), *InFilename);
+		return false;
+	}
+
+	FLandmarkHeader Header;
+	Header.Magic = LandmarkMagic;
+	Header.Version = LandmarkVersion;
+	Header.GridSize = MapSize;
+	Header.NumLandmarks = ChosenLandmarks.Num();
+	GetMapFileStamp(Map, Header.MapFileSize, Header.MapTimestamp);
+	Header.DistancesOffset = Align(sizeof(FLandmarkHeader) + ChosenLandmarks.Num() * sizeof(FIntPoint), DistancesAlignment);
+
+	*Writer << Header;
+	Writer->Serialize(ChosenLandmarks.GetData(), ChosenLandmarks.Num() * sizeof(FIntPoint));
+
+	uint8 Padding[DistancesAlignment] = {};
+	Writer->Serialize(Padding, Header.DistancesOffset - Writer->Tell());
+
+	if (ChosenLandmarks.Num() == InNumLandmarks)
+	{
+		Writer->Serialize(Table.GetData(), Table.Num() * sizeof(uint16));
+	}
+	else
+	{
+		// Map ran out of free cells, drop the unused columns
+		for (int64 Index = 0; Index < NumCells; ++Index)
+		{
+			Writer->Serialize(&Table[Index * InNumLandmarks], ChosenLandmarks.Num() * sizeof(uint16));
+		}
+	}
+
+	const bool bSuccess = Writer->Close();
+
+	UE_LOG(LogLandmarks, Display, TEXT("Built %d landmarks for %s in %.2fms"),
+		ChosenLandmarks.Num(), *Map.GetFilename(), FPlatformTime::ToMilliseconds64(FPlatformTime::Cycles64() - StartCycles));
+
+	return bSuccess;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+class FStaticObstacleMap;
+class IMappedFileHandle;
+class IMappedFileRegion;
+
+/**
+ * Shortest 4-way distances from a few landmark cells to every cell of a static obstacle map (ALT heuristic).
+ *
+ * By the triangle inequality |d(L, Goal) - d(L, Cell)| never overestimates the distance between Cell and Goal.
+ * Balls only make paths longer, so the bound stays admissible with dynamic obstacles.
+ * Tables are cached under Saved/Landmarks and memory mapped, distances of one cell are stored next to each other.
+ */
+class SIMBALLS_API FLandmarkTable
+{
+public:
+	// Landmark and cell are in different regions separated by terrain
+	static constexpr uint16 Unreachable = MAX_uint16;
+	static constexpr int32 MaxLandmarks = 32;
+
+	~FLandmarkTable();
+
+	/**
+	 * Returns the table already used by another grid, maps the cached file or builds and caches a new one.
+	 * @return nullptr when there is no map, no landmarks were requested or the table would be too large
+	 */
+	static TSharedPtr<const FLandmarkTable> FindOrBuild(const TSharedPtr<const FStaticObstacleMap>& Map, int32 NumLandmarks);
+
+	int32 GetNumLandmarks() const { return NumLandmarks; }
+	int32 GetGridSize() const { return GridSize; }
+	const FIntPoint& GetLandmark(int32 Index) const { return Landmarks[Index]; }
+
+	/**
+	 * Copies the distances from all landmarks to the cell, used once per search for its goal.
+	 */
+	void GetDistances(const FIntPoint& Cell, uint16* OutDistances) const
+	{
+		FMemory::Memcpy(OutDistances, GetCellDistances(Cell), NumLandmarks * sizeof(uint16));
+	}
+
+	/**
+	 * Largest landmark bound on the distance between the cell and the goal whose distances were copied with GetDistances().
+	 * @return Unreachable when some landmark reaches only one of them, 0 when no landmark reaches both
+	 */
+	int32 GetLowerBound(const FIntPoint& Cell, const uint16* GoalDistances) const
+	{
+		const uint16* CellDistances = GetCellDistances(Cell);
+
+		int32 Bound = 0;
+		for (int32 Index = 0; Index < NumLandmarks; ++Index)
+		{
+			if ((CellDistances[Index] == Unreachable) != (GoalDistances[Index] == Unreachable))
+			{
+				return Unreachable;
+			}
+			if (CellDistances[Index] != Unreachable)
+			{
+				Bound = FMath::Max(Bound, FMath::Abs(CellDistances[Index] - GoalDistances[Index]));
+			}
+		}
+		return Bound;
+	}
+
+private:
+	bool Load(const FString& InFilename, const FStaticObstacleMap& Map);
+	static bool Build(const FString& InFilename, const FStaticObstacleMap& Map, int32 InNumLandmarks);
+
+	const uint16* GetCellDistances(const FIntPoint& Cell) const
+	{
+		return Distances + (static_cast<int64>(Cell.X) * GridSize + Cell.Y) * NumLandmarks;
+	}
+
+	TUniquePtr<IMappedFileHandle> MappedHandle;
+	TUniquePtr<IMappedFileRegion> MappedRegion;
+
+	// View into the mapped region, NumLandmarks values per cell
+	const uint16* Distances = nullptr;
+
+	TArray<FIntPoint> Landmarks;
+
+	int32 GridSize = 0;
+	int32 NumLandmarks = 0;
+};
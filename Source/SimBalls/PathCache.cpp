@@ -0,0 +1,213 @@
+#include "PathCache.h"
+#include "SimBalls.h"
+
+DECLARE_DWORD_COUNTER_STAT(TEXT("Path Cache Hits"), STAT_SimPathCacheHits, STATGROUP_SimBalls);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Path Cache Misses"), STAT_SimPathCacheMisses, STATGROUP_SimBalls);
+
+void FPathCache::SetCapacity(int32 InCapacity)
+{
+	Capacity = FMath::Max(InCapacity, 0);
+	ShardCapacity = Capacity > 0 ? FMath::DivideAndRoundUp(Capacity, NumShards) : 0;
+	Empty();
+}
+
+bool FPathCache::Find(const FIntPoint& Start, const FIntPoint& Goal, TFunctionRef<bool(const FPathCacheEntry&)> IsValid, TArray<FIntPoint>& OutPath, int32& OutExpansions, int32 MaxExpansions)
+{
+	if (!IsEnabled())
+	{
+		return false;
+	}
+
+	const FKey Key{Start, Goal};
+	FShard& Shard = GetShard(Key);
+	{
+		FScopeLock ScopeLock(&Shard.Lock);
+
+		if (const int32* SlotIndex = Shard.SlotIndices.Find(Key))
+		{
+			const int32 Index = *SlotIndex;
+			const FPathCacheEntry& Entry = Shard.Slots[Index].Entry;
+			// A search without the cache would stop at the budget, such entries stay for later lookups
+			if (Entry.Expansions <= MaxExpansions)
+			{
+				if (IsValid(Entry))
+				{
+					OutPath = Entry.Path;
+					OutExpansions = Entry.Expansions;
+
+					Shard.Unlink(Index);
+					Shard.Link(Index);
+
+					++NumHits;
+					INC_DWORD_STAT(STAT_SimPathCacheHits);
+					return true;
+				}
+
+				Shard.Release(Index);
+				++NumStale;
+			}
+		}
+	}
+
+	++NumMisses;
+	INC_DWORD_STAT(STAT_SimPathCacheMisses);
+	return false;
+}
+
+void FPathCache::Add(const FIntPoint& Start, const FIntPoint& Goal, FPathCacheEntry&& Entry)
+{
+	if (!IsEnabled())
+	{
+		return;
+	}
+
+	const FKey Key{Start, Goal};
+	FShard& Shard = GetShard(Key);
+	FScopeLock ScopeLock(&Shard.Lock);
+
+	int32 Index = INDEX_NONE;
+	if (const int32* SlotIndex = Shard.SlotIndices.Find(Key))
+	{
+		// Searched again because the entry was over the caller's expansion budget
+		Index = *SlotIndex;
+		Shard.Unlink(Index);
+		Shard.EntryBytes -= Shard.Slots[Index].Entry.GetAllocatedSize();
+	}
+	else
+	{
+		if (Shard.SlotIndices.Num() >= ShardCapacity)
+		{
+			Shard.Release(Shard.Tail);
+			++NumEvictions;
+		}
+
+		Index = Shard.FreeSlots.Num() > 0 ? Shard.FreeSlots.Pop(EAllowShrinking::No) : Shard.Slots.AddDefaulted();
+		Shard.Slots[Index].Key = Key;
+		Shard.SlotIndices.Add(Key, Index);
+	}
+
+	FPathCacheEntry& Slot = Shard.Slots[Index].Entry;
+	Slot = MoveTemp(Entry);
+	Shard.EntryBytes += Slot.GetAllocatedSize();
+	Shard.Link(Index);
+}
+
+void FPathCache::Empty()
+{
+	for (FShard& Shard : Shards)
+	{
+		FScopeLock ScopeLock(&Shard.Lock);
+		Shard.Reset();
+	}
+}
+
+int32 FPathCache::Num() const
+{
+	int32 Count = 0;
+	for (const FShard& Shard : Shards)
+	{
+		FScopeLock ScopeLock(&Shard.Lock);
+		Count += Shard.SlotIndices.Num();
+	}
+	return Count;
+}
+
+SIZE_T FPathCache::GetAllocatedSize() const
+{
+	SIZE_T Size = 0;
+	for (const FShard& Shard : Shards)
+	{
+		FScopeLock ScopeLock(&Shard.Lock);
+		Size += Shard.SlotIndices.GetAllocatedSize() + Shard.Slots.GetAllocatedSize() + Shard.FreeSlots.GetAllocatedSize() + Shard.EntryBytes;
+	}
+	return Size;
+}
+
+double FPathCache::GetHitRate() const
+{
+	const int64 Lookups = NumHits + NumMisses;
+	return Lookups > 0 ? static_cast<double>(NumHits) / Lookups : 0.0;
+}
+
+void FPathCache::ResetCounters()
+{
+	NumHits = 0;
+	NumMisses = 0;
+	NumStale = 0;
+	NumEvictions = 0;
+}
+
+void FPathCache::Dump(FOutputDevice& Ar) const
+{
+	if (!IsEnabled())
+	{
+		Ar.Logf(TEXT("Path cache disabled"));
+		return;
+	}
+
+	Ar.Logf(TEXT("Path cache: %.1f%% hits (%lld hits, %lld misses, %lld stale, %lld evicted), %d of %d entries, %.1f KB"),
+		GetHitRate() * 100.0, NumHits.load(), NumMisses.load(), NumStale.load(), NumEvictions.load(),
+		Num(), Capacity, GetAllocatedSize() / 1024.0);
+}
+
+void FPathCache::FShard::Link(int32 SlotIndex)
+{
+	FSlot& Slot = Slots[SlotIndex];
+	Slot.Prev = INDEX_NONE;
+	Slot.Next = Head;
+	if (Head != INDEX_NONE)
+	{
+		Slots[Head].Prev = SlotIndex;
+	}
+	Head = SlotIndex;
+	if (Tail == INDEX_NONE)
+	{
+		Tail = SlotIndex;
+	}
+}
+
+void FPathCache::FShard::Unlink(int32 SlotIndex)
+{
+	FSlot& Slot = Slots[SlotIndex];
+	if (Slot.Prev != INDEX_NONE)
+	{
+		Slots[Slot.Prev].Next = Slot.Next;
+	}
+	else
+	{
+		Head = Slot.Next;
+	}
+
+	if (Slot.Next != INDEX_NONE)
+	{
+		Slots[Slot.Next].Prev = Slot.Prev;
+	}
+	else
+	{
+		Tail = Slot.Prev;
+	}
+
+	Slot.Prev = INDEX_NONE;
+	Slot.Next = INDEX_NONE;
+}
+
+void FPathCache::FShard::Release(int32 SlotIndex)
+{
+	Unlink(SlotIndex);
+
+	FSlot& Slot = Slots[SlotIndex];
+	SlotIndices.Remove(Slot.Key);
+	EntryBytes -= Slot.Entry.GetAllocatedSize();
+	Slot.Entry = FPathCacheEntry();
+	FreeSlots.Add(SlotIndex);
+}
+
+void FPathCache::FShard::Reset()
+{
+	SlotIndices.Reset();
+	Slots.Reset();
+	FreeSlots.Reset();
+	Head = INDEX_NONE;
+	Tail = INDEX_NONE;
+	EntryBytes = 0;
+}
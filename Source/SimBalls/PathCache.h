@@ -0,0 +1,135 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include <atomic>
+
+/**
+ * Grid region an A* search looked at, one bit per 64 cell word of a grid chunk.
+ */
+struct FPathCacheRegion
+{
+	FIntPoint ChunkCoord = FIntPoint::ZeroValue;
+	uint16 WordMask = 0;
+	// The chunk was allocated when the search ran, a released chunk may have freed cells
+	bool bExisted = false;
+};
+
+/**
+ * Search result kept by FPathCache.
+ */
+struct FPathCacheEntry
+{
+	TArray<FIntPoint> Path;
+	// Cells the search tested for obstacles
+	TArray<FPathCacheRegion> Regions;
+	// Expansions of the original search, reported again on hits so path budgets stay the same
+	int32 Expansions = 0;
+	// Grid change stamp when the search ran, regions changed at or after it make the entry stale
+	uint32 Stamp = 0;
+
+	SIZE_T GetAllocatedSize() const { return Path.GetAllocatedSize() + Regions.GetAllocatedSize(); }
+};
+
+/**
+ * Bounded least recently used cache of A* results keyed by start and goal cell.
+ * Entries are validated by the grid against the obstacle changes in the regions they searched,
+ * so a hit returns exactly what a new search would.
+ *
+ * Entries are spread over independently locked shards so the cache itself can be shared between threads.
+ * The grid still runs its searches on one thread, see FSimulationGrid::FindPathAStar().
+ */
+class SIMBALLS_API FPathCache
+{
+public:
+	/**
+	 * Drops all entries and sets the number kept, 0 disables the cache.
+	 */
+	void SetCapacity(int32 InCapacity);
+	int32 GetCapacity() const { return Capacity; }
+	bool IsEnabled() const { return Capacity > 0; }
+
+	/**
+	 * Copies the cached path when there is an entry that IsValid accepts, stale entries are removed.
+	 * @param IsValid - Called with the shard locked
+	 * @param OutPath - Keeps its allocation when large enough
+	 * @param MaxExpansions - Entries whose search expanded more nodes are kept but not returned
+	 * @return false on a miss, OutPath is unchanged
+	 */
+	bool Find(const FIntPoint& Start, const FIntPoint& Goal, TFunctionRef<bool(const FPathCacheEntry&)> IsValid, TArray<FIntPoint>& OutPath, int32& OutExpansions, int32 MaxExpansions = MAX_int32);
+
+	/**
+	 * Adds or replaces the entry for Start and Goal, evicting the least recently used one of its shard when full.
+	 */
+	void Add(const FIntPoint& Start, const FIntPoint& Goal, FPathCacheEntry&& Entry);
+
+	// Drops all entries, counters are kept
+	void Empty();
+
+	int32 Num() const;
+	SIZE_T GetAllocatedSize() const;
+
+	int64 GetNumHits() const { return NumHits; }
+	int64 GetNumMisses() const { return NumMisses; }
+	// Misses that found a stale entry
+	int64 GetNumStale() const { return NumStale; }
+	int64 GetNumEvictions() const { return NumEvictions; }
+	double GetHitRate() const;
+
+	void ResetCounters();
+
+	/**
+	 * Writes hit rate, entry count and memory to the given output.
+	 */
+	void Dump(FOutputDevice& Ar) const;
+
+private:
+	static constexpr int32 NumShards = 16;
+
+	struct FKey
+	{
+		FIntPoint Start;
+		FIntPoint Goal;
+
+		bool operator==(const FKey& Other) const { return Start == Other.Start && Goal == Other.Goal; }
+		friend uint32 GetTypeHash(const FKey& Key) { return HashCombineFast(GetTypeHash(Key.Start), GetTypeHash(Key.Goal)); }
+	};
+
+	struct FSlot
+	{
+		FKey Key;
+		FPathCacheEntry Entry;
+		// Neighbours in the recency list, INDEX_NONE at its ends
+		int32 Prev = INDEX_NONE;
+		int32 Next = INDEX_NONE;
+	};
+
+	struct FShard
+	{
+		mutable FCriticalSection Lock;
+		TMap<FKey, int32> SlotIndices;
+		TArray<FSlot> Slots;
+		TArray<int32> FreeSlots;
+		// Most and least recently used slot
+		int32 Head = INDEX_NONE;
+		int32 Tail = INDEX_NONE;
+		SIZE_T EntryBytes = 0;
+
+		void Link(int32 SlotIndex);
+		void Unlink(int32 SlotIndex);
+		void Release(int32 SlotIndex);
+		void Reset();
+	};
+
+	FShard& GetShard(const FKey& Key) { return Shards[GetTypeHash(Key) % NumShards]; }
+
+	FShard Shards[NumShards];
+
+	int32 Capacity = 0;
+	int32 ShardCapacity = 0;
+
+	std::atomic<int64> NumHits = 0;
+	std::atomic<int64> NumMisses = 0;
+	std::atomic<int64> NumStale = 0;
+	std::atomic<int64> NumEvictions = 0;
+};
@@ -0,0 +1,100 @@
+#include "PathTelemetry.h"
+#include "SimBalls.h"
+
+DECLARE_DWORD_COUNTER_STAT(TEXT("Regen - Path Empty"), STAT_SimRegenPathEmpty, STATGROUP_SimBalls);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Regen - Goal Changed"), STAT_SimRegenGoalChanged, STATGROUP_SimBalls);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Regen - Obstacle"), STAT_SimRegenObstacle, STATGROUP_SimBalls);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Regen - No Start Found"), STAT_SimRegenNoStartFound, STATGROUP_SimBalls);
+DECLARE_DWORD_COUNTER_STAT(TEXT("A* Expansions"), STAT_SimPathExpansions, STATGROUP_SimBalls);
+DECLARE_DWORD_COUNTER_STAT(TEXT("A* Failures"), STAT_SimPathFailures, STATGROUP_SimBalls);
+
+const TCHAR* LexToString(EPathRegenReason Reason)
+{
+	switch (Reason)
+	{
+	case EPathRegenReason::None:			return TEXT("Path Valid");
+	case EPathRegenReason::GoalReached:		return TEXT("Goal Reached");
+	case EPathRegenReason::PathEmpty:		return TEXT("Path Empty");
+	case EPathRegenReason::GoalChanged:		return TEXT("Goal Changed");
+	case EPathRegenReason::Obstacle:		return TEXT("Obstacle");
+	case EPathRegenReason::NoStartFound:	return TEXT("No Start Found");
+	default:								return TEXT("Unknown");
+	}
+}
+
+void FPathTelemetry::RecordSearch(EPathRegenReason Reason, int32 PathLength, int32 Expansions, uint64 Cycles)
+{
+	FReasonStats& Stats = Reasons[static_cast<int32>(Reason)];
+	Stats.Searches++;
+	Stats.Failures += PathLength == 0 ? 1 : 0;
+	Stats.TotalPathLength += PathLength;
+	Stats.TotalExpansions += Expansions;
+	Stats.MaxExpansions = FMath::Max(Stats.MaxExpansions, Expansions);
+	Stats.TotalCycles += Cycles;
+	Stats.PathLengthHistogram[GetHistogramBucket(PathLength)]++;
+	Stats.ExpansionsHistogram[GetHistogramBucket(Expansions)]++;
+
+	INC_DWORD_STAT_BY(STAT_SimPathExpansions, Expansions);
+	if (PathLength == 0)
+	{
+		INC_DWORD_STAT(STAT_SimPathFailures);
+	}
+
+	switch (Reason)
+	{
+	case EPathRegenReason::PathEmpty:		INC_DWORD_STAT(STAT_SimRegenPathEmpty); break;
+	case EPathRegenReason::GoalChanged:		INC_DWORD_STAT(STAT_SimRegenGoalChanged); break;
+	case EPathRegenReason::Obstacle:		INC_DWORD_STAT(STAT_SimRegenObstacle); break;
+	case EPathRegenReason::NoStartFound:	INC_DWORD_STAT(STAT_SimRegenNoStartFound); break;
+	default: break;
+	}
+}
+
+void FPathTelemetry::Reset()
+{
+	for (FReasonStats& Stats : Reasons)
+	{
+		Stats = FReasonStats();
+	}
+
+	TotalRemainingCells = 0;
+	TotalTestedCells = 0;
+}
+
+void FPathTelemetry::Dump(FOutputDevice& Ar) const
+{
+	auto HistogramToString = [](const int64 (&Histogram)[NumHistogramBuckets])
+	{
+		FString Result;
+		for (int32 Bucket = 0; Bucket < NumHistogramBuckets; ++Bucket)
+		{
+			if (Histogram[Bucket] > 0)
+			{
+				const int32 BucketMin = Bucket == 0 ? 0 : 1 << (Bucket - 1);
+				Result += FString::Printf(TEXT(" %d+:%lld"), BucketMin, Histogram[Bucket]);
+			}
+		}
+		return Result;
+	};
+
+	Ar.Logf(TEXT("%-16s %10s %10s %8s %10s %12s %10s %10s"), TEXT("Reason"), TEXT("Checks"), TEXT("Searches"), TEXT("Failed"),
+		TEXT("AvgLength"), TEXT("AvgExpanded"), TEXT("MaxExp"), TEXT("TotalMs"));
+
+	for (int32 Index = 0; Index < static_cast<int32>(EPathRegenReason::Max); ++Index)
+	{
+		const FReasonStats& Stats = Reasons[Index];
+		const double Searches = FMath::Max<double>(1.0, Stats.Searches);
+
+		Ar.Logf(TEXT("%-16s %10lld %10lld %8lld %10.1f %12.1f %10d %10.2f"), LexToString(static_cast<EPathRegenReason>(Index)),
+			Stats.Checks, Stats.Searches, Stats.Failures, Stats.TotalPathLength / Searches, Stats.TotalExpansions / Searches,
+			Stats.MaxExpansions, FPlatformTime::ToMilliseconds64(Stats.TotalCycles));
+
+		if (Stats.Searches > 0)
+		{
+			Ar.Logf(TEXT("    Length:%s"), *HistogramToString(Stats.PathLengthHistogram));
+			Ar.Logf(TEXT("    Expanded:%s"), *HistogramToString(Stats.ExpansionsHistogram));
+		}
+	}
+
+	Ar.Logf(TEXT("Path checks tested %lld of %lld cells ahead of the balls"), TotalTestedCells, TotalRemainingCells);
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Outcome of a path validity check, the first values keep the cached path.
+ */
+enum class EPathRegenReason : uint8
+{
+	// Skip - Path is the same
+	None,
+	// Skip - Goal Reached
+	GoalReached,
+	// Regenerate reasons
+	PathEmpty,
+	GoalChanged,
+	Obstacle,
+	NoStartFound,
+
+	Max,
+};
+
+inline bool ShouldRegenerate(EPathRegenReason Reason)
+{
+	return Reason >= EPathRegenReason::PathEmpty && Reason < EPathRegenReason::Max;
+}
+
+SIMBALLS_API const TCHAR* LexToString(EPathRegenReason Reason);
+
+/**
+ * Always-on path finding counters, grouped by the reason the path was checked or regenerated.
+ * Kept as plain integers so recording costs a few adds per call.
+ */
+struct SIMBALLS_API FPathTelemetry
+{
+	// Power of two buckets: [0], [1], [2-3], [4-7] ... [16384+]
+	static constexpr int32 NumHistogramBuckets = 16;
+
+	struct FReasonStats
+	{
+		// Number of ShouldRegeneratePath results with this reason
+		int64 Checks = 0;
+		// Number of A* searches run for this reason
+		int64 Searches = 0;
+		// Searches that returned no path
+		int64 Failures = 0;
+		int64 TotalPathLength = 0;
+		int64 TotalExpansions = 0;
+		int32 MaxExpansions = 0;
+		uint64 TotalCycles = 0;
+
+		int64 PathLengthHistogram[NumHistogramBuckets] = {};
+		int64 ExpansionsHistogram[NumHistogramBuckets] = {};
+	};
+
+	/**
+	 * @param RemainingCells - Path cells ahead of the ball
+	 * @param TestedCells - Cells of those tested for obstacles, the others did not change since the last check
+	 */
+	void RecordCheck(EPathRegenReason Reason, int32 RemainingCells, int32 TestedCells)
+	{
+		Reasons[static_cast<int32>(Reason)].Checks++;
+		TotalRemainingCells += RemainingCells;
+		TotalTestedCells += TestedCells;
+	}
+
+	void RecordSearch(EPathRegenReason Reason, int32 PathLength, int32 Expansions, uint64 Cycles);
+
+	const FReasonStats& GetReasonStats(EPathRegenReason Reason) const { return Reasons[static_cast<int32>(Reason)]; }
+
+	void Reset();
+
+	/**
+	 * Writes a table with per reason counters and histograms to the given output.
+	 */
+	void Dump(FOutputDevice& Ar) const;
+
+	static int32 GetHistogramBucket(int32 Value)
+	{
+		return Value <= 0 ? 0 : FMath::Min<int32>(FMath::FloorLog2(static_cast<uint32>(Value)) + 1, NumHistogramBuckets - 1);
+	}
+
+private:
+	FReasonStats Reasons[static_cast<int32>(EPathRegenReason::Max)];
+
+	int64 TotalRemainingCells = 0;
+	int64 TotalTestedCells = 0;
+};
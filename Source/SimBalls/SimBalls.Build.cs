@@ -10,7 +10,7 @@ public class SimBalls : ModuleRules
 	
 		PublicDependencyModuleNames.AddRange(new string[] { "Core", "CoreUObject", "Engine", "InputCore", "EnhancedInput" });
 
-		PrivateDependencyModuleNames.AddRange(new string[] { "DeveloperSettings" });
+		PrivateDependencyModuleNames.AddRange(new string[] { "DeveloperSettings", "ImageCore" });
 
 		// Uncomment if you are using Slate UI
 		// PrivateDependencyModuleNames.AddRange(new string[] { "Slate", "SlateCore" });
@@ -3,4 +3,6 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "Stats/Stats.h"
 
+DECLARE_STATS_GROUP(TEXT("SimBalls"), STATGROUP_SimBalls, STATCAT_Advanced);
@@ -0,0 +1,461 @@
+#include "SimBallsBatchCommandlet.h"
+
+#include "BallSimulation.h"
+#include "SimulationConfig.h"
+#include "SimulationGrid.h"
+#include "StaticObstacleMap.h"
+#include "Async/ParallelFor.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "UObject/StrongObjectPtr.h"
+
+#include <atomic>
+
+DEFINE_LOG_CATEGORY_STATIC(LogSimBatch, Log, All)
+
+namespace
+{
+	constexpr int32 DefaultSteps = 1000;
+	constexpr int32 DefaultSampleEvery = 10;
+
+	struct FBatchConfig
+	{
+		int32 NumBalls = 0;
+		int32 NumTeams = 0;
+		int32 GridSize = 0;
+		int32 AttackRange = 0;
+		int32 MoveRate = 0;
+	};
+
+	struct FMatchJob
+	{
+		int32 ConfigIndex = INDEX_NONE;
+		TStrongObjectPtr<USimulationConfig> Config;
+	};
+
+	struct FMatchResult
+	{
+		TArray<float> StepTimes;
+		int64 PathsTotal = 0;
+		int32 Deaths[MaxBallTeams] = {};
+		// Alive balls per team, NumTeams values per sample
+		TArray<int32> Survival;
+	};
+
+	struct FConfigReport
+	{
+		FBatchConfig Config;
+		int32 Runs = 0;
+		double MeanMs = 0.0;
+		double P50Ms = 0.0;
+		double P99Ms = 0.0;
+		double MaxMs = 0.0;
+		double PathsPerStep = 0.0;
+		int32 Wins[MaxBallTeams] = {};
+		int32 Draws = 0;
+		double MeanDeaths[MaxBallTeams] = {};
+		// Mean fraction of each team alive, NumTeams values per sample
+		TArray<double> Survival;
+	};
+
+	/**
+	 * Integer list with ranges, e.g. 1-100,200
+	 */
+	TArray<int32> ParseIntList(const FString& Params, const TCHAR* Key, const TArray<int32>& Default)
+	{
+		FString Value;
+		if (!FParse::Value(*Params, Key, Value, false))
+		{
+			return Default;
+		}
+
+		TArray<FString> Parts;
+		Value.ParseIntoArray(Parts, TEXT(","), true);
+
+		TArray<int32> Result;
+		for (const FString& Part : Parts)
+		{
+			FString First, Last;
+			if (Part.Split(TEXT("-"), &First, &Last) && !First.IsEmpty())
+			{
+				for (int32 Item = FCString::Atoi(*First); Item <= FCString::Atoi(*Last); ++Item)
+				{
+					Result.Add(Item);
+				}
+			}
+			else
+			{
+				Result.Add(FCString::Atoi(*Part));
+			}
+		}
+		return Result;
+	}
+
+	double Percentile(const TArray<float>& SortedValues, double Fraction)
+	{
+		if (SortedValues.IsEmpty())
+		{
+			return 0.0;
+		}
+
+		const int32 Index = FMath::Clamp(FMath::CeilToInt32(Fraction * SortedValues.Num()) - 1, 0, SortedValues.Num() - 1);
+		return SortedValues[Index];
+	}
+
+	void SampleSurvival(const FBallSimulation& Simulation, int32 NumTeams, TArray<int32>& OutSurvival)
+	{
+		int32 Alive[MaxBallTeams] = {};
+		for (const FBallSimulatedState& State : Simulation.GetBallStates())
+		{
+			Alive[static_cast<int32>(State.Team)] += State.bIsDead ? 0 : 1;
+		}
+		OutSurvival.Append(Alive, NumTeams);
+	}
+
+	/**
+	 * Runs a complete match on the calling thread.
+	 */
+	FMatchResult RunMatch(const USimulationConfig& Config, int32 Steps, int32 SampleEvery)
+	{
+		FSimulationGrid Grid;
+		FBallSimulation Simulation;
+		Simulation.Initialize(&Config, Grid);
+		Simulation.InitializeBalls();
+
+		const int32 NumTeams = Config.NumTeams;
+
+		FMatchResult Result;
+		Result.StepTimes.Reserve(Steps);
+		Result.Survival.Reserve((Steps / SampleEvery + 2) * NumTeams);
+
+		SampleSurvival(Simulation, NumTeams, Result.Survival);
+
+		TBitArray<> WasDead(false, Simulation.GetBallStates().Num());
+
+		double Timestamp = 0.0;
+		for (int32 Step = 1; Step <= Steps; ++Step)
+		{
+			Grid.ResetCounters();
+
+			const uint64 StartCycles = FPlatformTime::Cycles64();
+			Simulation.AdvanceSimulation(Timestamp);
+			Result.StepTimes.Add(FPlatformTime::ToMilliseconds64(FPlatformTime::Cycles64() - StartCycles));
+
+			Timestamp += Config.SimulationTimeStep;
+			Result.PathsTotal += Grid.GetNumPathsComputed();
+
+			for (const FBallSimulatedState& State : Simulation.GetBallStates())
+			{
+				if (State.bIsDead && !WasDead[State.ID])
+				{
+					Result.Deaths[static_cast<int32>(State.Team)]++;
+				}
+				WasDead[State.ID] = State.bIsDead;
+			}
+
+			if (Step % SampleEvery == 0 || Step == Steps)
+			{
+				SampleSurvival(Simulation, NumTeams, Result.Survival);
+			}
+		}
+
+		return Result;
+	}
+
+	FConfigReport Aggregate(const FBatchConfig& Config, const TArray<const FMatchResult*>& Matches)
+	{
+		FConfigReport Report;
+		Report.Config = Config;
+		Report.Runs = Matches.Num();
+
+		const int32 NumTeams = Config.NumTeams;
+
+		TArray<float> StepTimes;
+		double TotalMs = 0.0;
+		int64 PathsTotal = 0;
+
+		for (const FMatchResult* Match : Matches)
+		{
+			StepTimes.Append(Match->StepTimes);
+			PathsTotal += Match->PathsTotal;
+
+			for (int32 Team = 0; Team < NumTeams; ++Team)
+			{
+				Report.MeanDeaths[Team] += static_cast<double>(Match->Deaths[Team]) / Matches.Num();
+			}
+
+			// Most balls alive at the end wins
+			const int32* FinalAlive = Match->Survival.GetData() + Match->Survival.Num() - NumTeams;
+			int32 Winner = 0;
+			bool bDraw = false;
+			for (int32 Team = 1; Team < NumTeams; ++Team)
+			{
+				if (FinalAlive[Team] > FinalAlive[Winner])
+				{
+					Winner = Team;
+					bDraw = false;
+				}
+				else if (FinalAlive[Team] == FinalAlive[Winner])
+				{
+					bDraw = true;
+				}
+			}
+			if (bDraw)
+			{
+				Report.Draws++;
+			}
+			else
+			{
+				Report.Wins[Winner]++;
+			}
+
+			// Fractions of the team size at the start
+			Report.Survival.SetNumZeroed(FMath::Max(Report.Survival.Num(), Match->Survival.Num()));
+			for (int32 Index = 0; Index < Match->Survival.Num(); ++Index)
+			{
+				const int32 TeamSize = FMath::Max(Match->Survival[Index % NumTeams], 1);
+				Report.Survival[Index] += static_cast<double>(Match->Survival[Index]) / TeamSize / Matches.Num();
+			}
+		}
+
+		for (const float StepMs : StepTimes)
+		{
+			TotalMs += StepMs;
+		}
+
+		StepTimes.Sort();
+
+		Report.MeanMs = StepTimes.Num() > 0 ? TotalMs / StepTimes.Num() : 0.0;
+		Report.P50Ms = Percentile(StepTimes, 0.5);
+		Report.P99Ms = Percentile(StepTimes, 0.99);
+		Report.MaxMs = StepTimes.IsEmpty() ? 0.0 : StepTimes.Last();
+		Report.PathsPerStep = StepTimes.Num() > 0 ? static_cast<double>(PathsTotal) / StepTimes.Num() : 0.0;
+
+		return Report;
+	}
+
+	FString ToCSV(const TArray<FConfigReport>& Reports)
+	{
+		// Columns for the most teams in the batch, configs with less leave theirs empty
+		int32 MaxNumTeams = 0;
+		for (const FConfigReport& R : Reports)
+		{
+			MaxNumTeams = FMath::Max(MaxNumTeams, R.Config.NumTeams);
+		}
+
+		FString Out = TEXT("NumBalls,NumTeams,GridSize,AttackRange,MoveRate,Runs,MeanMs,P50Ms,P99Ms,MaxMs,PathsPerStep,Draws");
+		for (int32 Team = 0; Team < MaxNumTeams; ++Team)
+		{
+			Out += FString::Printf(TEXT(",Wins%d,MeanDeaths%d,FinalSurvival%d"), Team, Team, Team);
+		}
+		Out += TEXT("\n");
+
+		for (const FConfigReport& R : Reports)
+		{
+			Out += FString::Printf(TEXT("%d,%d,%d,%d,%d,%d,%.4f,%.4f,%.4f,%.4f,%.3f,%d"),
+				R.Config.NumBalls, R.Config.NumTeams, R.Config.GridSize, R.Config.AttackRange, R.Config.MoveRate, R.Runs,
+				R.MeanMs, R.P50Ms, R.P99Ms, R.MaxMs, R.PathsPerStep, R.Draws);
+
+			const int32 NumTeams = R.Config.NumTeams;
+			for (int32 Team = 0; Team < NumTeams; ++Team)
+			{
+				const double FinalSurvival = R.Survival.Num() >= NumTeams ? R.Survival[R.Survival.Num() - NumTeams + Team] : 0.0;
+				Out += FString::Printf(TEXT(",%d,%.3f,%.4f"), R.Wins[Team], R.MeanDeaths[Team], FinalSurvival);
+			}
+			for (int32 Team = NumTeams; Team < MaxNumTeams; ++Team)
+			{
+				Out += TEXT(",,,");
+			}
+			Out += TEXT("\n");
+		}
+		return Out;
+	}
+
+	FString ToJSON(const TArray<FConfigReport>& Reports, int32 Steps, int32 SampleEvery, int32 NumWorkers, double WallSeconds, int32 NumMatches)
+	{
+		FString Out = FString::Printf(TEXT("{\n\t\"Steps\": %d, \"SampleEvery\": %d, \"Workers\": %d, \"Matches\": %d, \"WallSeconds\": %.3f, ")
+			TEXT("\"MatchesPerSecond\": %.3f, \"StepsPerSecond\": %.1f,\n\t\"Configs\": [\n"),
+			Steps, SampleEvery, NumWorkers, NumMatches, WallSeconds,
+			WallSeconds > 0.0 ? NumMatches / WallSeconds : 0.0, WallSeconds > 0.0 ? static_cast<double>(NumMatches) * Steps / WallSeconds : 0.0);
+
+		for (int32 Index = 0; Index < Reports.Num(); ++Index)
+		{
+			const FConfigReport& R = Reports[Index];
+			Out += FString::Printf(TEXT("\t\t{ \"NumBalls\": %d, \"NumTeams\": %d, \"GridSize\": %d, \"AttackRange\": %d, \"MoveRate\": %d, \"Runs\": %d, ")
+				TEXT("\"MeanMs\": %.4f, \"P50Ms\": %.4f, \"P99Ms\": %.4f, \"MaxMs\": %.4f, \"PathsPerStep\": %.3f, \"Draws\": %d,\n"),
+				R.Config.NumBalls, R.Config.NumTeams, R.Config.GridSize, R.Config.AttackRange, R.Config.MoveRate, R.Runs,
+				R.MeanMs, R.P50Ms, R.P99Ms, R.MaxMs, R.PathsPerStep, R.Draws);
+
+			const int32 NumTeams = R.Config.NumTeams;
+			Out += TEXT("\t\t  \"Teams\": [");
+			for (int32 Team = 0; Team < NumTeams; ++Team)
+			{
+				Out += FString::Printf(TEXT("%s{ \"Wins\": %d, \"MeanDeaths\": %.3f, \"Survival\": ["), Team > 0 ? TEXT(", ") : TEXT(""), R.Wins[Team], R.MeanDeaths[Team]);
+				for (int32 Sample = Team; Sample < R.Survival.Num(); Sample += NumTeams)
+				{
+					Out += FString::Printf(TEXT("%s%.4f"), Sample > Team ? TEXT(",") : TEXT(""), R.Survival[Sample]);
+				}
+				Out += TEXT("] }");
+			}
+			Out += FString::Printf(TEXT("] }%s\n"), Index + 1 < Reports.Num() ? TEXT(",") : TEXT(""));
+		}
+
+		Out += TEXT("\t]\n}\n");
+		return Out;
+	}
+}
+
+USimBallsBatchCommandlet::USimBallsBatchCommandlet()
+{
+	IsClient = false;
+	IsServer = false;
+	IsEditor = false;
+	LogToConsole = true;
+}
+
+int32 USimBallsBatchCommandlet::Main(const FString& Params)
+{
+	int32 Steps = DefaultSteps;
+	FParse::Value(*Params, TEXT("Steps="), Steps);
+	Steps = FMath::Max(Steps, 1);
+
+	int32 SampleEvery = DefaultSampleEvery;
+	FParse::Value(*Params, TEXT("SampleEvery="), SampleEvery);
+	SampleEvery = FMath::Max(SampleEvery, 1);
+
+	int32 Threads = 0;
+	FParse::Value(*Params, TEXT("Threads="), Threads);
+
+	FString OutputDir = FPaths::ProjectSavedDir() / TEXT("Batch");
+	FParse::Value(*Params, TEXT("Output="), OutputDir);
+
+	FString ObstacleMap;
+	FParse::Value(*Params, TEXT("ObstacleMap="), ObstacleMap);
+
+	int32 PathExpansionBudget = 0;
+	FParse::Value(*Params, TEXT("PathBudget="), PathExpansionBudget);
+
+	const USimulationConfig* Settings = USimulationConfig::Get();
+	const TArray<int32> SeedList = ParseIntList(Params, TEXT("Seeds="), { Settings->Seed });
+	const TArray<int32> NumBallsList = ParseIntList(Params, TEXT("NumBalls="), { Settings->NumBalls });
+	const TArray<int32> NumTeamsList = ParseIntList(Params, TEXT("NumTeams="), { Settings->NumTeams });
+	const TArray<int32> GridSizeList = ParseIntList(Params, TEXT("GridSize="), { Settings->GridSize });
+	const TArray<int32> AttackRangeList = ParseIntList(Params, TEXT("AttackRange="), { Settings->AttackRange });
+	const TArray<int32> MoveRateList = ParseIntList(Params, TEXT("MoveRate="), { Settings->MoveRate });
+
+	// Kept loaded for the whole batch instead of every match mapping it again
+	const TSharedPtr<const FStaticObstacleMap> SharedObstacleMap = FStaticObstacleMap::FindOrLoad(ObstacleMap);
+
+	TArray<FBatchConfig> Configs;
+	TArray<FMatchJob> Jobs;
+
+	for (const int32 NumBalls : NumBallsList)
+	{
+		for (const int32 GridSize : GridSizeList)
+		{
+			if (static_cast<int64>(GridSize) * GridSize < NumBalls)
+			{
+				UE_LOG(LogSimBatch, Display, TEXT("Skipping NumBalls=%d GridSize=%d - grid too small"), NumBalls, GridSize);
+				continue;
+			}
+
+			for (const int32 AttackRange : AttackRangeList)
+			{
+				for (const int32 MoveRate : MoveRateList)
+				{
+					for (const int32 NumTeams : NumTeamsList)
+					{
+						const int32 ConfigIndex = Configs.Add({ NumBalls, FMath::Clamp(NumTeams, 2, MaxBallTeams), GridSize, AttackRange, MoveRate });
+
+						// Settings objects are created here, workers only read them
+						for (const int32 Seed : SeedList)
+						{
+							FMatchJob& Job = Jobs.AddDefaulted_GetRef();
+							Job.ConfigIndex = ConfigIndex;
+							Job.Config.Reset(NewObject<USimulationConfig>(GetTransientPackage(), NAME_None, RF_Transient, const_cast<USimulationConfig*>(Settings)));
+							Job.Config->NumBalls = NumBalls;
+							Job.Config->NumTeams = Configs[ConfigIndex].NumTeams;
+							Job.Config->GridSize = GridSize;
+							Job.Config->AttackRange = AttackRange;
+							Job.Config->MoveRate = MoveRate;
+							Job.Config->Seed = Seed;
+							Job.Config->StaticObstacleMap = ObstacleMap;
+							Job.Config->PathExpansionBudget = PathExpansionBudget;
+						}
+					}
+				}
+			}
+		}
+	}
+
+	if (Jobs.IsEmpty())
+	{
+		UE_LOG(LogSimBatch, Error, TEXT("Nothing to run"));
+		return 1;
+	}
+
+	const int32 NumWorkers = FMath::Clamp(Threads > 0 ? Threads : FTaskGraphInterface::Get().GetNumWorkerThreads() + 1, 1, Jobs.Num());
+
+	UE_LOG(LogSimBatch, Display, TEXT("Running %d matches (%d configs x %d seeds) of %d steps on %d workers"),
+		Jobs.Num(), Configs.Num(), SeedList.Num(), Steps, NumWorkers);
+
+	TArray<FMatchResult> Results;
+	Results.SetNum(Jobs.Num());
+
+	std::atomic<int32> NextJob = 0;
+	std::atomic<int32> NumFinished = 0;
+	const int32 ProgressEvery = FMath::Max(Jobs.Num() / 10, 1);
+
+	const uint64 StartCycles = FPlatformTime::Cycles64();
+
+	// Each worker pulls the next match when done, so long and short matches balance out
+	ParallelFor(TEXT("SimBalls.Batch"), NumWorkers, 1, [&](int32)
+	{
+		for (int32 JobIndex = NextJob++; JobIndex < Jobs.Num(); JobIndex = NextJob++)
+		{
+			Results[JobIndex] = RunMatch(*Jobs[JobIndex].Config, Steps, SampleEvery);
+
+			if (const int32 Finished = ++NumFinished; Finished % ProgressEvery == 0)
+			{
+				UE_LOG(LogSimBatch, Display, TEXT("%d/%d matches done"), Finished, Jobs.Num());
+			}
+		}
+	}, NumWorkers > 1 ? EParallelForFlags::Unbalanced : EParallelForFlags::ForceSingleThread);
+
+	const double WallSeconds = FPlatformTime::ToSeconds64(FPlatformTime::Cycles64() - StartCycles);
+
+	TArray<FConfigReport> Reports;
+	for (int32 ConfigIndex = 0; ConfigIndex < Configs.Num(); ++ConfigIndex)
+	{
+		TArray<const FMatchResult*> Matches;
+		for (int32 JobIndex = 0; JobIndex < Jobs.Num(); ++JobIndex)
+		{
+			if (Jobs[JobIndex].ConfigIndex == ConfigIndex)
+			{
+				Matches.Add(&Results[JobIndex]);
+			}
+		}
+
+		const FConfigReport& Report = Reports.Add_GetRef(Aggregate(Configs[ConfigIndex], Matches));
+		UE_LOG(LogSimBatch, Display, TEXT("NumBalls=%d NumTeams=%d GridSize=%d AttackRange=%d MoveRate=%d: %d runs, mean %.3fms p99 %.3fms, %.2f paths/step, %d draws"),
+			Report.Config.NumBalls, Report.Config.NumTeams, Report.Config.GridSize, Report.Config.AttackRange, Report.Config.MoveRate,
+			Report.Runs, Report.MeanMs, Report.P99Ms, Report.PathsPerStep, Report.Draws);
+	}
+
+	UE_LOG(LogSimBatch, Display, TEXT("%d matches in %.2fs on %d workers - %.2f matches/s, %.0f steps/s"),
+		Jobs.Num(), WallSeconds, NumWorkers, Jobs.Num() / FMath::Max(WallSeconds, UE_SMALL_NUMBER),
+		static_cast<double>(Jobs.Num()) * Steps / FMath::Max(WallSeconds, UE_SMALL_NUMBER));
+
+	const FString CSVPath = OutputDir / TEXT("SimBallsBatch.csv");
+	const FString JSONPath = OutputDir / TEXT("SimBallsBatch.json");
+
+	if (!FFileHelper::SaveStringToFile(ToCSV(Reports), *CSVPath)
+		|| !FFileHelper::SaveStringToFile(ToJSON(Reports, Steps, SampleEvery, NumWorkers, WallSeconds, Jobs.Num()), *JSONPath))
+	{
+		UE_LOG(LogSimBatch, Error, TEXT("Failed to write batch report to %s"), *OutputDir);
+		return 1;
+	}
+
+	UE_LOG(LogSimBatch, Display, TEXT("Batch report written to %s and %s"), *CSVPath, *JSONPath);
+	return 0;
+}
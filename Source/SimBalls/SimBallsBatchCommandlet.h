@@ -0,0 +1,30 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "SimBallsBatchCommandlet.generated.h"
+
+/**
+ * Runs complete matches for a seed range over a matrix of configurations as fast as the cores allow and writes
+ * outcome and performance statistics per configuration to one report.
+ * Every match runs start to end on a single worker, matches are handed out to workers as they finish.
+ *
+ * Usage: UnrealEditor-Cmd SimBalls.uproject -run=SimBallsBatch [-Seeds=1-1000] [-Steps=1000]
+ *        [-NumBalls=100,1000] [-NumTeams=2,8] [-GridSize=100] [-AttackRange=2] [-MoveRate=1] [-ObstacleMap=File] [-PathBudget=Expansions]
+ *        [-Threads=N] [-SampleEvery=10] [-Output=Dir]
+ *
+ * Lists accept ranges (1-1000). -Threads limits the number of matches running at once, 1 for a single core baseline.
+ * Results go to SimBallsBatch.json and SimBallsBatch.csv in Saved/Batch by default.
+ */
+UCLASS()
+class USimBallsBatchCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	USimBallsBatchCommandlet();
+
+	// Begin UCommandlet Interface
+	virtual int32 Main(const FString& Params) override;
+	// End UCommandlet Interface
+};
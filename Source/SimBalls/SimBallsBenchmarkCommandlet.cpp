@@ -0,0 +1,446 @@
+#include "SimBallsBenchmarkCommandlet.h"
+
+#include "BallKernels.h"
+#include "BallSimulation.h"
+#include "SimulationArena.h"
+#include "SimulationConfig.h"
+#include "SimulationGrid.h"
+#include "HAL/PlatformMemory.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "UObject/StrongObjectPtr.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogSimBenchmark, Log, All)
+
+namespace
+{
+	constexpr int32 DefaultSteps = 100;
+
+	// Closest enemy scans timed per kernel and ball count
+	constexpr int32 KernelQueries = 1000;
+	constexpr int32 KernelGridSize = 4000;
+	// Damage resolve and attack timer sweeps timed per kernel and ball count, one per simulated step
+	constexpr int32 KernelSweeps = 1000;
+	constexpr int32 KernelAttackInterval = 10;
+
+	struct FBenchmarkCase
+	{
+		int32 NumBalls = 0;
+		int32 GridSize = 0;
+		int32 AttackRange = 0;
+		int32 MoveRate = 0;
+		int32 Seed = 0;
+	};
+
+	struct FBenchmarkResult
+	{
+		FBenchmarkCase Case;
+		int32 Steps = 0;
+		double MeanMs = 0.0;
+		double P50Ms = 0.0;
+		double P90Ms = 0.0;
+		double P99Ms = 0.0;
+		double MaxMs = 0.0;
+		double PathsPerStep = 0.0;
+		int32 MaxPathsPerStep = 0;
+		int64 PathsTotal = 0;
+		uint64 SimPeakBytes = 0;
+		uint64 ProcessPeakBytes = 0;
+		int64 ArenaPeakBytes = 0;
+		// Arena blocks taken from the heap after the first step, 0 in steady state
+		int32 ArenaBlockAllocations = 0;
+		// All heap allocations made while stepping, see FHeapAllocationScope, the first step is left out
+		double HeapAllocationsPerStep = 0.0;
+		int64 MaxHeapAllocationsPerStep = 0;
+		// Share of A* requests served from the path cache
+		double PathCacheHitRate = 0.0;
+		uint64 PathCachePeakBytes = 0;
+	};
+
+	TArray<int32> ParseIntList(const FString& Params, const TCHAR* Key, const TArray<int32>& Default)
+	{
+		FString Value;
+		if (!FParse::Value(*Params, Key, Value, false))
+		{
+			return Default;
+		}
+
+		TArray<FString> Parts;
+		Value.ParseIntoArray(Parts, TEXT(","), true);
+
+		TArray<int32> Result;
+		for (const FString& Part : Parts)
+		{
+			Result.Add(FCString::Atoi(*Part));
+		}
+		return Result;
+	}
+
+	double Percentile(const TArray<double>& SortedValues, double Fraction)
+	{
+		if (SortedValues.IsEmpty())
+		{
+			return 0.0;
+		}
+
+		const int32 Index = FMath::Clamp(FMath::CeilToInt32(Fraction * SortedValues.Num()) - 1, 0, SortedValues.Num() - 1);
+		return SortedValues[Index];
+	}
+
+	FBenchmarkResult RunCase(const FBenchmarkCase& Case, int32 Steps, const FString& ObstacleMap, int32 NumLandmarks, int32 PathExpansionBudget, int32 PathCacheSize)
+	{
+		// Transient copy of the project settings with the benchmarked parameters applied
+		TStrongObjectPtr<USimulationConfig> Config(NewObject<USimulationConfig>(GetTransientPackage()));
+		Config->NumBalls = Case.NumBalls;
+		Config->GridSize = Case.GridSize;
+		Config->AttackRange = Case.AttackRange;
+		Config->MoveRate = Case.MoveRate;
+		Config->Seed = Case.Seed;
+		Config->StaticObstacleMap = ObstacleMap;
+		Config->NumLandmarks = NumLandmarks;
+		Config->PathExpansionBudget = PathExpansionBudget;
+		Config->PathCacheSize = PathCacheSize;
+
+		FSimulationGrid Grid;
+		FBallSimulation Simulation;
+		Simulation.Initialize(Config.Get(), Grid);
+		Simulation.InitializeBalls();
+
+		FBenchmarkResult Result;
+		Result.Case = Case;
+		Result.Steps = Steps;
+
+		TArray<double> StepTimes;
+		StepTimes.Reserve(Steps);
+
+		int64 HeapAllocations = 0;
+		double Timestamp = 0.0;
+		for (int32 Step = 0; Step < Steps; ++Step)
+		{
+			Grid.ResetCounters();
+
+			const FHeapAllocationScope HeapScope;
+			const uint64 StartCycles = FPlatformTime::Cycles64();
+			Simulation.AdvanceSimulation(Timestamp);
+			const double StepMs = FPlatformTime::ToMilliseconds64(FPlatformTime::Cycles64() - StartCycles);
+			const int64 StepHeapAllocations = HeapScope.GetNumAllocations();
+
+			StepTimes.Add(StepMs);
+			Timestamp += Config->SimulationTimeStep;
+
+			Result.PathsTotal += Grid.GetNumPathsComputed();
+			Result.MaxPathsPerStep = FMath::Max(Result.MaxPathsPerStep, Grid.GetNumPathsComputed());
+			Result.SimPeakBytes = FMath::Max<uint64>(Result.SimPeakBytes, Simulation.GetAllocatedSize() + Grid.GetAllocatedSize());
+			Result.ArenaPeakBytes = FMath::Max(Result.ArenaPeakBytes, Simulation.GetArena().GetLastPeakBytes());
+			Result.ArenaBlockAllocations += Step > 0 ? Simulation.GetArena().GetLastNumBlockAllocations() : 0;
+			if (Step > 0)
+			{
+				HeapAllocations += StepHeapAllocations;
+				Result.MaxHeapAllocationsPerStep = FMath::Max(Result.MaxHeapAllocationsPerStep, StepHeapAllocations);
+			}
+			Result.PathCachePeakBytes = FMath::Max<uint64>(Result.PathCachePeakBytes, Grid.GetPathCache().GetAllocatedSize());
+		}
+
+		double TotalMs = 0.0;
+		for (const double StepMs : StepTimes)
+		{
+			TotalMs += StepMs;
+		}
+
+		StepTimes.Sort();
+
+		Result.MeanMs = Steps > 0 ? TotalMs / Steps : 0.0;
+		Result.P50Ms = Percentile(StepTimes, 0.5);
+		Result.P90Ms = Percentile(StepTimes, 0.9);
+		Result.P99Ms = Percentile(StepTimes, 0.99);
+		Result.MaxMs = StepTimes.IsEmpty() ? 0.0 : StepTimes.Last();
+		Result.PathsPerStep = Steps > 0 ? static_cast<double>(Result.PathsTotal) / Steps : 0.0;
+		Result.HeapAllocationsPerStep = Steps > 1 ? static_cast<double>(HeapAllocations) / (Steps - 1) : 0.0;
+		Result.PathCacheHitRate = Grid.GetPathCache().GetHitRate();
+		// Note: process wide peak, cases run in ascending order so it mostly reflects the current one
+		Result.ProcessPeakBytes = FPlatformMemory::GetStats().PeakUsedPhysical;
+
+		return Result;
+	}
+
+	struct FKernelResult
+	{
+		const TCHAR* Kernel = TEXT("");
+		int32 NumBalls = 0;
+		int32 Repeats = 0;
+		double ScalarMs = 0.0;
+		double VectorMs = 0.0;
+		bool bMatches = true;
+	};
+
+	/**
+	 * Times the scalar and vector closest enemy scans over one hostile team partition of random positions,
+	 * queried from random cells like the balls of another team. Both have to return the same balls.
+	 */
+	FKernelResult RunKernelCase(int32 NumBalls, int32 GridSize, int32 Seed)
+	{
+		FRandomStream RandomStream(Seed);
+
+		TArray<int32> X, Y;
+		X.SetNumUninitialized(NumBalls);
+		Y.SetNumUninitialized(NumBalls);
+
+		for (int32 Index = 0; Index < NumBalls; ++Index)
+		{
+			X[Index] = RandomStream.RandRange(0, GridSize - 1);
+			Y[Index] = RandomStream.RandRange(0, GridSize - 1);
+		}
+
+		TArray<FIntPoint> Queries;
+		Queries.SetNumUninitialized(KernelQueries);
+		for (FIntPoint& Query : Queries)
+		{
+			Query = FIntPoint(RandomStream.RandRange(0, GridSize - 1), RandomStream.RandRange(0, GridSize - 1));
+		}
+
+		FKernelResult Result;
+		Result.Kernel = TEXT("FindClosest");
+		Result.NumBalls = NumBalls;
+		Result.Repeats = KernelQueries;
+
+		TArray<int32> ScalarClosest, VectorClosest;
+		ScalarClosest.SetNumUninitialized(KernelQueries);
+		VectorClosest.SetNumUninitialized(KernelQueries);
+
+		uint64 StartCycles = FPlatformTime::Cycles64();
+		for (int32 Query = 0; Query < KernelQueries; ++Query)
+		{
+			int32 Distance = 0;
+			ScalarClosest[Query] = FBallKernels::FindClosestScalar(X.GetData(), Y.GetData(), NumBalls, Queries[Query], Distance);
+		}
+		Result.ScalarMs = FPlatformTime::ToMilliseconds64(FPlatformTime::Cycles64() - StartCycles);
+
+		StartCycles = FPlatformTime::Cycles64();
+		for (int32 Query = 0; Query < KernelQueries; ++Query)
+		{
+			int32 Distance = 0;
+			VectorClosest[Query] = FBallKernels::FindClosest(X.GetData(), Y.GetData(), NumBalls, Queries[Query], Distance);
+		}
+		Result.VectorMs = FPlatformTime::ToMilliseconds64(FPlatformTime::Cycles64() - StartCycles);
+
+		Result.bMatches = ScalarClosest == VectorClosest;
+		return Result;
+	}
+
+	/**
+	 * Times a scalar and a vector sweep over random per ball arrays shaped like a step of the simulation,
+	 * each sweep starts from the same input. Both have to leave the same values.
+	 */
+	template<typename ScalarSweepType, typename VectorSweepType>
+	FKernelResult RunSweepCase(const TCHAR* Kernel, int32 NumBalls, int32 Seed, ScalarSweepType ScalarSweep, VectorSweepType VectorSweep)
+	{
+		FRandomStream RandomStream(Seed);
+
+		// Counters stay small like HP, damage and attack timers do
+		TArray<int32> Values, Inputs;
+		Values.SetNumUninitialized(NumBalls);
+		Inputs.SetNumUninitialized(NumBalls);
+		for (int32 Index = 0; Index < NumBalls; ++Index)
+		{
+			Values[Index] = RandomStream.RandRange(0, 10);
+			Inputs[Index] = RandomStream.RandRange(0, 3);
+		}
+
+		FKernelResult Result;
+		Result.Kernel = Kernel;
+		Result.NumBalls = NumBalls;
+		Result.Repeats = KernelSweeps;
+
+		TArray<int32> ScalarValues, VectorValues;
+
+		uint64 StartCycles = FPlatformTime::Cycles64();
+		for (int32 Sweep = 0; Sweep < KernelSweeps; ++Sweep)
+		{
+			ScalarValues = Values;
+			ScalarSweep(ScalarValues.GetData(), Inputs.GetData(), NumBalls);
+		}
+		Result.ScalarMs = FPlatformTime::ToMilliseconds64(FPlatformTime::Cycles64() - StartCycles);
+
+		StartCycles = FPlatformTime::Cycles64();
+		for (int32 Sweep = 0; Sweep < KernelSweeps; ++Sweep)
+		{
+			VectorValues = Values;
+			VectorSweep(VectorValues.GetData(), Inputs.GetData(), NumBalls);
+		}
+		Result.VectorMs = FPlatformTime::ToMilliseconds64(FPlatformTime::Cycles64() - StartCycles);
+
+		Result.bMatches = ScalarValues == VectorValues;
+		return Result;
+	}
+
+	int32 RunKernels(const TArray<int32>& NumBallsList, int32 Seed, const FString& OutputDir)
+	{
+		FString CSV = TEXT("Kernel,NumBalls,Repeats,ScalarMs,VectorMs,Speedup,Matches\n");
+		bool bAllMatch = true;
+
+		for (const int32 NumBalls : NumBallsList)
+		{
+			if (NumBalls <= 0)
+			{
+				continue;
+			}
+
+			const FKernelResult Results[] =
+			{
+				RunKernelCase(NumBalls, KernelGridSize, Seed),
+				RunSweepCase(TEXT("ResolveDamage"), NumBalls, Seed,
+					[](int32* HP, const int32* Damage, int32 Num) { FBallKernels::ResolveDamageScalar(HP, Damage, Num); },
+					[](int32* HP, const int32* Damage, int32 Num) { FBallKernels::ResolveDamage(HP, Damage, Num); }),
+				RunSweepCase(TEXT("ResetAttackTimers"), NumBalls, Seed,
+					[](int32* StepsToAttack, const int32*, int32 Num) { FBallKernels::ResetAttackTimersScalar(StepsToAttack, Num, KernelAttackInterval); },
+					[](int32* StepsToAttack, const int32*, int32 Num) { FBallKernels::ResetAttackTimers(StepsToAttack, Num, KernelAttackInterval); }),
+			};
+
+			for (const FKernelResult& Result : Results)
+			{
+				const double Speedup = Result.VectorMs > 0.0 ? Result.ScalarMs / Result.VectorMs : 0.0;
+				bAllMatch &= Result.bMatches;
+
+				UE_LOG(LogSimBenchmark, Display, TEXT("%s NumBalls=%d: scalar %.3fms vector %.3fms (x%.2f) for %d repeats%s"),
+					Result.Kernel, NumBalls, Result.ScalarMs, Result.VectorMs, Speedup, Result.Repeats, Result.bMatches ? TEXT("") : TEXT(", RESULTS DIFFER"));
+
+				CSV += FString::Printf(TEXT("%s,%d,%d,%.4f,%.4f,%.3f,%d\n"), Result.Kernel, NumBalls, Result.Repeats, Result.ScalarMs, Result.VectorMs, Speedup, Result.bMatches ? 1 : 0);
+			}
+		}
+
+		const FString CSVPath = OutputDir / TEXT("SimBallsKernels.csv");
+		if (!FFileHelper::SaveStringToFile(CSV, *CSVPath))
+		{
+			UE_LOG(LogSimBenchmark, Error, TEXT("Failed to write kernel results to %s"), *CSVPath);
+			return 1;
+		}
+
+		if (!bAllMatch)
+		{
+			UE_LOG(LogSimBenchmark, Error, TEXT("Vector kernel results differ from the scalar ones"));
+			return 2;
+		}
+
+		UE_LOG(LogSimBenchmark, Display, TEXT("Kernel results written to %s"), *CSVPath);
+		return 0;
+	}
+
+	FString ToCSV(const TArray<FBenchmarkResult>& Results)
+	{
+		FString Out = TEXT("NumBalls,GridSize,AttackRange,MoveRate,Seed,Steps,MeanMs,P50Ms,P90Ms,P99Ms,MaxMs,PathsPerStep,MaxPathsPerStep,PathsTotal,SimPeakBytes,ProcessPeakBytes,ArenaPeakBytes,ArenaBlockAllocations,HeapAllocationsPerStep,MaxHeapAllocationsPerStep,PathCacheHitRate,PathCachePeakBytes\n");
+		for (const FBenchmarkResult& R : Results)
+		{
+			Out += FString::Printf(TEXT("%d,%d,%d,%d,%d,%d,%.4f,%.4f,%.4f,%.4f,%.4f,%.3f,%d,%lld,%llu,%llu,%lld,%d,%.2f,%lld,%.4f,%llu\n"),
+				R.Case.NumBalls, R.Case.GridSize, R.Case.AttackRange, R.Case.MoveRate, R.Case.Seed, R.Steps,
+				R.MeanMs, R.P50Ms, R.P90Ms, R.P99Ms, R.MaxMs,
+				R.PathsPerStep, R.MaxPathsPerStep, R.PathsTotal, R.SimPeakBytes, R.ProcessPeakBytes, R.ArenaPeakBytes,
+				R.ArenaBlockAllocations, R.HeapAllocationsPerStep, R.MaxHeapAllocationsPerStep,
+				R.PathCacheHitRate, R.PathCachePeakBytes);
+		}
+		return Out;
+	}
+
+	FString ToJSON(const TArray<FBenchmarkResult>& Results)
+	{
+		FString Out = TEXT("[\n");
+		for (int32 Index = 0; Index < Results.Num(); ++Index)
+		{
+			const FBenchmarkResult& R = Results[Index];
+			Out += FString::Printf(TEXT("\t{ \"NumBalls\": %d, \"GridSize\": %d, \"AttackRange\": %d, \"MoveRate\": %d, \"Seed\": %d, \"Steps\": %d, ")
+				TEXT("\"MeanMs\": %.4f, \"P50Ms\": %.4f, \"P90Ms\": %.4f, \"P99Ms\": %.4f, \"MaxMs\": %.4f, ")
+				TEXT("\"PathsPerStep\": %.3f, \"MaxPathsPerStep\": %d, \"PathsTotal\": %lld, \"SimPeakBytes\": %llu, \"ProcessPeakBytes\": %llu, ")
+				TEXT("\"ArenaPeakBytes\": %lld, \"ArenaBlockAllocations\": %d, \"HeapAllocationsPerStep\": %.2f, \"MaxHeapAllocationsPerStep\": %lld, ")
+				TEXT("\"PathCacheHitRate\": %.4f, \"PathCachePeakBytes\": %llu }%s\n"),
+				R.Case.NumBalls, R.Case.GridSize, R.Case.AttackRange, R.Case.MoveRate, R.Case.Seed, R.Steps,
+				R.MeanMs, R.P50Ms, R.P90Ms, R.P99Ms, R.MaxMs,
+				R.PathsPerStep, R.MaxPathsPerStep, R.PathsTotal, R.SimPeakBytes, R.ProcessPeakBytes, R.ArenaPeakBytes,
+				R.ArenaBlockAllocations, R.HeapAllocationsPerStep, R.MaxHeapAllocationsPerStep,
+				R.PathCacheHitRate, R.PathCachePeakBytes,
+				Index + 1 < Results.Num() ? TEXT(",") : TEXT(""));
+		}
+		Out += TEXT("]\n");
+		return Out;
+	}
+}
+
+USimBallsBenchmarkCommandlet::USimBallsBenchmarkCommandlet()
+{
+	IsClient = false;
+	IsServer = false;
+	IsEditor = false;
+	LogToConsole = true;
+}
+
+int32 USimBallsBenchmarkCommandlet::Main(const FString& Params)
+{
+	int32 Steps = DefaultSteps;
+	FParse::Value(*Params, TEXT("Steps="), Steps);
+
+	FString OutputDir = FPaths::ProjectSavedDir() / TEXT("Benchmarks");
+	FParse::Value(*Params, TEXT("Output="), OutputDir);
+
+	FString ObstacleMap;
+	FParse::Value(*Params, TEXT("ObstacleMap="), ObstacleMap);
+
+	int32 NumLandmarks = 0;
+	FParse::Value(*Params, TEXT("Landmarks="), NumLandmarks);
+
+	int32 PathExpansionBudget = 0;
+	FParse::Value(*Params, TEXT("PathBudget="), PathExpansionBudget);
+
+	int32 PathCacheSize = GetDefault<USimulationConfig>()->PathCacheSize;
+	FParse::Value(*Params, TEXT("PathCache="), PathCacheSize);
+
+	const TArray<int32> NumBallsList = ParseIntList(Params, TEXT("NumBalls="), { 10, 100, 1000, 10000, 100000 });
+	const TArray<int32> GridSizeList = ParseIntList(Params, TEXT("GridSize="), { 50, 500, 4000 });
+	const TArray<int32> AttackRangeList = ParseIntList(Params, TEXT("AttackRange="), { 1, 4 });
+	const TArray<int32> MoveRateList = ParseIntList(Params, TEXT("MoveRate="), { 1, 3 });
+	const TArray<int32> SeedList = ParseIntList(Params, TEXT("Seeds="), { 100 });
+
+	if (FParse::Param(*Params, TEXT("Kernels")))
+	{
+		return RunKernels(ParseIntList(Params, TEXT("NumBalls="), { 1000, 10000, 100000 }), SeedList.IsEmpty() ? 100 : SeedList[0], OutputDir);
+	}
+
+	TArray<FBenchmarkResult> Results;
+
+	for (const int32 NumBalls : NumBallsList)
+	{
+		for (const int32 GridSize : GridSizeList)
+		{
+			// Balls would have to share cells - not a meaningful setup
+			if (static_cast<int64>(GridSize) * GridSize < NumBalls)
+			{
+				UE_LOG(LogSimBenchmark, Display, TEXT("Skipping NumBalls=%d GridSize=%d - grid too small"), NumBalls, GridSize);
+				continue;
+			}
+
+			for (const int32 AttackRange : AttackRangeList)
+			{
+				for (const int32 MoveRate : MoveRateList)
+				{
+					for (const int32 Seed : SeedList)
+					{
+						const FBenchmarkCase Case { NumBalls, GridSize, AttackRange, MoveRate, Seed };
+						const FBenchmarkResult& Result = Results.Add_GetRef(RunCase(Case, Steps, ObstacleMap, NumLandmarks, PathExpansionBudget, PathCacheSize));
+
+						UE_LOG(LogSimBenchmark, Display, TEXT("NumBalls=%d GridSize=%d AttackRange=%d MoveRate=%d Seed=%d: mean %.3fms p99 %.3fms, %.2f paths/step, %.2f heap allocations/step"),
+							NumBalls, GridSize, AttackRange, MoveRate, Seed, Result.MeanMs, Result.P99Ms, Result.PathsPerStep, Result.HeapAllocationsPerStep);
+					}
+				}
+			}
+		}
+	}
+
+	const FString CSVPath = OutputDir / TEXT("SimBallsBenchmark.csv");
+	const FString JSONPath = OutputDir / TEXT("SimBallsBenchmark.json");
+
+	if (!FFileHelper::SaveStringToFile(ToCSV(Results), *CSVPath) || !FFileHelper::SaveStringToFile(ToJSON(Results), *JSONPath))
+	{
+		UE_LOG(LogSimBenchmark, Error, TEXT("Failed to write benchmark results to %s"), *OutputDir);
+		return 1;
+	}
+
+	UE_LOG(LogSimBenchmark, Display, TEXT("Benchmark results written to %s and %s"), *CSVPath, *JSONPath);
+	return 0;
+}
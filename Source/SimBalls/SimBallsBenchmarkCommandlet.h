@@ -0,0 +1,29 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "SimBallsBenchmarkCommandlet.generated.h"
+
+/**
+ * Runs the simulation headless over a matrix of configurations and writes step timings to CSV and JSON.
+ *
+ * Usage: UnrealEditor-Cmd SimBalls.uproject -run=SimBallsBenchmark [-Steps=200] [-Seeds=100,200]
+ *        [-NumBalls=10,100,1000] [-GridSize=50,500] [-AttackRange=1,4] [-MoveRate=1,3] [-Output=Dir]
+ *        [-ObstacleMap=File] [-Landmarks=K] [-PathBudget=Expansions] [-PathCache=Entries]
+ *        -Kernels [-NumBalls=1000,10000,100000] times the scalar and vector closest enemy scan, damage resolve and attack timer
+ *        kernels instead
+ *
+ * Rows are written in a fixed order so the files can be diffed between commits.
+ */
+UCLASS()
+class USimBallsBenchmarkCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	USimBallsBenchmarkCommandlet();
+
+	// Begin UCommandlet Interface
+	virtual int32 Main(const FString& Params) override;
+	// End UCommandlet Interface
+};
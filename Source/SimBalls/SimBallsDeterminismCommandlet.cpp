@@ -0,0 +1,348 @@
+#include "SimBallsDeterminismCommandlet.h"
+
+#include "BallSimulation.h"
+#include "SimulationConfig.h"
+#include "SimulationGrid.h"
+#include "SimulationRecorder.h"
+#include "SimulationSnapshots.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "UObject/StrongObjectPtr.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogSimDeterminism, Log, All)
+
+namespace
+{
+	struct FDeterminismScenario
+	{
+		const TCHAR* Name = nullptr;
+		int32 NumBalls = 0;
+		int32 GridSize = 0;
+		int32 AttackRange = 0;
+		int32 MoveRate = 0;
+		int32 Seed = 0;
+		int32 Steps = 0;
+	};
+
+	// Entries of the run with the path cache, enough to keep the paths of the largest scenario
+	constexpr int32 PathCacheSize = 4096;
+
+	// Steps simulated again by the rewound run, from a snapshot ring with a keyframe every quarter of them
+	constexpr int32 RewindSteps = 40;
+
+	/**
+	 * Variations of a scenario run that all have to produce the same hashes.
+	 */
+	struct FRunOptions
+	{
+		bool bParallel = false;
+		bool bSleeping = true;
+		int32 PathCacheSize = 0;
+		// Rewind halfway through and simulate the last RewindSteps again
+		bool bRewind = false;
+		// Record from a third of the way through and take the remaining hashes from replaying the recording in a new simulation
+		bool bReplay = false;
+	};
+
+	FString GetRecordingPath(const FDeterminismScenario& Scenario)
+	{
+		return FPaths::ProjectSavedDir() / TEXT("Determinism") / FString(Scenario.Name) + TEXT(".simrec");
+	}
+
+	/**
+	 * Replays a recording in a simulation of its own, appending the hash after every step.
+	 * @return false if the recording could not be replayed or diverged from its recorded hashes
+	 */
+	bool ReplayRecording(const FDeterminismScenario& Scenario, TArray<uint32>& Hashes)
+	{
+		FSimulationReplay Replay;
+		if (!Replay.Open(GetRecordingPath(Scenario)))
+		{
+			return false;
+		}
+
+		TStrongObjectPtr<USimulationConfig> Config(NewObject<USimulationConfig>(GetTransientPackage()));
+		Replay.GetRecordedConfig().ApplyTo(*Config);
+		Config->PathCacheSize = 0;
+
+		// Starts from a grid that never saw the recorded match
+		FSimulationGrid Grid;
+		FBallSimulation Simulation;
+		Simulation.Initialize(Config.Get(), Grid);
+		if (!Replay.RestoreSimulation(Simulation))
+		{
+			return false;
+		}
+
+		double Timestamp = 0.0;
+		while (Replay.AdvanceSimulation(Simulation, Timestamp))
+		{
+			Hashes.Add(Simulation.ComputeStateHash());
+		}
+
+		return Replay.GetFirstDivergentStep() == INDEX_NONE;
+	}
+
+	// Note: changing any of these invalidates the golden files
+	const FDeterminismScenario Scenarios[] =
+	{
+		{ TEXT("Duel"),		4,		100,	2,	1,	1000,	600 },
+		{ TEXT("Skirmish"),	200,	100,	2,	1,	7,		500 },
+		{ TEXT("Crowded"),	1000,	50,		1,	1,	3,		300 },
+		{ TEXT("Battle"),	2000,	300,	3,	2,	42,		200 },
+	};
+
+	FString GetGoldenPath(const FDeterminismScenario& Scenario)
+	{
+		return FPaths::ProjectDir() / TEXT("Determinism") / FString(Scenario.Name) + TEXT(".golden");
+	}
+
+	FString DescribeScenario(const FDeterminismScenario& Scenario)
+	{
+		return FString::Printf(TEXT("Scenario=%s NumBalls=%d GridSize=%d AttackRange=%d MoveRate=%d Seed=%d Steps=%d"),
+			Scenario.Name, Scenario.NumBalls, Scenario.GridSize, Scenario.AttackRange, Scenario.MoveRate, Scenario.Seed, Scenario.Steps);
+	}
+
+	/**
+	 * @return State hash after initialization followed by the hash after every step
+	 */
+	TArray<uint32> RunScenario(const FDeterminismScenario& Scenario, const FRunOptions& Options = FRunOptions())
+	{
+		TStrongObjectPtr<USimulationConfig> Config(NewObject<USimulationConfig>(GetTransientPackage()));
+		Config->NumBalls = Scenario.NumBalls;
+		Config->GridSize = Scenario.GridSize;
+		Config->AttackRange = Scenario.AttackRange;
+		Config->MoveRate = Scenario.MoveRate;
+		Config->Seed = Scenario.Seed;
+		// Scenarios run on an open grid regardless of the project settings
+		Config->StaticObstacleMap.Empty();
+		Config->NumLandmarks = 0;
+		Config->PathExpansionBudget = 0;
+		Config->PathCacheSize = Options.PathCacheSize;
+
+		FSimulationGrid Grid;
+		FBallSimulation Simulation;
+		Simulation.Initialize(Config.Get(), Grid);
+		Simulation.SetParallel(Options.bParallel);
+		Simulation.SetSleepingEnabled(Options.bSleeping);
+		Simulation.InitializeBalls();
+
+		TArray<uint32> Hashes;
+		Hashes.Reserve(Scenario.Steps + 1);
+		Hashes.Add(Simulation.ComputeStateHash());
+
+		FSimulationSnapshotRing Snapshots;
+		if (Options.bRewind)
+		{
+			Snapshots.Configure(RewindSteps * 2, RewindSteps / 4);
+		}
+		bool bRewound = false;
+
+		FSimulationRecorder Recorder;
+		int32 RecordingStartStep = INDEX_NONE;
+
+		double Timestamp = 0.0;
+		for (int32 Step = 0; Step < Scenario.Steps; ++Step)
+		{
+			Simulation.AdvanceSimulation(Timestamp);
+			Snapshots.RecordStep(Simulation, Timestamp);
+			if (RecordingStartStep != INDEX_NONE)
+			{
+				Recorder.RecordStep(Simulation, Timestamp);
+			}
+			Timestamp += Config->SimulationTimeStep;
+
+			Hashes.Add(Simulation.ComputeStateHash());
+
+			if (Options.bRewind && !bRewound && Step == Scenario.Steps / 2)
+			{
+				const int32 RewindStep = FMath::Max(Simulation.GetCurrentStep() - RewindSteps, Snapshots.GetOldestStep());
+				double RewindTimestamp = 0.0;
+				if (!Snapshots.Rewind(Simulation, RewindStep, RewindTimestamp))
+				{
+					UE_LOG(LogSimDeterminism, Error, TEXT("%s: failed to rewind to step %d"), Scenario.Name, RewindStep);
+					break;
+				}
+
+				// Continue with the step after the rewound one, its hash gets recorded again
+				Hashes.SetNum(RewindStep + 1);
+				Timestamp = RewindTimestamp + Config->SimulationTimeStep;
+				Step = RewindStep - 1;
+				bRewound = true;
+			}
+
+			// Mid-match start, the replay has to rebuild everything from the saved state alone
+			if (Options.bReplay && RecordingStartStep == INDEX_NONE && Step == Scenario.Steps / 3)
+			{
+				if (!Recorder.Open(GetRecordingPath(Scenario), *Config, Simulation, Timestamp))
+				{
+					break;
+				}
+				RecordingStartStep = Simulation.GetCurrentStep();
+			}
+		}
+
+		if (RecordingStartStep != INDEX_NONE)
+		{
+			Recorder.Close();
+
+			Hashes.SetNum(RecordingStartStep + 1);
+			if (!ReplayRecording(Scenario, Hashes))
+			{
+				UE_LOG(LogSimDeterminism, Error, TEXT("%s: replay of the recording started at step %d failed or diverged"), Scenario.Name, RecordingStartStep);
+			}
+		}
+
+		return Hashes;
+	}
+
+	int32 FindFirstMismatch(const TArray<uint32>& A, const TArray<uint32>& B)
+	{
+		for (int32 Index = 0; Index < FMath::Max(A.Num(), B.Num()); ++Index)
+		{
+			if (!A.IsValidIndex(Index) || !B.IsValidIndex(Index) || A[Index] != B[Index])
+			{
+				return Index;
+			}
+		}
+		return INDEX_NONE;
+	}
+
+	bool SaveGolden(const FDeterminismScenario& Scenario, const TArray<uint32>& Hashes)
+	{
+		FString Out = FString::Printf(TEXT("# SimBalls determinism golden - %s\n"), *DescribeScenario(Scenario));
+		for (int32 Step = 0; Step < Hashes.Num(); ++Step)
+		{
+			Out += FString::Printf(TEXT("%d %08x\n"), Step, Hashes[Step]);
+		}
+		return FFileHelper::SaveStringToFile(Out, *GetGoldenPath(Scenario));
+	}
+
+	bool LoadGolden(const FDeterminismScenario& Scenario, TArray<uint32>& OutHashes)
+	{
+		TArray<FString> Lines;
+		if (!FFileHelper::LoadFileToStringArray(Lines, *GetGoldenPath(Scenario)))
+		{
+			return false;
+		}
+
+		for (const FString& Line : Lines)
+		{
+			TArray<FString> Parts;
+			if (Line.StartsWith(TEXT("#")) || Line.ParseIntoArrayWS(Parts) != 2)
+			{
+				continue;
+			}
+
+			const int32 Step = FCString::Atoi(*Parts[0]);
+			OutHashes.SetNumZeroed(FMath::Max(OutHashes.Num(), Step + 1));
+			OutHashes[Step] = FParse::HexNumber(*Parts[1]);
+		}
+		return true;
+	}
+}
+
+USimBallsDeterminismCommandlet::USimBallsDeterminismCommandlet()
+{
+	IsClient = false;
+	IsServer = false;
+	IsEditor = false;
+	LogToConsole = true;
+}
+
+int32 USimBallsDeterminismCommandlet::Main(const FString& Params)
+{
+	const bool bUpdate = FParse::Param(*Params, TEXT("Update"));
+
+	FString ScenarioFilter;
+	FParse::Value(*Params, TEXT("Scenario="), ScenarioFilter);
+
+	int32 NumFailed = 0;
+
+	for (const FDeterminismScenario& Scenario : Scenarios)
+	{
+		if (!ScenarioFilter.IsEmpty() && ScenarioFilter != Scenario.Name)
+		{
+			continue;
+		}
+
+		FRunOptions ParallelOptions;
+		ParallelOptions.bParallel = true;
+		FRunOptions AwakeOptions;
+		AwakeOptions.bSleeping = false;
+		FRunOptions PathCacheOptions;
+		PathCacheOptions.PathCacheSize = PathCacheSize;
+		FRunOptions RewindOptions;
+		RewindOptions.bRewind = true;
+		FRunOptions ReplayOptions;
+		ReplayOptions.bReplay = true;
+
+		const TArray<uint32> SingleThreaded = RunScenario(Scenario);
+		const TArray<uint32> MultiThreaded = RunScenario(Scenario, ParallelOptions);
+		const TArray<uint32> AlwaysAwake = RunScenario(Scenario, AwakeOptions);
+		const TArray<uint32> PathCached = RunScenario(Scenario, PathCacheOptions);
+		const TArray<uint32> Rewound = RunScenario(Scenario, RewindOptions);
+		const TArray<uint32> Replayed = RunScenario(Scenario, ReplayOptions);
+
+		bool bPassed = true;
+
+		if (const int32 Mismatch = FindFirstMismatch(SingleThreaded, MultiThreaded); Mismatch != INDEX_NONE)
+		{
+			UE_LOG(LogSimDeterminism, Error, TEXT("%s: parallel run diverged from single threaded run at step %d"), Scenario.Name, Mismatch);
+			bPassed = false;
+		}
+
+		if (const int32 Mismatch = FindFirstMismatch(SingleThreaded, AlwaysAwake); Mismatch != INDEX_NONE)
+		{
+			UE_LOG(LogSimDeterminism, Error, TEXT("%s: run without sleeping balls diverged at step %d"), Scenario.Name, Mismatch);
+			bPassed = false;
+		}
+
+		if (const int32 Mismatch = FindFirstMismatch(SingleThreaded, PathCached); Mismatch != INDEX_NONE)
+		{
+			UE_LOG(LogSimDeterminism, Error, TEXT("%s: run with the path cache diverged at step %d"), Scenario.Name, Mismatch);
+			bPassed = false;
+		}
+
+		if (const int32 Mismatch = FindFirstMismatch(SingleThreaded, Rewound); Mismatch != INDEX_NONE)
+		{
+			UE_LOG(LogSimDeterminism, Error, TEXT("%s: run rewound from the snapshot ring diverged at step %d"), Scenario.Name, Mismatch);
+			bPassed = false;
+		}
+
+		if (const int32 Mismatch = FindFirstMismatch(SingleThreaded, Replayed); Mismatch != INDEX_NONE)
+		{
+			UE_LOG(LogSimDeterminism, Error, TEXT("%s: replay of a recording started mid-match diverged at step %d"), Scenario.Name, Mismatch);
+			bPassed = false;
+		}
+
+		if (bUpdate)
+		{
+			if (!SaveGolden(Scenario, SingleThreaded))
+			{
+				UE_LOG(LogSimDeterminism, Error, TEXT("%s: failed to write %s"), Scenario.Name, *GetGoldenPath(Scenario));
+				bPassed = false;
+			}
+		}
+		else
+		{
+			TArray<uint32> Golden;
+			if (!LoadGolden(Scenario, Golden))
+			{
+				UE_LOG(LogSimDeterminism, Error, TEXT("%s: missing golden file %s, run with -Update to create it"), Scenario.Name, *GetGoldenPath(Scenario));
+				bPassed = false;
+			}
+			else if (const int32 Mismatch = FindFirstMismatch(SingleThreaded, Golden); Mismatch != INDEX_NONE)
+			{
+				UE_LOG(LogSimDeterminism, Error, TEXT("%s: diverged from golden at step %d (%08x, expected %08x)"), Scenario.Name, Mismatch,
+					SingleThreaded.IsValidIndex(Mismatch) ? SingleThreaded[Mismatch] : 0, Golden.IsValidIndex(Mismatch) ? Golden[Mismatch] : 0);
+				bPassed = false;
+			}
+		}
+
+		UE_LOG(LogSimDeterminism, Display, TEXT("%s: %s"), *DescribeScenario(Scenario), bPassed ? TEXT("passed") : TEXT("FAILED"));
+		NumFailed += bPassed ? 0 : 1;
+	}
+
+	return NumFailed > 0 ? 1 : 0;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "SimBallsDeterminismCommandlet.generated.h"
+
+/**
+ * Runs fixed simulation scenarios and compares their per-step state hashes with golden files in Determinism/.
+ * Each scenario also runs with parallel sweeps enabled, with sleeping balls disabled, with the path cache enabled,
+ * rewound halfway through from a snapshot ring and replayed from a recording started mid-match in a new simulation,
+ * all have to produce the same hashes as the single threaded run. Recordings are written to Saved/Determinism.
+ *
+ * Usage: UnrealEditor-Cmd SimBalls.uproject -run=SimBallsDeterminism [-Scenario=Name] [-Update]
+ *
+ * -Update rewrites the golden files from the single threaded run, to be used only for intended behavior changes.
+ * Returns 0 when every scenario matched.
+ */
+UCLASS()
+class USimBallsDeterminismCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	USimBallsDeterminismCommandlet();
+
+	// Begin UCommandlet Interface
+	virtual int32 Main(const FString& Params) override;
+	// End UCommandlet Interface
+};
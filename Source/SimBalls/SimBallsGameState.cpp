@@ -4,6 +4,8 @@
 #include "GridManager.h"
 
 #include "SimulationConfig.h"
+#include "Misc/CommandLine.h"
+#include "Misc/Paths.h"
 
 DEFINE_LOG_CATEGORY_STATIC(LogSim, Log, All)
 
@@ -15,10 +17,264 @@ static FAutoConsoleVariableRef CVarAutoCameraAdjust(
 		ECVF_Cheat
 	);
 
+static float ActorSpawnBudgetMs = 2.0f;
+static FAutoConsoleVariableRef CVarActorSpawnBudgetMs(
+		TEXT("Sim.ActorSpawnBudgetMs"),
+		ActorSpawnBudgetMs,
+		TEXT("Time per frame spent spawning ball actors, at least one is spawned each frame."),
+		ECVF_Default
+	);
+
+static bool bParallelStep = false;
+static FAutoConsoleVariableRef CVarParallelStep(
+		TEXT("Sim.ParallelStep"),
+		bParallelStep,
+		TEXT("Runs the order independent parts of a simulation step on worker threads."),
+		ECVF_Default
+	);
+
+static bool bSleepingBalls = true;
+static FAutoConsoleVariableRef CVarSleepingBalls(
+		TEXT("Sim.SleepingBalls"),
+		bSleepingBalls,
+		TEXT("Lets balls in range of their target or without enemies skip the enemy scan until something near them changes."),
+		ECVF_Default
+	);
+
+static float StepBudgetMs = 4.0f;
+static FAutoConsoleVariableRef CVarStepBudgetMs(
+		TEXT("Sim.StepBudgetMs"),
+		StepBudgetMs,
+		TEXT("Time per frame spent on simulation steps, at least one step runs each frame when behind."),
+		ECVF_Default
+	);
+
+static float CatchUpBudgetMs = 12.0f;
+static FAutoConsoleVariableRef CVarCatchUpBudgetMs(
+		TEXT("Sim.CatchUpBudgetMs"),
+		CatchUpBudgetMs,
+		TEXT("Time per frame spent on simulation steps while catching up with a backlog larger than Sim.CatchUpBacklog."),
+		ECVF_Default
+	);
+
+static int32 CatchUpBacklog = 10;
+static FAutoConsoleVariableRef CVarCatchUpBacklog(
+		TEXT("Sim.CatchUpBacklog"),
+		CatchUpBacklog,
+		TEXT("Steps behind the current time that switch the scheduler to Sim.CatchUpBudgetMs."),
+		ECVF_Default
+	);
+
+static bool bApplyIntermediateSteps = false;
+static FAutoConsoleVariableRef CVarApplyIntermediateSteps(
+		TEXT("Sim.ApplyIntermediateSteps"),
+		bApplyIntermediateSteps,
+		TEXT("Applies every step of a frame to the ball actors instead of only the last one. Skipped while catching up."),
+		ECVF_Default
+	);
+
+static bool bServerBallActors = false;
+static FAutoConsoleVariableRef CVarServerBallActors(
+		TEXT("Sim.ServerBallActors"),
+		bServerBallActors,
+		TEXT("Spawns visual ball actors on dedicated servers too, read when the match starts. Only useful to compare with the lean server."),
+		ECVF_Default
+	);
+
+static int32 SnapshotSteps = 64;
+static FAutoConsoleVariableRef CVarSnapshotSteps(
+		TEXT("Sim.SnapshotSteps"),
+		SnapshotSteps,
+		TEXT("Last simulation steps kept in memory for Sim.Snapshots, 0 disables the ring."),
+		ECVF_Default
+	);
+
+static int32 SnapshotKeyframeInterval = 16;
+static FAutoConsoleVariableRef CVarSnapshotKeyframeInterval(
+		TEXT("Sim.SnapshotKeyframeInterval"),
+		SnapshotKeyframeInterval,
+		TEXT("Steps between full simulation states in the snapshot ring, rewinding re-simulates at most this many steps."),
+		ECVF_Default
+	);
+
+static bool bServerSnapshots = false;
+static FAutoConsoleVariableRef CVarServerSnapshots(
+		TEXT("Sim.ServerSnapshots"),
+		bServerSnapshots,
+		TEXT("Keeps the snapshot ring on dedicated servers too, where it is off by default to save memory."),
+		ECVF_Default
+	);
+
+static FAutoConsoleCommandWithWorldAndArgs CmdRecord(
+		TEXT("Sim.Record"),
+		TEXT("Records the simulation to Saved/Recordings. Optional file name, 'Sim.Record stop' finishes the recording."),
+		FConsoleCommandWithWorldAndArgsDelegate::CreateStatic([](const TArray<FString>& Args, UWorld* World)
+		{
+			if (ASimBallsGameState* GameState = World ? World->GetGameState<ASimBallsGameState>() : nullptr)
+			{
+				if (Args.Num() > 0 && Args[0] == TEXT("stop"))
+				{
+					GameState->StopRecording();
+				}
+				else
+				{
+					GameState->StartRecording(Args.Num() > 0 ? Args[0] : FString());
+				}
+			}
+		})
+	);
+
+static FAutoConsoleCommandWithWorldAndArgs CmdReplay(
+		TEXT("Sim.Replay"),
+		TEXT("Replays a recording from Saved/Recordings (or an absolute path) in place of the live simulation."),
+		FConsoleCommandWithWorldAndArgsDelegate::CreateStatic([](const TArray<FString>& Args, UWorld* World)
+		{
+			ASimBallsGameState* GameState = World ? World->GetGameState<ASimBallsGameState>() : nullptr;
+			if (GameState && Args.Num() > 0)
+			{
+				GameState->StartReplay(Args[0]);
+			}
+		})
+	);
+
+static FAutoConsoleCommandWithWorldArgsAndOutputDevice CmdCommand(
+		TEXT("Sim.Command"),
+		TEXT("Submits a command for the next simulation step: 'kill ID', 'spawn Team [X Y]', 'target ID TargetID' (-1 clears), 'block X Y', 'unblock X Y'."),
+		FConsoleCommandWithWorldArgsAndOutputDeviceDelegate::CreateStatic([](const TArray<FString>& Args, UWorld* World, FOutputDevice& Ar)
+		{
+			ASimBallsGameState* GameState = World ? World->GetGameState<ASimBallsGameState>() : nullptr;
+			if (!GameState || Args.IsEmpty())
+			{
+				return;
+			}
+
+			auto GetInt = [&Args](int32 Index, int32 Default)
+			{
+				return Args.IsValidIndex(Index) ? FCString::Atoi(*Args[Index]) : Default;
+			};
+
+			const FString& Name = Args[0];
+			if (Name == TEXT("kill") && Args.Num() > 1)
+			{
+				GameState->SubmitCommand(FSimulationCommand::KillBall(GetInt(1, INDEX_NONE)));
+			}
+			else if (Name == TEXT("spawn") && Args.Num() > 1)
+			{
+				const EBallTeamColor Team = static_cast<EBallTeamColor>(FMath::Clamp(GetInt(1, 0), 0, static_cast<int32>(EBallTeamColor::Max_None)));
+				GameState->SubmitCommand(FSimulationCommand::SpawnBall(Team, FIntPoint(GetInt(2, INDEX_NONE), GetInt(3, INDEX_NONE))));
+			}
+			else if (Name == TEXT("target") && Args.Num() > 2)
+			{
+				GameState->SubmitCommand(FSimulationCommand::ForceTarget(GetInt(1, INDEX_NONE), GetInt(2, INDEX_NONE)));
+			}
+			else if ((Name == TEXT("block") || Name == TEXT("unblock")) && Args.Num() > 2)
+			{
+				GameState->SubmitCommand(FSimulationCommand::SetObstacle(FIntPoint(GetInt(1, 0), GetInt(2, 0)), Name == TEXT("block")));
+			}
+			else
+			{
+				Ar.Logf(TEXT("Unknown simulation command '%s'"), *FString::Join(Args, TEXT(" ")));
+			}
+		})
+	);
+
+static FAutoConsoleCommandWithWorldArgsAndOutputDevice CmdSnapshots(
+		TEXT("Sim.Snapshots"),
+		TEXT("Lists the kept steps. 'rewind Step' continues from a kept step, 'diff StepA StepB' compares two steps, ")
+		TEXT("'export Step [File]' writes a step to Saved/Snapshots and 'compare Step File' diffs it with one exported by another peer."),
+		FConsoleCommandWithWorldArgsAndOutputDeviceDelegate::CreateStatic([](const TArray<FString>& Args, UWorld* World, FOutputDevice& Ar)
+		{
+			ASimBallsGameState* GameState = World ? World->GetGameState<ASimBallsGameState>() : nullptr;
+			if (!GameState)
+			{
+				return;
+			}
+
+			const FSimulationSnapshotRing& Snapshots = GameState->GetSnapshots();
+			const FString SnapshotsDir = FPaths::ProjectSavedDir() / TEXT("Snapshots");
+			auto GetPath = [&SnapshotsDir](const FString& Filename)
+			{
+				return FPaths::IsRelative(Filename) ? SnapshotsDir / Filename : Filename;
+			};
+
+			auto GetStates = [&Snapshots, &Ar](int32 Step, TArray<FBallRecordState>& OutStates, uint32& OutHash)
+			{
+				if (!Snapshots.GetStates(Step, OutStates, &OutHash))
+				{
+					Ar.Logf(TEXT("Step %d is not kept, steps %d to %d are"), Step, Snapshots.GetOldestStep(), Snapshots.GetNewestStep());
+					return false;
+				}
+				return true;
+			};
+
+			const FString Name = Args.Num() > 0 ? Args[0] : FString();
+			if (Name == TEXT("rewind") && Args.Num() > 1)
+			{
+				const int32 Step = FCString::Atoi(*Args[1]);
+				if (!GameState->RewindSimulation(Step))
+				{
+					Ar.Logf(TEXT("Failed to rewind to step %d, steps %d to %d are kept"), Step, Snapshots.GetOldestStep(), Snapshots.GetNewestStep());
+				}
+			}
+			else if (Name == TEXT("diff") && Args.Num() > 2)
+			{
+				TArray<FBallRecordState> StatesA, StatesB;
+				uint32 HashA = 0, HashB = 0;
+				const int32 StepA = FCString::Atoi(*Args[1]);
+				const int32 StepB = FCString::Atoi(*Args[2]);
+				if (GetStates(StepA, StatesA, HashA) && GetStates(StepB, StatesB, HashB))
+				{
+					Ar.Logf(TEXT("Step %d (%08x) / step %d (%08x):"), StepA, HashA, StepB, HashB);
+					FSimulationSnapshotRing::DiffStates(StatesA, StatesB, Ar);
+				}
+			}
+			else if (Name == TEXT("export") && Args.Num() > 1)
+			{
+				const int32 Step = FCString::Atoi(*Args[1]);
+				const FString Path = GetPath(Args.Num() > 2 ? Args[2] : FString::Printf(TEXT("Step_%d.simsnap"), Step));
+				if (Snapshots.Export(Step, Path))
+				{
+					Ar.Logf(TEXT("Wrote step %d to %s"), Step, *Path);
+				}
+				else
+				{
+					Ar.Logf(TEXT("Failed to write step %d to %s"), Step, *Path);
+				}
+			}
+			else if (Name == TEXT("compare") && Args.Num() > 2)
+			{
+				TArray<FBallRecordState> LocalStates, PeerStates;
+				uint32 LocalHash = 0, PeerHash = 0;
+				int32 PeerStep = INDEX_NONE;
+				const int32 Step = FCString::Atoi(*Args[1]);
+				if (!FSimulationSnapshotRing::Import(GetPath(Args[2]), PeerStep, PeerHash, PeerStates))
+				{
+					Ar.Logf(TEXT("Failed to read %s"), *GetPath(Args[2]));
+				}
+				else if (GetStates(Step, LocalStates, LocalHash))
+				{
+					Ar.Logf(TEXT("Local step %d (%08x) / peer step %d (%08x):"), Step, LocalHash, PeerStep, PeerHash);
+					FSimulationSnapshotRing::DiffStates(LocalStates, PeerStates, Ar);
+				}
+			}
+			else
+			{
+				Snapshots.Dump(Ar);
+			}
+		})
+	);
+
 namespace
 {
-	// limit number of simulation steps per tick
-	constexpr int32 MAX_SIMULATIONS_PER_TICK = 50;
+	FString GetRecordingPath(const FString& Filename)
+	{
+		const FString RecordingsDir = FPaths::ProjectSavedDir() / TEXT("Recordings");
+		if (Filename.IsEmpty())
+		{
+			return RecordingsDir / FDateTime::Now().ToString() + TEXT(".simrec");
+		}
+		return FPaths::IsRelative(Filename) ? RecordingsDir / Filename : Filename;
+	}
 }
 
 ASimBallsGameState::ASimBallsGameState()
@@ -26,28 +282,6 @@ ASimBallsGameState::ASimBallsGameState()
 	PrimaryActorTick.bCanEverTick = true;
 }
 
-FBallSimulatedState& ASimBallsGameState::CreateBallState(int32 StateID)
-{
-	const int32 GridMax = Config->GridSize - 1;
-	const int32 HP = RandomStream.RandRange(Config->MinHP, Config->MaxHP);
-	const int32 X = RandomStream.RandRange(0, GridMax);
-	const int32 Y = RandomStream.RandRange(0, GridMax);
-	const EBallTeamColor Team = static_cast<EBallTeamColor>(StateID % static_cast<int32>(EBallTeamColor::Max_None));
-
-	FBallSimulatedState State(StateID, INDEX_NONE, HP, Config->AttackInterval, FIntPoint(X, Y), Team);
-	
-	if (!BallStates.IsValidIndex(StateID))
-	{
-		BallStates.Add(MoveTemp(State));
-	}
-	else
-	{
-		BallStates[StateID] = State;
-	}
-
-	return BallStates[StateID];
-}
-
 ABallActor* ASimBallsGameState::CreateBallActor(const FBallSimulatedState& BallState)
 {
 	ABallActor* NewBall = BallActors.IsValidIndex(BallState.ID) ? BallActors[BallState.ID] : nullptr;
@@ -59,7 +293,11 @@ ABallActor* ASimBallsGameState::CreateBallActor(const FBallSimulatedState& BallS
 		ASP.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
 		NewBall = GetWorld()->SpawnActor<ABallActor>(ASP);
 		
-		BallActors.Add(NewBall);
+		if (!BallActors.IsValidIndex(BallState.ID))
+		{
+			BallActors.SetNum(BallState.ID + 1);
+		}
+		BallActors[BallState.ID] = NewBall;
 	}
 	
 	NewBall->InitBall(BallState);
@@ -69,15 +307,42 @@ ABallActor* ASimBallsGameState::CreateBallActor(const FBallSimulatedState& BallS
 
 void ASimBallsGameState::InitializeBalls()
 {
-	BallStates.Reserve(Config->NumBalls);
-	BallActors.Reserve(Config->NumBalls);
-	
 	// Initialize all the states based on random seed value
-	for (int32 Index = 0; Index < Config->NumBalls; ++Index)
+	Simulation.InitializeBalls();
+
+	// Actors are spawned over the next frames, simulation does not wait for them
+	ResetBallActors();
+}
+
+void ASimBallsGameState::SpawnPendingBallActors()
+{
+	if (PendingBallActors.IsEmpty())
 	{
-		const FBallSimulatedState& State = CreateBallState(Index);
-		
-		CreateBallActor(State);
+		return;
+	}
+
+	const uint64 StartCycles = FPlatformTime::Cycles64();
+
+	while (NextPendingBallActor < PendingBallActors.Num())
+	{
+		const int32 BallID = PendingBallActors[NextPendingBallActor++];
+
+		// Spawn with the latest state, the ball may have moved or respawned while waiting
+		if (BallID < Simulation.GetNumBalls())
+		{
+			CreateBallActor(Simulation.GetBallState(BallID));
+		}
+
+		if (FPlatformTime::ToMilliseconds64(FPlatformTime::Cycles64() - StartCycles) >= ActorSpawnBudgetMs)
+		{
+			break;
+		}
+	}
+
+	if (NextPendingBallActor >= PendingBallActors.Num())
+	{
+		PendingBallActors.Reset();
+		NextPendingBallActor = 0;
 	}
 }
 
@@ -87,11 +352,46 @@ void ASimBallsGameState::BeginPlay()
 
 	Config = USimulationConfig::Get();
 	Grid = AGridManager::FindOrSpawnGrid(this);
-	//Note: setting the Seed from config, but this should come from server
-	RandomStream.Initialize(Config->Seed);
-		
+
+	// Nobody sees the balls on a dedicated server, it only runs the simulation states
+	bSpawnBallActors = !GetWorld()->IsNetMode(NM_DedicatedServer) || bServerBallActors;
+	if (!bSpawnBallActors)
+	{
+		UE_LOG(LogSim, Log, TEXT("Dedicated server - running without ball actors"));
+	}
+	
+	Simulation.Initialize(Config, Grid->GetSimulationGrid());
+	// Respawned balls reuse their actors, pending ones get spawned with the new state
+	if (bSpawnBallActors)
+	{
+		Simulation.OnBallRespawned.BindWeakLambda(this, [this](const FBallSimulatedState& State)
+		{
+			if (ABallActor* BallActor = BallActors.IsValidIndex(State.ID) ? BallActors[State.ID].Get() : nullptr)
+			{
+				BallActor->InitBall(State);
+			}
+		});
+
+		// Balls added by commands get an actor like the initial ones
+		Simulation.OnBallSpawned.BindWeakLambda(this, [this](const FBallSimulatedState& State)
+		{
+			BallActors.SetNum(FMath::Max(BallActors.Num(), State.ID + 1));
+			PendingBallActors.Add(State.ID);
+		});
+	}
+
 	InitializeBalls();
 
+	FString RecordingFile;
+	if (FParse::Value(FCommandLine::Get(), TEXT("SimReplay="), RecordingFile))
+	{
+		StartReplay(RecordingFile);
+	}
+	else if (FParse::Value(FCommandLine::Get(), TEXT("SimRecord="), RecordingFile))
+	{
+		StartRecording(RecordingFile);
+	}
+
 	// Hack - Make player look at the balls.
 	if (!GetWorld()->IsNetMode(NM_DedicatedServer))
 	{
@@ -106,10 +406,11 @@ void ASimBallsGameState::Tick(float DeltaSeconds)
 	
 	RunSimulation(DeltaSeconds);
 
-	// no need to update visual actors on DS
-	//if (!GetWorld()->IsNetMode(NM_DedicatedServer))
+	SpawnPendingBallActors();
+
+	for (ABallActor* BallActor : BallActors)
 	{
-		for (ABallActor* BallActor : BallActors)
+		if (BallActor)
 		{
 			BallActor->UpdateVisuals(DeltaSeconds);
 		}
@@ -133,206 +434,223 @@ void ASimBallsGameState::Tick(float DeltaSeconds)
 
 void ASimBallsGameState::RunSimulation(float DeltaSeconds)
 {
-	const double CurrentTime = HasAuthority() ? GetWorld()->GetTimeSeconds() : GetServerWorldTimeSeconds();
+	const double CurrentTime = (HasAuthority() ? GetWorld()->GetTimeSeconds() : GetServerWorldTimeSeconds()) - SimulationTimeOffset;
 	const double TimeStep = Config->SimulationTimeStep;
 
-	int32 Cycle = 0;
+	auto GetBacklog = [&]()
+	{
+		return CurrentTime > SimulationTime ? FMath::FloorToInt32((CurrentTime - SimulationTime) / TimeStep) + 1 : 0;
+	};
+
+	Simulation.SetParallel(bParallelStep);
+	Simulation.SetSleepingEnabled(bSleepingBalls);
+	const bool bSnapshots = !GetWorld()->IsNetMode(NM_DedicatedServer) || bServerSnapshots;
+	Snapshots.Configure(bSnapshots ? SnapshotSteps : 0, SnapshotKeyframeInterval);
+
+	Scheduler.BudgetMs = StepBudgetMs;
+	Scheduler.CatchUpBudgetMs = CatchUpBudgetMs;
+	Scheduler.CatchUpBacklog = CatchUpBacklog;
+	Scheduler.BeginFrame(GetBacklog());
 	
 	// Try to process all missing steps for late joiners so everyone can stay at the same time frame.
-	// Note: this may be too heavy if client joins very late - better to conditional replicate initial state?
-	while (CurrentTime > SimulationTime)
+	// Steps that do not fit the frame budget are left for the next frames.
+	while (CurrentTime > SimulationTime && Scheduler.CanRunStep())
 	{
-		AdvanceSimulation(SimulationTime);
+		const uint64 StartCycles = FPlatformTime::Cycles64();
+
+		AdvanceSimulation();
 		SimulationTime += TimeStep;
 
-		// Prevent too many cycles per single frame
-		if (Cycle++ > MAX_SIMULATIONS_PER_TICK)
+		Scheduler.EndStep(FPlatformTime::ToMilliseconds64(FPlatformTime::Cycles64() - StartCycles));
+
+		// Intermediate states feed the actors' move queues, not worth it while behind
+		if (bApplyIntermediateSteps && !Scheduler.IsCatchingUp() && CurrentTime > SimulationTime)
 		{
-			return;
+			ApplySimulatedStates();
 		}
 	}
 
+	Scheduler.EndFrame(GetBacklog());
+
 	// Apply updated simulated states to the Ball Actors.
-	if (Cycle > 0)
+	if (Scheduler.GetStepsThisFrame() > 0)
 	{
-		for (const FBallSimulatedState& State : BallStates)
-		{
-			BallActors[State.ID]->ApplySimulatedState(State);
-		}
+		ApplySimulatedStates();
 	}
 }
 
-void ASimBallsGameState::AdvanceSimulation(double Timestamp)
+void ASimBallsGameState::ApplySimulatedStates()
 {
-	// Reset and prepare states for new simulation step (e.g. reset Damage)
-	PrepareBallStates(Timestamp);
-	
-	for (FBallSimulatedState& State : BallStates)
+	if (BallActors.IsEmpty())
 	{
-		SimulateBallState(State);
+		return;
 	}
 
-	// Resolve attack/damage
-	for (FBallSimulatedState& State : BallStates)
+	for (const FBallSimulatedState& State : Simulation.GetBallStates())
 	{
-		State.HP = FMath::Max(0, State.HP - State.Damage);
-		State.bIsDead = State.HP <= 0;
+		// Not spawned yet
+		if (ABallActor* BallActor = BallActors[State.ID])
+		{
+			BallActor->ApplySimulatedState(State);
+		}
 	}
 }
 
-void ASimBallsGameState::PrepareBallStates(double Timestamp)
+void ASimBallsGameState::AdvanceSimulation()
 {
-	TSet<FIntPoint> Obstacles;
-	Obstacles.Reserve(BallStates.Num());
-	
-	for (FBallSimulatedState& State : BallStates)
+	if (Replay)
 	{
-		if (State.bIsDead)
-		{
-			// Respawn after death
-			if (Timestamp - State.Timestamp > Config->DyingDuration)
-			{
-				CreateBallActor(CreateBallState(State.ID));
-				State.Timestamp = Timestamp;
-			}
-		}
-		else
+		double StepTimestamp = SimulationTime;
+		if (Replay->AdvanceSimulation(Simulation, StepTimestamp))
 		{
-			State.Timestamp = Timestamp;	
+			SimulationTime = StepTimestamp;
+			Snapshots.RecordStep(Simulation, StepTimestamp);
+			return;
 		}
 
-		// Reset trackers before entering next simulation step
-		State.Damage = 0;
-		State.MoveSteps = 0;
-		// Reset attack if reached attack interval
-		if (State.StepsToAttack == 0)
-		{
-			State.StepsToAttack = Config->AttackInterval;	
-		}
-		 
-		Obstacles.Add(State.GridPosition);
+		// Recording finished - continue live from the replayed state
+		UE_LOG(LogSim, Log, TEXT("Replay finished at step %d, first divergent step %d"), Simulation.GetCurrentStep(), Replay->GetFirstDivergentStep());
+		Replay.Reset();
 	}
-	
-	Grid->SetObstacles(Obstacles);
+
+	Simulation.AdvanceSimulation(SimulationTime);
+
+	if (Recorder)
+	{
+		Recorder->RecordStep(Simulation, SimulationTime);
+	}
+
+	Snapshots.RecordStep(Simulation, SimulationTime);
 }
 
-void ASimBallsGameState::SimulateBallState(FBallSimulatedState& State)
+bool ASimBallsGameState::RewindSimulation(int32 Step)
 {
-	if (State.bIsDead)
+	if (!Snapshots.CanRewind(Step))
 	{
-		return;
+		return false;
 	}
 
-	if (!ProcessCombatState(State))
-	{
-		ProcessMovementState(State);
+	// Neither matches the timeline after the rewind
+	StopRecording();
+	Replay.Reset();
 
-		// reset attack timer when no longer in combat
-		State.StepsToAttack = Config->AttackInterval;
-	}
+	double StepTimestamp = 0.0;
+	const bool bReproduced = Snapshots.Rewind(Simulation, Step, StepTimestamp);
+
+	// Continue with the step after it, starting now
+	SimulationTime = StepTimestamp + Config->SimulationTimeStep;
+	SimulationTimeOffset = GetWorld()->GetTimeSeconds() - SimulationTime;
+
+	ResetBallActors();
+
+	UE_LOG(LogSim, Log, TEXT("Rewound simulation to step %d"), Simulation.GetCurrentStep());
+	return bReproduced;
 }
 
-bool ASimBallsGameState::ProcessCombatState(FBallSimulatedState& State)
+void ASimBallsGameState::StartRecording(const FString& Filename)
 {
-	int32 EnemyDistance = 0;
-	if (!FindClosestEnemy(State, State.TargetID, EnemyDistance))
-	{
-		return false;	
-	}
+	StopRecording();
 
-	// Enter fighting mode at range - this will stop movement
-	if (EnemyDistance <= Config->AttackRange)
+	TUniquePtr<FSimulationRecorder> NewRecorder = MakeUnique<FSimulationRecorder>();
+	if (NewRecorder->Open(GetRecordingPath(Filename), *Config, Simulation, SimulationTime))
 	{
-		// Apply damage according to expected time step
-		if (--State.StepsToAttack == 0)
-		{
-			ApplyDamage(State, BallStates[State.TargetID]);
-		}
-		
-		return true;
+		Recorder = MoveTemp(NewRecorder);
 	}
-	
-	return false;
 }
 
-bool ASimBallsGameState::ProcessMovementState(FBallSimulatedState& State)
+void ASimBallsGameState::StopRecording()
+{
+	Recorder.Reset();
+}
+
+bool ASimBallsGameState::StartReplay(const FString& Filename)
 {
-	if (!State.IsTargetValid())
+	TUniquePtr<FSimulationReplay> NewReplay = MakeUnique<FSimulationReplay>();
+	if (!NewReplay->Open(GetRecordingPath(Filename)))
 	{
 		return false;
 	}
-	
-	const FIntPoint& TargetPosition = BallStates[State.TargetID].GridPosition;
 
-	// We cache the path and generate when anything changed only
-	// Note: should be done in Async task
-	if (Grid->ShouldRegeneratePath(State.GridPosition, TargetPosition, State.GridPath, Config->AttackRange))
+	StopRecording();
+
+	// Run with the recorded settings instead of the project ones
+	USimulationConfig* ReplayConfig = NewObject<USimulationConfig>(this);
+	NewReplay->GetRecordedConfig().ApplyTo(*ReplayConfig);
+	Config = ReplayConfig;
+
+	Grid->ApplyConfig(Config);
+	Simulation.Initialize(Config, Grid->GetSimulationGrid());
+	Snapshots.Reset();
+
+	if (!NewReplay->RestoreSimulation(Simulation))
 	{
-		State.PathIndex = 0;
-		State.GridPath = Grid->FindPathAStar(State.GridPosition, TargetPosition);
+		UE_LOG(LogSim, Error, TEXT("Failed to restore simulation state from %s"), *Filename);
+		return false;
 	}
 
-	ApplyMovement(State);
+	Replay = MoveTemp(NewReplay);
 
+	// Replay from the recorded time on, starting now
+	SimulationTime = Replay->GetStartTimestamp();
+	SimulationTimeOffset = GetWorld()->GetTimeSeconds() - SimulationTime;
+
+	ResetBallActors();
+	
+	UE_LOG(LogSim, Log, TEXT("Replaying %s from step %d"), *Filename, Simulation.GetCurrentStep());
 	return true;
 }
 
-void ASimBallsGameState::ApplyMovement(FBallSimulatedState& State)
+void ASimBallsGameState::ResetBallActors()
 {
-	const FIntPoint PrevPosition = State.GridPosition;
-	
-	while (State.MoveSteps < Config->MoveRate && State.PathIndex < State.GridPath.Num() - 1 - Config->AttackRange)
+	const TArray<FBallSimulatedState>& States = Simulation.GetBallStates();
+
+	// Without ball actors all of them go
+	const int32 NumKept = bSpawnBallActors ? States.Num() : 0;
+	for (int32 Index = NumKept; Index < BallActors.Num(); ++Index)
 	{
-		State.MoveSteps++;
-		// start from the next grid position and move until MoveStep or Goal is reached
-		State.GridPosition = State.GridPath[++State.PathIndex];
+		if (BallActors[Index])
+		{
+			BallActors[Index]->Destroy();
+		}
 	}
-	
-	// prevent other state finding the same goal position
-	Grid->UpdateObstacle(PrevPosition, State.GridPosition);
-}
+	BallActors.SetNum(NumKept);
 
-void ASimBallsGameState::ApplyDamage(FBallSimulatedState& Attacker, FBallSimulatedState& Receiver)
-{
-	// accumulate damage and set at the end of simulation
-	//Note: Attacker could provide Damage size
-	Receiver.Damage++;
-}
+	PendingBallActors.Reset();
+	NextPendingBallActor = 0;
 
-bool ASimBallsGameState::FindClosestEnemy(const FBallSimulatedState& State, int32& OutEnemy, int32& OutDistance)
-{
-	OutEnemy = INDEX_NONE;
-	OutDistance = TNumericLimits<int32>::Max();
+	if (!bSpawnBallActors)
+	{
+		return;
+	}
 
-	for (const FBallSimulatedState& OtherState : BallStates)
+	for (const FBallSimulatedState& State : States)
 	{
-		// interested in other team states only
-		if (OtherState.bIsDead || OtherState.Team == State.Team || State.ID == OtherState.ID)
+		if (ABallActor* BallActor = BallActors[State.ID])
 		{
-			continue;
+			BallActor->InitBall(State);
 		}
-		
-		const int32 Dist = FMath::Abs(OtherState.GridPosition.X - State.GridPosition.X) + FMath::Abs(OtherState.GridPosition.Y - State.GridPosition.Y);
-		
-		if (Dist < OutDistance)
+		else
 		{
-			OutDistance = Dist;
-			OutEnemy = OtherState.ID;
+			PendingBallActors.Add(State.ID);
 		}
 	}
-		
-	return OutEnemy != INDEX_NONE;
 }
 
 void ASimBallsGameState::AdjustCamera(float DeltaSeconds)
 {
 	if (auto PC = GetGameInstance()->GetFirstLocalPlayerController())
 	{
+		int32 NumSpawnedBalls = 0;
 		FVector BallsMiddlePoint = FVector::ZeroVector;
 		for (const auto Ball : BallActors)
 		{
-			BallsMiddlePoint += Ball->GetActorLocation() / BallActors.Num();
+			if (Ball)
+			{
+				BallsMiddlePoint += Ball->GetActorLocation();
+				NumSpawnedBalls++;
+			}
 		}
+		BallsMiddlePoint /= FMath::Max(1, NumSpawnedBalls);
 		
 		const FVector CameraLoc = PC->PlayerCameraManager->GetCameraLocation();	
 		const FVector LookDir = (BallsMiddlePoint - CameraLoc).GetSafeNormal();
@@ -347,6 +665,11 @@ void ASimBallsGameState::AdjustCamera(float DeltaSeconds)
 			float MinCameraDist = 500;
 			for (const auto Ball : BallActors)
 			{
+				if (!Ball)
+				{
+					continue;
+				}
+				
 				FVector Origin, BoxExtent;
 				Ball->GetActorBounds(false, Origin, BoxExtent);
 				
@@ -3,6 +3,10 @@
 #include "CoreMinimal.h"
 #include "GameFramework/GameState.h"
 #include "BallsTypes.h"
+#include "BallSimulation.h"
+#include "SimulationRecorder.h"
+#include "SimulationScheduler.h"
+#include "SimulationSnapshots.h"
 #include "SimBallsGameState.generated.h"
 
 class AGridManager;
@@ -19,6 +23,31 @@ class SIMBALLS_API ASimBallsGameState : public AGameState
 public:
 	ASimBallsGameState();
 
+	/**
+	 * Starts streaming every simulation step to a recording file.
+	 * @param Filename - File in Saved/Recordings or an absolute path, generated from current time if empty
+	 */
+	void StartRecording(const FString& Filename);
+	void StopRecording();
+	/**
+	 * Replaces the live simulation with a recorded one, visuals follow the replayed states.
+	 * @param Filename - File in Saved/Recordings or an absolute path
+	 * @return true if the recording was loaded
+	 */
+	bool StartReplay(const FString& Filename);
+	/**
+	 * Queues a gameplay command for the simulation, see FBallSimulation::SubmitCommand().
+	 */
+	void SubmitCommand(const FSimulationCommand& Command) { Simulation.SubmitCommand(Command); }
+	/**
+	 * Restores the simulation to a step kept in the snapshot ring and continues from there, stops a running recording or replay.
+	 * @return true if the step was kept and re-simulated to its recorded state
+	 */
+	bool RewindSimulation(int32 Step);
+
+	// Last steps of the simulation (Sim.SnapshotSteps)
+	const FSimulationSnapshotRing& GetSnapshots() const { return Snapshots; }
+
 protected:
 	// Start Base Class Interface
 	virtual void BeginPlay() override;
@@ -27,66 +56,37 @@ protected:
 private:
 	/**
 	 * Initializes all ball states with random positions and team assignments.
-	 * Creates both simulated states and visual actors.
+	 * Visual actors are queued and spawned over the following frames.
 	 */
 	void InitializeBalls();
+	/**
+	 * Spawns queued ball actors until the per frame budget (Sim.ActorSpawnBudgetMs) is used up.
+	 */
+	void SpawnPendingBallActors();
 	/**
 	 * Manages the simulation time progression.
 	 * Processes all pending simulation steps based on elapsed time.
 	 */
 	void RunSimulation(float DeltaSeconds);
 	/**
-	 * Advances the simulation by one time step.
-	 * @param Timestamp - The current simulation time
+	 * Advances the simulation by one time step, from the replay if one is running.
 	 */
-	void AdvanceSimulation(double Timestamp);
+	void AdvanceSimulation();
 	/**
-	 * Prepares all ball states for a new simulation step.
-	 * Resets temporary flags.
+	 * Applies the current simulated states to spawned ball actors.
 	 */
-	void PrepareBallStates(double Timestamp);
-	/**
-	 * Simulates a single ball's behavior for the current time step.
-	 */
-	void SimulateBallState(FBallSimulatedState& State);
-	/**
-	 * Processes combat logic for a ball (attacking and damage).
-	 * @return true if combat occurred, false otherwise
-	 */
-	bool ProcessCombatState(FBallSimulatedState& State);
-	/**
-	 * Processes movement logic for a ball.
-	 * @param State - The ball state to process (will be modified)
-	 * @return true if movement occurred, false otherwise
-	 */
-	bool ProcessMovementState(FBallSimulatedState& State);
-	/**
-	 * Applies movement to a ball state based on its current path.
-	 */
-	void ApplyMovement(FBallSimulatedState& State);
-	/**
-	 * Applies damage from an attacker to a receiver.
-	 * @param Attacker - The attacking ball state
-	 * @param Receiver - The receiving ball state (will be modified)
-	 */
-	void ApplyDamage(FBallSimulatedState& Attacker, FBallSimulatedState& Receiver);
-	/**
-	 * Finds the closest enemy for a given ball state.
-	 * @return true if an enemy was found, false otherwise
-	 */
-	bool FindClosestEnemy(const FBallSimulatedState& State, int32& OutEnemy, int32& OutDistance);
-	/**
-	 * Creates a new ball state with and appends to BallStates.
-	 * @param StateID - Unique identifier for the new ball
-	 * @return Reference to the newly created ball state
-	 */
-	FBallSimulatedState& CreateBallState(int32 StateID);
+	void ApplySimulatedStates();
 	/**
 	 * Creates and initializes a visual ball actor based on SimulatedState.
 	 * @param BallState - The simulated state to visualize
 	 * @return Created ball actor
 	 */
 	ABallActor* CreateBallActor(const FBallSimulatedState& BallState);
+	/**
+	 * Re-initializes ball actors from the current simulated states, removing the ones without a state.
+	 * Missing actors are queued for spawning.
+	 */
+	void ResetBallActors();
 	
 	// Cached Simulation settings
 	UPROPERTY()
@@ -96,20 +96,38 @@ private:
 	UPROPERTY()
 	TWeakObjectPtr<AGridManager> Grid = nullptr;
 
-	// Collection of all ball simulation states
-	TArray<FBallSimulatedState> BallStates;
+	// Ball simulation states and step logic
+	FBallSimulation Simulation;
 
-	// Collection of all visual ball actors
+	// Collection of all visual ball actors, indexed by ball ID, null until spawned
 	UPROPERTY()
 	TArray<TObjectPtr<ABallActor>> BallActors;
-	
-	// Random number generator for deterministic simulation
-	UPROPERTY()
-	FRandomStream RandomStream;
+
+	// False on dedicated servers, which only run the simulation states (Sim.ServerBallActors)
+	bool bSpawnBallActors = true;
+
+	// Ball IDs waiting for an actor, consumed from NextPendingBallActor
+	TArray<int32> PendingBallActors;
+	int32 NextPendingBallActor = 0;
 
 	// Track simulation time
 	double SimulationTime = 0.0;
 
+	// Limits steps per frame to the time budget (Sim.StepBudgetMs)
+	FSimulationScheduler Scheduler;
+
+	// Subtracted from world time, set when a replay restarts the simulation time
+	double SimulationTimeOffset = 0.0;
+
+	// Active recording, if any
+	TUniquePtr<FSimulationRecorder> Recorder;
+
+	// Active replay driving the simulation, if any
+	TUniquePtr<FSimulationReplay> Replay;
+
+	// Last steps for rewinding and diffing
+	FSimulationSnapshotRing Snapshots;
+
 private:
 	void AdjustCamera(float DeltaSeconds = 0);
 };
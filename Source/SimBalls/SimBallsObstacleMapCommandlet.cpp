@@ -0,0 +1,110 @@
+#include "SimBallsObstacleMapCommandlet.h"
+
+#include "ImageCore.h"
+#include "ImageUtils.h"
+#include "StaticObstacleMap.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogSimObstacleMap, Log, All)
+
+namespace
+{
+	constexpr int32 DefaultThreshold = 128;
+	constexpr int32 DefaultGap = 4;
+
+	bool AddImageObstacles(const FString& ImagePath, int32 Threshold, TOptional<FStaticObstacleMapBuilder>& OutBuilder)
+	{
+		FImage Image;
+		if (!FImageUtils::LoadImage(*ImagePath, Image))
+		{
+			UE_LOG(LogSimObstacleMap, Error, TEXT("Failed to load image %s"), *ImagePath);
+			return false;
+		}
+
+		FImage Gray;
+		Image.CopyTo(Gray, ERawImageFormat::G8, EGammaSpace::sRGB);
+		const TArrayView64<uint8> Pixels = Gray.AsG8();
+
+		OutBuilder.Emplace(FMath::Max(Gray.SizeX, Gray.SizeY));
+		for (int32 Y = 0; Y < Gray.SizeY; ++Y)
+		{
+			for (int32 X = 0; X < Gray.SizeX; ++X)
+			{
+				if (Pixels[static_cast<int64>(Y) * Gray.SizeX + X] < Threshold)
+				{
+					OutBuilder->AddBlockedCell(FIntPoint(X, Y));
+				}
+			}
+		}
+		return true;
+	}
+
+	void AddWallObstacles(int32 GridSize, int32 Spacing, int32 Gap, int32 Seed, FStaticObstacleMapBuilder& Builder)
+	{
+		FRandomStream RandomStream(Seed);
+
+		for (int32 X = Spacing; X < GridSize; X += Spacing)
+		{
+			const int32 GapStart = RandomStream.RandRange(0, FMath::Max(GridSize - Gap, 0));
+			Builder.AddBlockedRect(FIntPoint(X, 0), FIntPoint(X, GapStart - 1));
+			Builder.AddBlockedRect(FIntPoint(X, GapStart + Gap), FIntPoint(X, GridSize - 1));
+		}
+	}
+}
+
+USimBallsObstacleMapCommandlet::USimBallsObstacleMapCommandlet()
+{
+	IsClient = false;
+	IsServer = false;
+	IsEditor = false;
+	LogToConsole = true;
+}
+
+int32 USimBallsObstacleMapCommandlet::Main(const FString& Params)
+{
+	FString OutputPath;
+	FString ImagePath;
+	int32 WallSpacing = 0;
+
+	FParse::Value(*Params, TEXT("Output="), OutputPath);
+	FParse::Value(*Params, TEXT("Image="), ImagePath);
+	FParse::Value(*Params, TEXT("Walls="), WallSpacing);
+
+	if (OutputPath.IsEmpty() || (ImagePath.IsEmpty() && WallSpacing <= 0))
+	{
+		UE_LOG(LogSimObstacleMap, Error, TEXT("Usage: -run=SimBallsObstacleMap -Output=<file> (-Image=<file> [-Threshold=128] | -Walls=<Spacing> -GridSize=N [-Gap=4] [-Seed=0])"));
+		return 1;
+	}
+
+	TOptional<FStaticObstacleMapBuilder> Builder;
+
+	if (!ImagePath.IsEmpty())
+	{
+		int32 Threshold = DefaultThreshold;
+		FParse::Value(*Params, TEXT("Threshold="), Threshold);
+
+		if (!AddImageObstacles(ImagePath, Threshold, Builder))
+		{
+			return 1;
+		}
+	}
+	else
+	{
+		int32 GridSize = 0;
+		int32 Gap = DefaultGap;
+		int32 Seed = 0;
+		FParse::Value(*Params, TEXT("GridSize="), GridSize);
+		FParse::Value(*Params, TEXT("Gap="), Gap);
+		FParse::Value(*Params, TEXT("Seed="), Seed);
+
+		if (GridSize <= 0)
+		{
+			UE_LOG(LogSimObstacleMap, Error, TEXT("-Walls requires -GridSize"));
+			return 1;
+		}
+
+		Builder.Emplace(GridSize);
+		AddWallObstacles(GridSize, WallSpacing, Gap, Seed, *Builder);
+	}
+
+	return Builder->Save(OutputPath) ? 0 : 1;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "SimBallsObstacleMapCommandlet.generated.h"
+
+/**
+ * Builds a static obstacle map file from an image or a generated wall pattern.
+ *
+ * Usage: UnrealEditor-Cmd SimBalls.uproject -run=SimBallsObstacleMap -Output=<file>
+ *        (-Image=<file> [-Threshold=128] | -Walls=<Spacing> -GridSize=N [-Gap=4] [-Seed=0])
+ *
+ * Image pixels map to cells, pixels darker than the threshold are blocked.
+ * Walls are vertical lines every Spacing cells, each with a gap at a random position.
+ */
+UCLASS()
+class USimBallsObstacleMapCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	USimBallsObstacleMapCommandlet();
+
+	// Begin UCommandlet Interface
+	virtual int32 Main(const FString& Params) override;
+	// End UCommandlet Interface
+};
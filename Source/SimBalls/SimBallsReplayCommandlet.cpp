@@ -0,0 +1,86 @@
+#include "SimBallsReplayCommandlet.h"
+
+#include "BallSimulation.h"
+#include "SimulationConfig.h"
+#include "SimulationGrid.h"
+#include "SimulationRecorder.h"
+#include "UObject/StrongObjectPtr.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogSimReplay, Log, All)
+
+USimBallsReplayCommandlet::USimBallsReplayCommandlet()
+{
+	IsClient = false;
+	IsServer = false;
+	IsEditor = false;
+	LogToConsole = true;
+}
+
+int32 USimBallsReplayCommandlet::Main(const FString& Params)
+{
+	FString Filename;
+	if (!FParse::Value(*Params, TEXT("File="), Filename))
+	{
+		UE_LOG(LogSimReplay, Error, TEXT("Usage: -run=SimBallsReplay -File=<recording> [-Steps=N] [-IgnoreDivergence]"));
+		return 1;
+	}
+
+	int32 MaxSteps = MAX_int32;
+	FParse::Value(*Params, TEXT("Steps="), MaxSteps);
+	const bool bIgnoreDivergence = FParse::Param(*Params, TEXT("IgnoreDivergence"));
+
+	FSimulationReplay Replay;
+	if (!Replay.Open(Filename))
+	{
+		return 1;
+	}
+
+	TStrongObjectPtr<USimulationConfig> Config(NewObject<USimulationConfig>(GetTransientPackage()));
+	Replay.GetRecordedConfig().ApplyTo(*Config);
+
+	FSimulationGrid Grid;
+	FBallSimulation Simulation;
+	Simulation.Initialize(Config.Get(), Grid);
+
+	if (!Replay.RestoreSimulation(Simulation))
+	{
+		UE_LOG(LogSimReplay, Error, TEXT("Failed to restore simulation state from %s"), *Filename);
+		return 1;
+	}
+
+	const int32 StartStep = Simulation.GetCurrentStep();
+	double TotalMs = 0.0;
+	double MaxMs = 0.0;
+	int32 NumSteps = 0;
+	double Timestamp = 0.0;
+
+	while (NumSteps < MaxSteps)
+	{
+		const uint64 StartCycles = FPlatformTime::Cycles64();
+		if (!Replay.AdvanceSimulation(Simulation, Timestamp))
+		{
+			break;
+		}
+		const double StepMs = FPlatformTime::ToMilliseconds64(FPlatformTime::Cycles64() - StartCycles);
+
+		TotalMs += StepMs;
+		MaxMs = FMath::Max(MaxMs, StepMs);
+		NumSteps++;
+
+		if (!bIgnoreDivergence && Replay.GetFirstDivergentStep() != INDEX_NONE)
+		{
+			break;
+		}
+	}
+
+	UE_LOG(LogSimReplay, Display, TEXT("Replayed %d steps (%d-%d) of %s: total %.2fms, mean %.3fms, max %.3fms, %d paths"),
+		NumSteps, StartStep, Simulation.GetCurrentStep(), *Filename, TotalMs, NumSteps > 0 ? TotalMs / NumSteps : 0.0, MaxMs, Grid.GetNumPathsComputed());
+
+	if (Replay.GetFirstDivergentStep() != INDEX_NONE)
+	{
+		UE_LOG(LogSimReplay, Error, TEXT("Simulation diverged from the recording at step %d"), Replay.GetFirstDivergentStep());
+		return 2;
+	}
+
+	return 0;
+}
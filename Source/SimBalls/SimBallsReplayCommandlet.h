@@ -0,0 +1,25 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "SimBallsReplayCommandlet.generated.h"
+
+/**
+ * Replays a simulation recording headless at maximum speed, verifying every step against the recorded state hash.
+ *
+ * Usage: UnrealEditor-Cmd SimBalls.uproject -run=SimBallsReplay -File=<recording> [-Steps=N] [-IgnoreDivergence]
+ *
+ * Returns 0 when all replayed steps matched, 2 on divergence - suitable for git bisect run.
+ */
+UCLASS()
+class USimBallsReplayCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	USimBallsReplayCommandlet();
+
+	// Begin UCommandlet Interface
+	virtual int32 Main(const FString& Params) override;
+	// End UCommandlet Interface
+};
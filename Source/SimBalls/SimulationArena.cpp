@@ -0,0 +1,217 @@
+#include "SimulationArena.h"
+
+#include "SimBalls.h"
+#include "HAL/MemoryBase.h"
+#include "Misc/ScopeLock.h"
+
+#include <atomic>
+
+DECLARE_DWORD_COUNTER_STAT(TEXT("Arena Peak Bytes"), STAT_SimArenaPeakBytes, STATGROUP_SimBalls);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Arena Allocations"), STAT_SimArenaAllocations, STATGROUP_SimBalls);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Arena Block Allocations"), STAT_SimArenaBlockAllocations, STATGROUP_SimBalls);
+
+namespace
+{
+	thread_local FSimulationArena* CurrentArena = nullptr;
+
+	constexpr uint32 BlockAlignment = 64;
+
+	std::atomic<int64> NumHeapAllocations = 0;
+
+	/**
+	 * Forwards to the allocator it was put in front of, counting the calls that may take new memory.
+	 */
+	class FCountingMalloc final : public FMalloc
+	{
+	public:
+		explicit FCountingMalloc(FMalloc* InInner)
+			: Inner(InInner)
+		{
+		}
+
+		virtual void* Malloc(SIZE_T Count, uint32 Alignment) override
+		{
+			NumHeapAllocations.fetch_add(1, std::memory_order_relaxed);
+			return Inner->Malloc(Count, Alignment);
+		}
+		virtual void* TryMalloc(SIZE_T Count, uint32 Alignment) override
+		{
+			NumHeapAllocations.fetch_add(1, std::memory_order_relaxed);
+			return Inner->TryMalloc(Count, Alignment);
+		}
+		virtual void* Realloc(void* Original, SIZE_T Count, uint32 Alignment) override
+		{
+			NumHeapAllocations.fetch_add(Count > 0 ? 1 : 0, std::memory_order_relaxed);
+			return Inner->Realloc(Original, Count, Alignment);
+		}
+		virtual void* TryRealloc(void* Original, SIZE_T Count, uint32 Alignment) override
+		{
+			NumHeapAllocations.fetch_add(Count > 0 ? 1 : 0, std::memory_order_relaxed);
+			return Inner->TryRealloc(Original, Count, Alignment);
+		}
+		virtual void Free(void* Original) override { Inner->Free(Original); }
+		virtual SIZE_T QuantizeSize(SIZE_T Count, uint32 Alignment) override { return Inner->QuantizeSize(Count, Alignment); }
+		virtual bool GetAllocationSize(void* Original, SIZE_T& SizeOut) override { return Inner->GetAllocationSize(Original, SizeOut); }
+		virtual void Trim(bool bTrimThreadCaches) override { Inner->Trim(bTrimThreadCaches); }
+		virtual void SetupTLSCachesOnCurrentThread() override { Inner->SetupTLSCachesOnCurrentThread(); }
+		virtual void ClearAndDisableTLSCachesOnCurrentThread() override { Inner->ClearAndDisableTLSCachesOnCurrentThread(); }
+		virtual void InitializeStatsMetadata() override { Inner->InitializeStatsMetadata(); }
+		virtual void UpdateStats() override { Inner->UpdateStats(); }
+		virtual void GetAllocatorStats(FGenericMemoryStats& OutStats) override { Inner->GetAllocatorStats(OutStats); }
+		virtual void DumpAllocatorStats(FOutputDevice& Ar) override { Inner->DumpAllocatorStats(Ar); }
+		virtual bool IsInternallyThreadSafe() const override { return Inner->IsInternallyThreadSafe(); }
+		virtual bool ValidateHeap() override { return Inner->ValidateHeap(); }
+		virtual const TCHAR* GetDescriptiveName() override { return TEXT("SimBallsCountingMalloc"); }
+
+	private:
+		FMalloc* Inner;
+	};
+
+	void InstallCountingMalloc()
+	{
+		static FCriticalSection InstallLock;
+		static bool bInstalled = false;
+
+		FScopeLock Lock(&InstallLock);
+		if (!bInstalled)
+		{
+			// Never removed, memory allocated through it may be freed at any later point
+			GMalloc = new FCountingMalloc(GMalloc);
+			bInstalled = true;
+		}
+	}
+}
+
+FSimulationArena::~FSimulationArena()
+{
+	FreeBlocks();
+}
+
+void* FSimulationArena::Allocate(SIZE_T Size, uint32 Alignment)
+{
+	for (;;)
+	{
+		if (Blocks.IsValidIndex(CurrentBlock))
+		{
+			const FBlock& Block = Blocks[CurrentBlock];
+			const int64 AlignedOffset = Align(Offset, static_cast<int64>(Alignment));
+
+			if (AlignedOffset + static_cast<int64>(Size) <= Block.Size)
+			{
+				Offset = AlignedOffset + Size;
+				PeakBytes = FMath::Max(PeakBytes, Block.Start + Offset);
+				NumAllocations++;
+				return Block.Data + AlignedOffset;
+			}
+
+			// Blocks kept from a rewound scope are reused before growing
+			if (CurrentBlock + 1 < Blocks.Num())
+			{
+				CurrentBlock++;
+				Offset = 0;
+				continue;
+			}
+		}
+
+		AddBlock(Size + Alignment);
+		CurrentBlock = Blocks.Num() - 1;
+		Offset = 0;
+	}
+}
+
+void FSimulationArena::AddBlock(int64 MinSize)
+{
+	FBlock& Block = Blocks.AddDefaulted_GetRef();
+	Block.Size = FMath::Max(DefaultBlockSize, Align(MinSize, static_cast<int64>(4096)));
+	Block.Data = static_cast<uint8*>(FMemory::Malloc(Block.Size, BlockAlignment));
+	Block.Start = Blocks.Num() > 1 ? Blocks[Blocks.Num() - 2].Start + Blocks[Blocks.Num() - 2].Size : 0;
+
+	NumBlockAllocations++;
+}
+
+void FSimulationArena::FreeBlocks()
+{
+	for (const FBlock& Block : Blocks)
+	{
+		FMemory::Free(Block.Data);
+	}
+	Blocks.Reset();
+}
+
+void FSimulationArena::Reset()
+{
+	LastPeakBytes = PeakBytes;
+	LastNumAllocations = NumAllocations;
+	LastNumBlockAllocations = NumBlockAllocations;
+
+	SET_DWORD_STAT(STAT_SimArenaPeakBytes, LastPeakBytes);
+	SET_DWORD_STAT(STAT_SimArenaAllocations, LastNumAllocations);
+	SET_DWORD_STAT(STAT_SimArenaBlockAllocations, LastNumBlockAllocations);
+
+	PeakBytes = 0;
+	NumAllocations = 0;
+	NumBlockAllocations = 0;
+
+	// Merge into one block large enough for the whole step
+	if (Blocks.Num() > 1)
+	{
+		const int64 Capacity = GetCapacity();
+		FreeBlocks();
+		AddBlock(Capacity);
+		NumBlockAllocations = 0;
+	}
+
+	CurrentBlock = 0;
+	Offset = 0;
+}
+
+int64 FSimulationArena::GetCapacity() const
+{
+	return Blocks.Num() > 0 ? Blocks.Last().Start + Blocks.Last().Size : 0;
+}
+
+FSimulationArena* FSimulationArena::GetCurrent()
+{
+	return CurrentArena;
+}
+
+FSimulationArena::FScope::FScope(FSimulationArena& InArena)
+	: PrevArena(CurrentArena)
+{
+	CurrentArena = &InArena;
+}
+
+FSimulationArena::FScope::~FScope()
+{
+	CurrentArena = PrevArena;
+}
+
+FSimulationArena::FMark::FMark(FSimulationArena* InArena)
+	: Arena(InArena)
+{
+	if (Arena)
+	{
+		Block = Arena->CurrentBlock;
+		Offset = Arena->Offset;
+	}
+}
+
+FSimulationArena::FMark::~FMark()
+{
+	if (Arena)
+	{
+		Arena->CurrentBlock = Block;
+		Arena->Offset = Offset;
+	}
+}
+
+FHeapAllocationScope::FHeapAllocationScope()
+{
+	InstallCountingMalloc();
+	StartCount = NumHeapAllocations.load(std::memory_order_relaxed);
+}
+
+int64 FHeapAllocationScope::GetNumAllocations() const
+{
+	return NumHeapAllocations.load(std::memory_order_relaxed) - StartCount;
+}
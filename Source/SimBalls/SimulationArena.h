@@ -0,0 +1,214 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Bump allocator for simulation step temporaries, reset by the owner once the step is done.
+ * Memory of a step that needed more than one block is merged into a single block on reset,
+ * so the arena stops taking memory from the heap once the largest step fits. Allocations the step
+ * still makes outside of the arena can be counted with FHeapAllocationScope.
+ *
+ * Containers pick up the arena made current with FScope on the calling thread through TSimulationArenaAllocator.
+ */
+class SIMBALLS_API FSimulationArena
+{
+public:
+	static constexpr int64 DefaultBlockSize = 256 * 1024;
+
+	FSimulationArena() = default;
+	~FSimulationArena();
+
+	FSimulationArena(const FSimulationArena&) = delete;
+	FSimulationArena& operator=(const FSimulationArena&) = delete;
+
+	void* Allocate(SIZE_T Size, uint32 Alignment);
+	/**
+	 * Releases everything allocated since the last reset and publishes the step counters.
+	 * No container using the arena may be alive.
+	 */
+	void Reset();
+
+	/**
+	 * Makes the arena current for containers created on this thread within the scope.
+	 */
+	struct FScope
+	{
+		explicit FScope(FSimulationArena& InArena);
+		~FScope();
+
+	private:
+		FSimulationArena* PrevArena = nullptr;
+	};
+
+	/**
+	 * Rewinds the arena to its state at construction, for temporaries of a nested scope such as a single search.
+	 */
+	struct FMark
+	{
+		explicit FMark(FSimulationArena* InArena);
+		~FMark();
+
+	private:
+		FSimulationArena* Arena = nullptr;
+		int32 Block = 0;
+		int64 Offset = 0;
+	};
+
+	// Arena of the calling thread, nullptr outside of FScope
+	static FSimulationArena* GetCurrent();
+
+	// Counters of the last finished step
+	int64 GetLastPeakBytes() const { return LastPeakBytes; }
+	int32 GetLastNumAllocations() const { return LastNumAllocations; }
+	// Blocks the arena itself took from the heap, other heap allocations of the step are counted by FHeapAllocationScope
+	int32 GetLastNumBlockAllocations() const { return LastNumBlockAllocations; }
+
+	int64 GetCapacity() const;
+
+private:
+	struct FBlock
+	{
+		uint8* Data = nullptr;
+		int64 Size = 0;
+		// Bytes of all blocks before this one
+		int64 Start = 0;
+	};
+
+	void AddBlock(int64 MinSize);
+	void FreeBlocks();
+
+	TArray<FBlock> Blocks;
+	int32 CurrentBlock = 0;
+	int64 Offset = 0;
+
+	int64 PeakBytes = 0;
+	int32 NumAllocations = 0;
+	int32 NumBlockAllocations = 0;
+
+	int64 LastPeakBytes = 0;
+	int32 LastNumAllocations = 0;
+	int32 LastNumBlockAllocations = 0;
+};
+
+/**
+ * Counts general heap allocations (Malloc and Realloc calls of GMalloc, frees are not counted) while alive.
+ * The first scope puts a counting proxy in front of GMalloc that stays installed, so this is meant for headless tools
+ * such as the benchmark. Allocations of every thread are counted, including engine threads running at the same time.
+ */
+class SIMBALLS_API FHeapAllocationScope
+{
+public:
+	FHeapAllocationScope();
+
+	// Allocations since construction
+	int64 GetNumAllocations() const;
+
+private:
+	int64 StartCount = 0;
+};
+
+/**
+ * Container allocator policy taking memory from the current FSimulationArena, falls back to the heap outside of one.
+ * Like TMemStackAllocator, containers must not outlive the arena scope they were created in.
+ */
+template<uint32 Alignment = DEFAULT_ALIGNMENT>
+class TSimulationArenaAllocator
+{
+public:
+	using SizeType = int32;
+
+	enum { NeedsElementType = true };
+	enum { RequireRangeCheck = true };
+
+	class ForAnyElementType
+	{
+	public:
+		ForAnyElementType()
+			: Arena(FSimulationArena::GetCurrent())
+		{
+		}
+
+		~ForAnyElementType()
+		{
+			if (!Arena && Data)
+			{
+				FMemory::Free(Data);
+			}
+		}
+
+		FORCEINLINE void MoveToEmpty(ForAnyElementType& Other)
+		{
+			checkSlow(this != &Other);
+
+			if (!Arena && Data)
+			{
+				FMemory::Free(Data);
+			}
+
+			Data = Other.Data;
+			Arena = Other.Arena;
+			Other.Data = nullptr;
+		}
+
+		FORCEINLINE FScriptContainerElement* GetAllocation() const { return Data; }
+
+		void ResizeAllocation(SizeType PreviousNumElements, SizeType NumElements, SIZE_T NumBytesPerElement)
+		{
+			if (!Arena)
+			{
+				Data = static_cast<FScriptContainerElement*>(FMemory::Realloc(Data, NumElements * NumBytesPerElement, Alignment));
+				return;
+			}
+
+			// Old memory stays in the arena until it is reset or rewound
+			void* OldData = Data;
+			Data = NumElements > 0 ? static_cast<FScriptContainerElement*>(Arena->Allocate(NumElements * NumBytesPerElement, FMath::Max<uint32>(Alignment, 8))) : nullptr;
+
+			if (OldData && Data && PreviousNumElements > 0)
+			{
+				FMemory::Memcpy(Data, OldData, FMath::Min(PreviousNumElements, NumElements) * NumBytesPerElement);
+			}
+		}
+
+		SizeType CalculateSlackReserve(SizeType NumElements, SIZE_T NumBytesPerElement) const
+		{
+			return DefaultCalculateSlackReserve(NumElements, NumBytesPerElement, false, Alignment);
+		}
+		SizeType CalculateSlackShrink(SizeType NumElements, SizeType NumAllocatedElements, SIZE_T NumBytesPerElement) const
+		{
+			return DefaultCalculateSlackShrink(NumElements, NumAllocatedElements, NumBytesPerElement, false, Alignment);
+		}
+		SizeType CalculateSlackGrow(SizeType NumElements, SizeType NumAllocatedElements, SIZE_T NumBytesPerElement) const
+		{
+			return DefaultCalculateSlackGrow(NumElements, NumAllocatedElements, NumBytesPerElement, false, Alignment);
+		}
+
+		SIZE_T GetAllocatedSize(SizeType NumAllocatedElements, SIZE_T NumBytesPerElement) const
+		{
+			return NumAllocatedElements * NumBytesPerElement;
+		}
+
+		bool HasAllocation() const { return !!Data; }
+		SizeType GetInitialCapacity() const { return 0; }
+
+	private:
+		ForAnyElementType(const ForAnyElementType&) = delete;
+		ForAnyElementType& operator=(const ForAnyElementType&) = delete;
+
+		FScriptContainerElement* Data = nullptr;
+		FSimulationArena* Arena = nullptr;
+	};
+
+	template<typename ElementType>
+	class ForElementType : public ForAnyElementType
+	{
+	public:
+		FORCEINLINE ElementType* GetAllocation() const
+		{
+			return reinterpret_cast<ElementType*>(ForAnyElementType::GetAllocation());
+		}
+	};
+};
+
+// TSet/TMap allocator with elements, free list bits and hash all in the current arena
+using FSimulationArenaSetAllocator = TSetAllocator<TSparseArrayAllocator<TSimulationArenaAllocator<>, TSimulationArenaAllocator<>>, TSimulationArenaAllocator<>>;
@@ -0,0 +1,14 @@
+#include "SimulationCommand.h"
+
+const TCHAR* LexToString(ESimulationCommandType Type)
+{
+	switch (Type)
+	{
+	case ESimulationCommandType::SpawnBall:			return TEXT("SpawnBall");
+	case ESimulationCommandType::KillBall:			return TEXT("KillBall");
+	case ESimulationCommandType::ForceTarget:		return TEXT("ForceTarget");
+	case ESimulationCommandType::AddObstacle:		return TEXT("AddObstacle");
+	case ESimulationCommandType::RemoveObstacle:	return TEXT("RemoveObstacle");
+	default:										return TEXT("Unknown");
+	}
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "BallsTypes.h"
+
+enum class ESimulationCommandType : uint8
+{
+	// Adds a ball of Team, on Cell if it is free
+	SpawnBall,
+	// Kills BallID, it respawns like any other dead ball
+	KillBall,
+	// Makes BallID attack OtherBallID until it dies, INDEX_NONE goes back to the closest enemy
+	ForceTarget,
+	// Blocks Cell until removed again
+	AddObstacle,
+	// Removes an obstacle added by AddObstacle, terrain from the static obstacle map stays
+	RemoveObstacle,
+
+	Max,
+};
+
+SIMBALLS_API const TCHAR* LexToString(ESimulationCommandType Type);
+
+/**
+ * Gameplay input applied at the start of a simulation step.
+ * Commands of a step are applied in submission order, see FBallSimulation::SubmitCommand().
+ */
+struct FSimulationCommand
+{
+	ESimulationCommandType Type = ESimulationCommandType::Max;
+	// Step the command is applied at, INDEX_NONE or a past step for the next one
+	int32 TargetStep = INDEX_NONE;
+
+	int32 BallID = INDEX_NONE;
+	int32 OtherBallID = INDEX_NONE;
+	FIntPoint Cell = FIntPoint(INDEX_NONE, INDEX_NONE);
+	EBallTeamColor Team = EBallTeamColor::Max_None;
+
+	// Submission order, assigned by the simulation
+	uint32 Sequence = 0;
+
+	static FSimulationCommand SpawnBall(EBallTeamColor InTeam, const FIntPoint& InCell = FIntPoint(INDEX_NONE, INDEX_NONE))
+	{
+		FSimulationCommand Command;
+		Command.Type = ESimulationCommandType::SpawnBall;
+		Command.Team = InTeam;
+		Command.Cell = InCell;
+		return Command;
+	}
+
+	static FSimulationCommand KillBall(int32 InBallID)
+	{
+		FSimulationCommand Command;
+		Command.Type = ESimulationCommandType::KillBall;
+		Command.BallID = InBallID;
+		return Command;
+	}
+
+	static FSimulationCommand ForceTarget(int32 InBallID, int32 InTargetID)
+	{
+		FSimulationCommand Command;
+		Command.Type = ESimulationCommandType::ForceTarget;
+		Command.BallID = InBallID;
+		Command.OtherBallID = InTargetID;
+		return Command;
+	}
+
+	static FSimulationCommand SetObstacle(const FIntPoint& InCell, bool bBlocked)
+	{
+		FSimulationCommand Command;
+		Command.Type = bBlocked ? ESimulationCommandType::AddObstacle : ESimulationCommandType::RemoveObstacle;
+		Command.Cell = InCell;
+		return Command;
+	}
+
+	friend FArchive& operator<<(FArchive& Ar, FSimulationCommand& Command)
+	{
+		uint8 Type = static_cast<uint8>(Command.Type);
+		uint8 Team = static_cast<uint8>(Command.Team);
+
+		Ar << Type << Command.TargetStep << Command.BallID << Command.OtherBallID << Command.Cell << Team << Command.Sequence;
+
+		Command.Type = static_cast<ESimulationCommandType>(Type);
+		Command.Team = static_cast<EBallTeamColor>(Team);
+		return Ar;
+	}
+};
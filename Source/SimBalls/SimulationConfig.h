@@ -31,6 +31,31 @@ public:
 	 */
 	UPROPERTY(Config, EditAnywhere, BlueprintReadOnly, Category="General", meta=(ClampMin="1"))
 	int32 CellSize = 100;
+	/**
+	 * Static obstacle map file (see SimBallsObstacleMap commandlet), relative to the project directory.
+	 * Empty for an open grid.
+	 */
+	UPROPERTY(Config, EditAnywhere, BlueprintReadOnly, Category="General")
+	FString StaticObstacleMap;
+	/**
+	 * Landmarks precomputed over the static obstacle map to guide path finding, 0 to use plain manhattan distance.
+	 * Tables are cached in Saved/Landmarks.
+	 */
+	UPROPERTY(Config, EditAnywhere, BlueprintReadOnly, Category="General", meta=(ClampMin="0", ClampMax="32"))
+	int32 NumLandmarks = 0;
+	/**
+	 * A* node expansions per simulation step. The default 0 turns the request queue off, every path is searched in full when it is needed.
+	 * With a limit path requests are queued by priority and balls keep walking their last path while waiting.
+	 * A search that runs out of budget is continued next step, its ball waits on its cell until then.
+	 */
+	UPROPERTY(Config, EditAnywhere, BlueprintReadOnly, Category="General", meta=(ClampMin="0"))
+	int32 PathExpansionBudget = 0;
+	/**
+	 * A* results kept for reuse by balls searching between the same cells, 0 disables the cache.
+	 * Entries are dropped once an obstacle changes in the area they searched, so results are the same either way.
+	 */
+	UPROPERTY(Config, EditAnywhere, BlueprintReadOnly, Category="General", meta=(ClampMin="0"))
+	int32 PathCacheSize = 1024;
 	/** 
 	* Minimum health points for balls
 	*/
@@ -61,6 +86,17 @@ public:
 	 */
 	UPROPERTY(Config, EditAnywhere, BlueprintReadOnly, Category="Balls", meta=(ClampMin="1"))
 	int32 NumBalls = 4;
+	/**
+	 * Number of teams balls are dealt into, every team fights all others unless allied
+	 */
+	UPROPERTY(Config, EditAnywhere, BlueprintReadOnly, Category="Balls", meta=(ClampMin="2", ClampMax="32"))
+	int32 NumTeams = 2;
+	/**
+	 * Bit masks of teams fighting on the same side, e.g. 5 allies teams 0 and 2.
+	 * Teams in no alliance are hostile to everyone.
+	 */
+	UPROPERTY(Config, EditAnywhere, BlueprintReadOnly, Category="Balls")
+	TArray<int32> TeamAlliances;
 	/** 
 	 * Duration of an attack action
 	 */
@@ -0,0 +1,805 @@
+#include "SimulationGrid.h"
+#include "GridHeatmap.h"
+#include "LandmarkTable.h"
+#include "SimBalls.h"
+#include "SimulationArena.h"
+#include "StaticObstacleMap.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogGrid, Log, All)
+
+DECLARE_CYCLE_STAT(TEXT("FindPathAStar"), STAT_SimFindPathAStar, STATGROUP_SimBalls);
+
+namespace
+{
+	const FIntPoint SearchDirections[] = { {1,0}, {-1,0}, {0,1}, {0,-1} };
+
+	// lowest final score gets highest priority, ties broken by deeper nodes then position
+	// so the expansion order does not depend on the heap implementation
+	struct FPathNodeOrder
+	{
+		bool operator()(const FPathSearchNode& A, const FPathSearchNode& B) const
+		{
+			if (A.F != B.F)
+			{
+				return A.F < B.F;
+			}
+			if (A.G != B.G)
+			{
+				return A.G > B.G;
+			}
+			return A.Pos.X != B.Pos.X ? A.Pos.X < B.Pos.X : A.Pos.Y < B.Pos.Y;
+		}
+	};
+	const FPathNodeOrder PathNodeOrder;
+}
+
+void FSimulationGrid::Initialize(int32 InGridSize)
+{
+	GridSize = InGridSize;
+	Chunks.Reset();
+	ChangeStamp = 1;
+	LastChangeStamp = 0;
+	bRebuildingOccupancy = false;
+	PathCache.Empty();
+	ResetCounters();
+
+	if (Heatmap)
+	{
+		Heatmap->Initialize(GridSize);
+	}
+}
+
+void FSimulationGrid::FindPathAStar(const FIntPoint& Start, const FIntPoint& Goal, TArray<FIntPoint>& OutPath, EPathRegenReason Reason, int32* OutExpansions)
+{
+	SCOPE_CYCLE_COUNTER(STAT_SimFindPathAStar);
+
+	const uint64 StartCycles = FPlatformTime::Cycles64();
+	int32 Expansions = 0;
+
+	// Starting on the goal needs no search
+	const bool bUseCache = PathCache.IsEnabled() && Start != Goal;
+	bool bCacheHit = false;
+	if (!bUseCache)
+	{
+		SearchAStar(Start, Goal, OutPath, Expansions);
+	}
+	else if (PathCache.Find(Start, Goal, [this](const FPathCacheEntry& Entry) { return IsCachedPathValid(Entry); }, OutPath, Expansions))
+	{
+		bCacheHit = true;
+	}
+	else
+	{
+		FPathCacheEntry Entry;
+		Entry.Stamp = ChangeStamp;
+		SearchAStar(Start, Goal, OutPath, Expansions, &Entry.Regions);
+		Entry.Path = OutPath;
+		Entry.Expansions = Expansions;
+		PathCache.Add(Start, Goal, MoveTemp(Entry));
+	}
+
+	if (OutExpansions)
+	{
+		*OutExpansions = Expansions;
+	}
+
+	if (bCacheHit)
+	{
+		RecordCacheHit(OutPath);
+	}
+	else
+	{
+		RecordSearch(OutPath, Reason, Expansions, FPlatformTime::Cycles64() - StartCycles);
+	}
+}
+
+bool FSimulationGrid::StartPathSearch(FPathSearch& Search, const FIntPoint& Start, const FIntPoint& Goal, int32 MaxExpansions, TArray<FIntPoint>& OutPath, EPathRegenReason Reason, int32& OutExpansions)
+{
+	SCOPE_CYCLE_COUNTER(STAT_SimFindPathAStar);
+
+	const uint64 StartCycles = FPlatformTime::Cycles64();
+	Search.Reset();
+	Search.Start = Start;
+	Search.Goal = Goal;
+	OutExpansions = 0;
+
+	const bool bUseCache = PathCache.IsEnabled() && Start != Goal;
+	if (bUseCache && PathCache.Find(Start, Goal, [this](const FPathCacheEntry& Entry) { return IsCachedPathValid(Entry); }, OutPath, OutExpansions, MaxExpansions))
+	{
+		RecordCacheHit(OutPath);
+		return true;
+	}
+
+	if (!BeginSearch(Search.Nodes, Start, Goal))
+	{
+		Search.Reset();
+		OutPath.Reset();
+		RecordSearch(OutPath, Reason, 0, FPlatformTime::Cycles64() - StartCycles);
+		return true;
+	}
+
+	FPathCacheEntry Entry;
+	Entry.Stamp = ChangeStamp;
+	if (!ExpandSearch(Search.Nodes, Goal, MaxExpansions, OutPath, OutExpansions, bUseCache ? &Entry.Regions : nullptr))
+	{
+		Search.Expansions = OutExpansions;
+		Search.Cycles = FPlatformTime::Cycles64() - StartCycles;
+		return false;
+	}
+
+	if (bUseCache)
+	{
+		Entry.Path = OutPath;
+		Entry.Expansions = OutExpansions;
+		PathCache.Add(Start, Goal, MoveTemp(Entry));
+	}
+
+	Search.Reset();
+	RecordSearch(OutPath, Reason, OutExpansions, FPlatformTime::Cycles64() - StartCycles);
+	return true;
+}
+
+bool FSimulationGrid::ContinuePathSearch(FPathSearch& Search, int32 MaxExpansions, TArray<FIntPoint>& OutPath, EPathRegenReason Reason, int32& OutExpansions)
+{
+	SCOPE_CYCLE_COUNTER(STAT_SimFindPathAStar);
+
+	const uint64 StartCycles = FPlatformTime::Cycles64();
+	OutExpansions = 0;
+
+	const bool bFinished = ExpandSearch(Search.Nodes, Search.Goal, MaxExpansions, OutPath, OutExpansions, nullptr);
+	Search.Expansions += OutExpansions;
+	Search.Cycles += FPlatformTime::Cycles64() - StartCycles;
+	if (!bFinished)
+	{
+		return false;
+	}
+
+	RecordSearch(OutPath, Reason, Search.Expansions, Search.Cycles);
+	Search.Reset();
+	return true;
+}
+
+FArchive& operator<<(FArchive& Ar, FPathSearch& Search)
+{
+	Ar << Search.Start << Search.Goal << Search.Expansions;
+	Ar << Search.Nodes.NodePool << Search.Nodes.OpenQueue;
+
+	if (Ar.IsLoading())
+	{
+		Search.Cycles = 0;
+		Search.Nodes.PosToIndex.Reset();
+		for (int32 Index = 0; Index < Search.Nodes.NodePool.Num(); ++Index)
+		{
+			const FPathSearchNode& Node = Search.Nodes.NodePool[Index];
+			const int32 ParentIndex = Node.ParentIndex;
+			if (Search.Nodes.PosToIndex.Contains(Node.Pos) || ParentIndex < INDEX_NONE || ParentIndex >= Search.Nodes.NodePool.Num())
+			{
+				Ar.SetError();
+				Search.Reset();
+				break;
+			}
+			Search.Nodes.PosToIndex.Add(Node.Pos, Index);
+		}
+	}
+	return Ar;
+}
+
+void FSimulationGrid::RecordSearch(const TArray<FIntPoint>& Path, EPathRegenReason Reason, int32 Expansions, uint64 Cycles)
+{
+	NumPathsComputed++;
+
+	if (Heatmap)
+	{
+		Heatmap->AddPath(Path);
+	}
+	Telemetry.RecordSearch(Reason, Path.Num(), Expansions, Cycles);
+}
+
+void FSimulationGrid::RecordCacheHit(const TArray<FIntPoint>& Path)
+{
+	if (Heatmap)
+	{
+		Heatmap->AddPath(Path);
+	}
+}
+
+void FSimulationGrid::SearchAStar(const FIntPoint& Start, const FIntPoint& Goal, TArray<FIntPoint>& OutPath, int32& OutExpansions, TArray<FPathCacheRegion>* OutRegions) const
+{
+	OutPath.Reset();
+
+	// Search temporaries are released when the search is done
+	FSimulationArena::FMark ArenaMark(FSimulationArena::GetCurrent());
+
+	TPathSearchNodes<TSimulationArenaAllocator<>, FSimulationArenaSetAllocator> Nodes;
+	if (BeginSearch(Nodes, Start, Goal))
+	{
+		ExpandSearch(Nodes, Goal, MAX_int32, OutPath, OutExpansions, OutRegions);
+	}
+}
+
+template<typename NodesType>
+bool FSimulationGrid::BeginSearch(NodesType& Nodes, const FIntPoint& Start, const FIntPoint& Goal) const
+{
+	if (Start == Goal)
+	{
+		return false;
+	}
+
+	// Landmark distances to the goal give a tighter bound than manhattan around terrain
+	int32 StartBound = FMath::Abs(Start.X - Goal.X) + FMath::Abs(Start.Y - Goal.Y);
+	if (const FLandmarkTable* Landmarks = LandmarkTable.Get())
+	{
+		uint16 GoalDistances[FLandmarkTable::MaxLandmarks];
+		Landmarks->GetDistances(Goal, GoalDistances);
+
+		// Start and goal are separated by terrain
+		const int32 LowerBound = Landmarks->GetLowerBound(Start, GoalDistances);
+		if (LowerBound == FLandmarkTable::Unreachable)
+		{
+			return false;
+		}
+		StartBound = FMath::Max(StartBound, LowerBound);
+	}
+
+	// Initial node
+	Nodes.NodePool.Add(FPathSearchNode(Start, 0, StartBound, INDEX_NONE));
+	Nodes.PosToIndex.Add(Start, 0);
+	Nodes.OpenQueue.HeapPush(Nodes.NodePool[0], PathNodeOrder);
+	return true;
+}
+
+template<typename NodesType>
+bool FSimulationGrid::ExpandSearch(NodesType& Nodes, const FIntPoint& Goal, int32 MaxExpansions, TArray<FIntPoint>& OutPath, int32& OutExpansions, TArray<FPathCacheRegion>* OutRegions) const
+{
+	const FLandmarkTable* Landmarks = LandmarkTable.Get();
+	uint16 GoalDistances[FLandmarkTable::MaxLandmarks];
+	if (Landmarks)
+	{
+		Landmarks->GetDistances(Goal, GoalDistances);
+	}
+
+	// manhatan heuristic (4 directions)
+	auto Heuristic = [Landmarks, &GoalDistances](const FIntPoint& A, const FIntPoint& B)
+	{
+		const int32 Manhattan = FMath::Abs(A.X - B.X) + FMath::Abs(A.Y - B.Y);
+		return Landmarks ? FMath::Max(Manhattan, Landmarks->GetLowerBound(A, GoalDistances)) : Manhattan;
+	};
+
+	// Neighbours mostly stay in the chunk of the previous one
+	FPathCacheRegion* LastRegion = nullptr;
+	auto AddTestedCell = [this, OutRegions, &LastRegion](const FIntPoint& Cell)
+	{
+		const FIntPoint ChunkCoord = FGridChunk::GetChunkCoord(Cell);
+		if (!LastRegion || LastRegion->ChunkCoord != ChunkCoord)
+		{
+			LastRegion = OutRegions->FindByPredicate([&ChunkCoord](const FPathCacheRegion& Region) { return Region.ChunkCoord == ChunkCoord; });
+			if (!LastRegion)
+			{
+				LastRegion = &OutRegions->AddDefaulted_GetRef();
+				LastRegion->ChunkCoord = ChunkCoord;
+				LastRegion->bExisted = Chunks.Contains(ChunkCoord);
+			}
+		}
+		LastRegion->WordMask |= static_cast<uint16>(1u << (FGridChunk::GetLocalIndex(Cell) >> 6));
+	};
+
+	int32 NumExpanded = 0;
+	while (Nodes.OpenQueue.Num() > 0)
+	{
+		FPathSearchNode CurrentNode;
+		Nodes.OpenQueue.HeapPop(CurrentNode, PathNodeOrder, EAllowShrinking::No);
+
+		const int32* CurrentIndexPtr = Nodes.PosToIndex.Find(CurrentNode.Pos);
+		// should never happen
+		if (!CurrentIndexPtr)
+		{
+			continue;
+		}
+
+		const int32 CurrentIndex = *CurrentIndexPtr;
+
+		if (CurrentNode.Pos == Goal)
+		{
+			// Reconstruct path, bounded in case a loaded search links its nodes in a loop
+			OutPath.Reset();
+			int32 TraceIndex = CurrentIndex;
+			while (TraceIndex != INDEX_NONE && OutPath.Num() < Nodes.NodePool.Num())
+			{
+				int32 NextIndex = Nodes.NodePool[TraceIndex].ParentIndex;
+				OutPath.Add(Nodes.NodePool[TraceIndex].Pos);
+				TraceIndex = NextIndex;
+			}
+
+			Algo::Reverse(OutPath);
+
+			return true;
+		}
+
+		// Out of budget, the node is popped again first when the search continues
+		if (NumExpanded >= MaxExpansions)
+		{
+			Nodes.OpenQueue.HeapPush(CurrentNode, PathNodeOrder);
+			return false;
+		}
+
+		Nodes.NodePool[CurrentIndex].bClosed = true;
+		NumExpanded++;
+		OutExpansions++;
+
+		for (const FIntPoint& Dir : SearchDirections)
+		{
+			FIntPoint Neighbor = CurrentNode.Pos + Dir;
+
+			// Boundary check
+			if (Neighbor.X < 0 || Neighbor.Y < 0 || Neighbor.X >= GridSize || Neighbor.Y >= GridSize)
+			{
+				continue;
+			}
+
+			// Obstacle/closed set check, the goal is the target ball cell so it stays walkable
+			if (OutRegions && Neighbor != Goal)
+			{
+				AddTestedCell(Neighbor);
+			}
+			const int32* ExistingIndex = Nodes.PosToIndex.Find(Neighbor);
+			if ((Neighbor != Goal && IsBlocked(Neighbor)) || (ExistingIndex && Nodes.NodePool[*ExistingIndex].bClosed))
+			{
+				continue;
+			}
+
+			const int32 GScore = CurrentNode.G + 1;
+
+			if (ExistingIndex)
+			{
+				FPathSearchNode& ExistingNode = Nodes.NodePool[*ExistingIndex];
+
+				// Existing node - check if this path is better
+				if (GScore < ExistingNode.G)
+				{
+					ExistingNode.G = GScore;
+					ExistingNode.F = GScore + Heuristic(Neighbor, Goal);
+					ExistingNode.ParentIndex = CurrentIndex;
+					Nodes.OpenQueue.HeapPush(ExistingNode, PathNodeOrder);
+				}
+			}
+			else
+			{
+				// New node
+				const int32 NewIndex = Nodes.NodePool.Add(FPathSearchNode(Neighbor, GScore, GScore + Heuristic(Neighbor, Goal), CurrentIndex));
+				Nodes.PosToIndex.Add(Neighbor, NewIndex);
+				Nodes.OpenQueue.HeapPush(Nodes.NodePool[NewIndex], PathNodeOrder);
+			}
+		}
+	}
+
+	// No path found
+	OutPath.Reset();
+	return true;
+}
+
+bool FSimulationGrid::IsCachedPathValid(const FPathCacheEntry& Entry) const
+{
+	static_assert(FGridChunk::NumWords <= 16, "FPathCacheRegion::WordMask holds one bit per chunk word");
+
+	if (LastChangeStamp < Entry.Stamp)
+	{
+		return true;
+	}
+
+	for (const FPathCacheRegion& Region : Entry.Regions)
+	{
+		const FGridChunk* Chunk = Chunks.Find(Region.ChunkCoord);
+		if (!Chunk)
+		{
+			// Released chunks were empty, cells blocked during the search may have been freed since
+			if (Region.bExisted)
+			{
+				return false;
+			}
+			continue;
+		}
+
+		if (Chunk->LastChangeStamp < Entry.Stamp)
+		{
+			continue;
+		}
+
+		for (uint32 Words = Region.WordMask; Words != 0; Words &= Words - 1)
+		{
+			if (Chunk->WordStamps[FMath::CountTrailingZeros(Words)] >= Entry.Stamp)
+			{
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+TArray<FIntPoint> FSimulationGrid::FindPathSimple(const FIntPoint& Start, const FIntPoint& Goal)
+{
+	TArray<FIntPoint> Path;
+	Path.Reserve(FMath::Abs(Start.X - Goal.X) + FMath::Abs(Start.Y - Goal.Y));
+	Path.Add(Start);
+	
+	FIntPoint NextPathPoint = Start;
+	
+	while (NextPathPoint != Goal)
+	{
+		if (NextPathPoint.X < Goal.X)
+		{
+			Path.Add(++NextPathPoint.X);
+		}
+		else if (NextPathPoint.X > Goal.X)
+		{
+			Path.Add(--NextPathPoint.X);
+		}
+		else if (NextPathPoint.Y < Goal.Y)
+		{
+			Path.Add(++NextPathPoint.Y);
+		}
+		else if (NextPathPoint.Y > Goal.Y)
+		{
+			Path.Add(--NextPathPoint.Y);
+		}
+	}
+
+	return Path;
+}
+
+EPathRegenReason FSimulationGrid::ShouldRegeneratePath(const FIntPoint& Start, const FIntPoint& Goal, const TArray<FIntPoint>& InPath, int32 PathIndex, int32 ValidatedStep, int32 Range) const
+{
+	int32 TestedCells = 0;
+	const EPathRegenReason Reason = CheckPath(Start, Goal, InPath, PathIndex, ValidatedStep, Range, TestedCells);
+
+	Telemetry.RecordCheck(Reason, FMath::Max(InPath.Num() - 1 - PathIndex, 0), TestedCells);
+	UE_LOG(LogGrid, Verbose, TEXT("[%hs] %s - %s"), __func__, ShouldRegenerate(Reason) ? TEXT("Regenerate") : TEXT("Skip"), LexToString(Reason));
+
+	return Reason;
+}
+
+EPathRegenReason FSimulationGrid::CheckPath(const FIntPoint& Start, const FIntPoint& Goal, const TArray<FIntPoint>& InPath, int32 PathIndex, int32 ValidatedStep, int32 Range, int32& OutTestedCells) const
+{
+	if (InPath.IsEmpty())
+	{
+		return EPathRegenReason::PathEmpty;
+	}
+
+	// Reached end already
+	if (IsAtRange(Start, Goal, Range))
+	{
+		return EPathRegenReason::GoalReached;
+	}
+	
+	// Goal changed - other ball moved away
+	if (Goal != InPath.Last())
+	{
+		return EPathRegenReason::GoalChanged;
+	}
+
+	// Path walked as expected - the cells behind the ball don't matter
+	if (InPath.IsValidIndex(PathIndex) && InPath[PathIndex] == Start)
+	{
+		return HasChangedObstacle(Goal, InPath, PathIndex, ValidatedStep, OutTestedCells) ? EPathRegenReason::Obstacle : EPathRegenReason::None;
+	}
+
+	bool bFoundStart = false;
+	
+	for (const FIntPoint& Pos : InPath)
+	{
+		if (!bFoundStart)
+		{
+			bFoundStart = Start == Pos;
+			continue;
+		}
+		
+		//Ignore Start/End for obstacle testing
+		OutTestedCells++;
+		if (Pos != Start && Pos != Goal && IsBlocked(Pos))
+		{
+			return EPathRegenReason::Obstacle;
+		}
+	}
+
+	if (!bFoundStart)
+	{
+		return EPathRegenReason::NoStartFound;
+	}
+	
+	return EPathRegenReason::None;
+}
+
+bool FSimulationGrid::HasChangedObstacle(const FIntPoint& Goal, const TArray<FIntPoint>& InPath, int32 PathIndex, int32 ValidatedStep, int32& OutTestedCells) const
+{
+	// Cells changed at ValidatedStep or later carry a higher stamp, the others were free when the path was validated
+	const bool bTestAll = ValidatedStep == INDEX_NONE;
+	const uint32 ValidatedStamp = bTestAll ? 0 : static_cast<uint32>(ValidatedStep);
+	if (!bTestAll && LastChangeStamp <= ValidatedStamp)
+	{
+		return false;
+	}
+
+	FIntPoint ChunkCoord(INDEX_NONE, INDEX_NONE);
+	const FGridChunk* Chunk = nullptr;
+
+	int32 Index = PathIndex + 1;
+	while (Index < InPath.Num())
+	{
+		const FIntPoint& Pos = InPath[Index];
+
+		if (!bTestAll)
+		{
+			const FIntPoint PosChunkCoord = FGridChunk::GetChunkCoord(Pos);
+			if (PosChunkCoord != ChunkCoord)
+			{
+				ChunkCoord = PosChunkCoord;
+				Chunk = Chunks.Find(ChunkCoord);
+			}
+
+			// Unchanged chunk - a 4-way path needs at least the distance to the chunk border to leave it
+			if (!Chunk || Chunk->LastChangeStamp <= ValidatedStamp)
+			{
+				const int32 LocalX = Pos.X & (FGridChunk::Size - 1);
+				const int32 LocalY = Pos.Y & (FGridChunk::Size - 1);
+				Index += FMath::Min(FMath::Min(LocalX, FGridChunk::Size - 1 - LocalX), FMath::Min(LocalY, FGridChunk::Size - 1 - LocalY)) + 1;
+				continue;
+			}
+
+			if (Chunk->ChangeStamps[FGridChunk::GetLocalIndex(Pos)] <= ValidatedStamp)
+			{
+				Index++;
+				continue;
+			}
+		}
+
+		// Goal is occupied by the target
+		OutTestedCells++;
+		if (Pos != Goal && IsBlocked(Pos))
+		{
+			return true;
+		}
+		Index++;
+	}
+
+	return false;
+}
+
+void FSimulationGrid::SetCurrentStep(int32 Step)
+{
+	const uint32 Stamp = static_cast<uint32>(Step) + 1;
+
+	// Cached searches newer than the step could miss changes stamped with older steps
+	if (Stamp < ChangeStamp)
+	{
+		PathCache.Empty();
+	}
+
+	ChangeStamp = Stamp;
+}
+
+FSimulationGrid::FGridChunk& FSimulationGrid::FindOrAddChunk(const FIntPoint& Cell)
+{
+	const FIntPoint ChunkCoord = FGridChunk::GetChunkCoord(Cell);
+	if (FGridChunk* Chunk = Chunks.Find(ChunkCoord))
+	{
+		return *Chunk;
+	}
+
+	// May replace a released chunk whose cells were blocked, all of them count as changed
+	FGridChunk& Chunk = Chunks.Add(ChunkCoord);
+	for (uint32& WordStamp : Chunk.WordStamps)
+	{
+		WordStamp = ChangeStamp;
+	}
+	Chunk.LastChangeStamp = ChangeStamp;
+	LastChangeStamp = ChangeStamp;
+	return Chunk;
+}
+
+bool FSimulationGrid::FGridChunk::SetBit(uint64* Bits, int32 Index, bool bValue)
+{
+	uint64& Word = Bits[Index >> 6];
+	const uint64 Mask = 1ull << (Index & 63);
+	const uint64 Prev = Word;
+	Word = bValue ? (Word | Mask) : (Word & ~Mask);
+	return Word != Prev;
+}
+
+void FSimulationGrid::ResetObstacles()
+{
+	for (auto It = Chunks.CreateIterator(); It; ++It)
+	{
+		FGridChunk& Chunk = It.Value();
+		if (Chunk.NumOccupied == 0 && Chunk.NumStatic == 0)
+		{
+			// Nothing there since the last reset
+			It.RemoveCurrent();
+			continue;
+		}
+
+		FMemory::Memcpy(Chunk.ResetOccupied, Chunk.Occupied, sizeof(Chunk.Occupied));
+		FMemory::Memzero(Chunk.Occupied);
+		Chunk.NumOccupied = 0;
+	}
+
+	bRebuildingOccupancy = true;
+}
+
+void FSimulationGrid::CommitObstacles()
+{
+	bRebuildingOccupancy = false;
+
+	for (TPair<FIntPoint, FGridChunk>& Pair : Chunks)
+	{
+		FGridChunk& Chunk = Pair.Value;
+		for (int32 WordIndex = 0; WordIndex < FGridChunk::NumWords; ++WordIndex)
+		{
+			uint64 Changed = Chunk.Occupied[WordIndex] ^ Chunk.ResetOccupied[WordIndex];
+			while (Changed)
+			{
+				const int32 LocalIndex = WordIndex * 64 + static_cast<int32>(FMath::CountTrailingZeros64(Changed));
+				StampChange(Chunk, LocalIndex);
+
+				// Only cells that differ from before the reset reach the heatmap
+				if (Heatmap)
+				{
+					Heatmap->AddOccupancy(FGridChunk::GetCell(Pair.Key, LocalIndex), FGridChunk::TestBit(Chunk.Occupied, LocalIndex) ? 1 : -1);
+				}
+				Changed &= Changed - 1;
+			}
+		}
+	}
+}
+
+void FSimulationGrid::UpdateObstacle(const FIntPoint& PrevObstacle, const FIntPoint& NewObstacle)
+{
+	if (PrevObstacle == NewObstacle)
+	{
+		return;
+	}
+
+	RemoveObstacle(PrevObstacle);
+	AddObstacle(NewObstacle);
+}
+
+void FSimulationGrid::AddObstacle(const FIntPoint& Obstacle)
+{
+	FGridChunk& Chunk = FindOrAddChunk(Obstacle);
+	const int32 LocalIndex = FGridChunk::GetLocalIndex(Obstacle);
+	if (FGridChunk::SetBit(Chunk.Occupied, LocalIndex, true))
+	{
+		Chunk.NumOccupied++;
+		if (!bRebuildingOccupancy)
+		{
+			StampChange(Chunk, LocalIndex);
+
+			if (Heatmap)
+			{
+				Heatmap->AddOccupancy(Obstacle, 1);
+			}
+		}
+	}
+}
+
+void FSimulationGrid::RemoveObstacle(const FIntPoint& Obstacle)
+{
+	// Empty chunks are kept until the next reset, balls tend to move back and forth between neighbour cells
+	FGridChunk* Chunk = FindChunk(Obstacle);
+	const int32 LocalIndex = FGridChunk::GetLocalIndex(Obstacle);
+	if (Chunk && FGridChunk::SetBit(Chunk->Occupied, LocalIndex, false))
+	{
+		Chunk->NumOccupied--;
+		if (!bRebuildingOccupancy)
+		{
+			StampChange(*Chunk, LocalIndex);
+
+			if (Heatmap)
+			{
+				Heatmap->AddOccupancy(Obstacle, -1);
+			}
+		}
+	}
+}
+
+bool FSimulationGrid::HasObstacle(const FIntPoint& Cell) const
+{
+	const FGridChunk* Chunk = FindChunk(Cell);
+	return Chunk && FGridChunk::TestBit(Chunk->Occupied, FGridChunk::GetLocalIndex(Cell));
+}
+
+void FSimulationGrid::SetStaticObstacle(const FIntPoint& Cell, bool bBlocked)
+{
+	FGridChunk* Chunk = bBlocked ? &FindOrAddChunk(Cell) : FindChunk(Cell);
+	const int32 LocalIndex = FGridChunk::GetLocalIndex(Cell);
+	if (Chunk && FGridChunk::SetBit(Chunk->Static, LocalIndex, bBlocked))
+	{
+		Chunk->NumStatic += bBlocked ? 1 : -1;
+		StampChange(*Chunk, LocalIndex);
+	}
+}
+
+bool FSimulationGrid::HasStaticObstacle(const FIntPoint& Cell) const
+{
+	if (StaticObstacleMap && StaticObstacleMap->IsBlocked(Cell))
+	{
+		return true;
+	}
+
+	const FGridChunk* Chunk = FindChunk(Cell);
+	return Chunk && FGridChunk::TestBit(Chunk->Static, FGridChunk::GetLocalIndex(Cell));
+}
+
+void FSimulationGrid::SetStaticObstacleMap(TSharedPtr<const FStaticObstacleMap> InStaticObstacleMap)
+{
+	StaticObstacleMap = MoveTemp(InStaticObstacleMap);
+	PathCache.Empty();
+
+	if (StaticObstacleMap && StaticObstacleMap->GetGridSize() != GridSize)
+	{
+		UE_LOG(LogGrid, Warning, TEXT("Static obstacle map %s is %d cells wide, grid is %d"), *StaticObstacleMap->GetFilename(), StaticObstacleMap->GetGridSize(), GridSize);
+	}
+}
+
+void FSimulationGrid::SetLandmarkTable(TSharedPtr<const FLandmarkTable> InLandmarkTable)
+{
+	if (InLandmarkTable && InLandmarkTable->GetGridSize() != GridSize)
+	{
+		// Distances over a different area may overestimate
+		UE_LOG(LogGrid, Warning, TEXT("Ignoring landmarks built for %d cells wide grid, grid is %d"), InLandmarkTable->GetGridSize(), GridSize);
+		InLandmarkTable.Reset();
+	}
+
+	LandmarkTable = MoveTemp(InLandmarkTable);
+	PathCache.Empty();
+}
+
+void FSimulationGrid::SetHeatmap(FGridHeatmap* InHeatmap)
+{
+	Heatmap = InHeatmap;
+
+	if (Heatmap)
+	{
+		for (const TPair<FIntPoint, FGridChunk>& Pair : Chunks)
+		{
+			AddChunkOccupancyToHeatmap(Pair.Key, Pair.Value, 1);
+		}
+	}
+}
+
+void FSimulationGrid::AddChunkOccupancyToHeatmap(const FIntPoint& ChunkCoord, const FGridChunk& Chunk, int32 Delta) const
+{
+	if (Chunk.NumOccupied == 0)
+	{
+		return;
+	}
+
+	for (int32 WordIndex = 0; WordIndex < FGridChunk::NumWords; ++WordIndex)
+	{
+		for (uint64 Word = Chunk.Occupied[WordIndex]; Word != 0; Word &= Word - 1)
+		{
+			const int32 LocalIndex = WordIndex * 64 + static_cast<int32>(FMath::CountTrailingZeros64(Word));
+			Heatmap->AddOccupancy(FGridChunk::GetCell(ChunkCoord, LocalIndex), Delta);
+		}
+	}
+}
+
+bool FSimulationGrid::IsBlocked(const FIntPoint& Cell) const
+{
+	if (StaticObstacleMap && StaticObstacleMap->IsBlocked(Cell))
+	{
+		return true;
+	}
+
+	const FGridChunk* Chunk = FindChunk(Cell);
+	if (!Chunk)
+	{
+		return false;
+	}
+
+	const int32 Index = FGridChunk::GetLocalIndex(Cell);
+	return FGridChunk::TestBit(Chunk->Occupied, Index) || FGridChunk::TestBit(Chunk->Static, Index);
+}
+
+SIZE_T FSimulationGrid::GetAllocatedSize() const
+{
+	return Chunks.GetAllocatedSize() + PathCache.GetAllocatedSize();
+}
@@ -0,0 +1,317 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "PathCache.h"
+#include "PathTelemetry.h"
+
+class FGridHeatmap;
+class FLandmarkTable;
+class FStaticObstacleMap;
+
+/**
+ * Node of an A* search, nodes are never removed so ParentIndex stays valid.
+ */
+struct FPathSearchNode
+{
+	FIntPoint Pos = FIntPoint::ZeroValue;
+	int32 G = 0;
+	int32 F = 0;
+	int32 ParentIndex = INDEX_NONE;
+	// Expanded, better paths to it are ignored
+	bool bClosed = false;
+
+	FPathSearchNode() {}
+	FPathSearchNode(FIntPoint InPos, int32 InG, int32 InF, int32 InParent)
+		: Pos(InPos), G(InG), F(InF), ParentIndex(InParent) {}
+
+	friend FArchive& operator<<(FArchive& Ar, FPathSearchNode& Node)
+	{
+		return Ar << Node.Pos << Node.G << Node.F << Node.ParentIndex << Node.bClosed;
+	}
+};
+
+/**
+ * Nodes and open queue of one A* search.
+ */
+template<typename ArrayAllocator, typename SetAllocator>
+struct TPathSearchNodes
+{
+	TArray<FPathSearchNode, ArrayAllocator> NodePool;
+	TMap<FIntPoint, int32, SetAllocator> PosToIndex;
+	TArray<FPathSearchNode, ArrayAllocator> OpenQueue;
+
+	void Reset()
+	{
+		NodePool.Reset();
+		PosToIndex.Reset();
+		OpenQueue.Reset();
+	}
+};
+
+/**
+ * A* search limited by an expansion budget, see FSimulationGrid::StartPathSearch().
+ * When the budget runs out the search keeps its nodes and is continued in a later step against the grid of that step.
+ * Containers keep their allocation between searches.
+ */
+struct FPathSearch
+{
+	FIntPoint Start = FIntPoint::ZeroValue;
+	FIntPoint Goal = FIntPoint::ZeroValue;
+	TPathSearchNodes<FDefaultAllocator, FDefaultSetAllocator> Nodes;
+	// Expanded so far over all steps
+	int32 Expansions = 0;
+	// Time spent so far, not saved
+	uint64 Cycles = 0;
+
+	// Stopped at the budget and waiting to be continued
+	bool IsActive() const { return Nodes.NodePool.Num() > 0; }
+
+	void Reset()
+	{
+		Nodes.Reset();
+		Expansions = 0;
+		Cycles = 0;
+	}
+
+	SIZE_T GetAllocatedSize() const { return Nodes.NodePool.GetAllocatedSize() + Nodes.PosToIndex.GetAllocatedSize() + Nodes.OpenQueue.GetAllocatedSize(); }
+
+	/**
+	 * Saves or loads the nodes, the position index is rebuilt on load. Sets the archive error on duplicate nodes.
+	 */
+	friend FArchive& operator<<(FArchive& Ar, FPathSearch& Search);
+};
+
+/**
+ * World-independent grid used by the simulation for obstacles and path finding.
+ * AGridManager owns one for the level, headless tools can create their own.
+ *
+ * Cells are stored in fixed size chunks allocated on first use, so memory follows the populated
+ * area instead of the GridSize x GridSize square. Each chunk keeps ball occupancy and static obstacles as bits.
+ * Terrain loaded from a file stays in its memory mapped FStaticObstacleMap and is merged at query time.
+ */
+class SIMBALLS_API FSimulationGrid
+{
+public:
+	void Initialize(int32 InGridSize);
+
+	/**
+	 * Finds the shortest 4-way path, attributing its cost to the given regeneration reason.
+	 * Search temporaries come from the current FSimulationArena when there is one.
+	 * Results are reused from the path cache while no cell the search tested has changed.
+	 * Not thread safe, the search counters, telemetry and heatmap are plain members.
+	 * @param OutPath - Receives the path from Start to Goal, empty if there is none. Keeps its allocation when large enough
+	 * @param OutExpansions - Optional, receives the number of nodes the search expanded
+	 */
+	void FindPathAStar(const FIntPoint& Start, const FIntPoint& Goal, TArray<FIntPoint>& OutPath, EPathRegenReason Reason = EPathRegenReason::None, int32* OutExpansions = nullptr);
+
+	/**
+	 * Starts a search that expands at most MaxExpansions nodes per call, dropping any search Search still holds.
+	 * Cache hits are only used when the search they replay fits in MaxExpansions, so results do not depend on the cache.
+	 * @param OutPath - Set only when the search finished
+	 * @param OutExpansions - Receives the nodes expanded by this call, the original search's count on cache hits
+	 * @return true when the search finished, false when it stopped at the budget, see ContinuePathSearch()
+	 */
+	bool StartPathSearch(FPathSearch& Search, const FIntPoint& Start, const FIntPoint& Goal, int32 MaxExpansions, TArray<FIntPoint>& OutPath, EPathRegenReason Reason, int32& OutExpansions);
+
+	/**
+	 * Continues a search that stopped at its budget. Continued searches are not cached, they saw more than one grid state.
+	 * @return true when the search finished, Search is reset then
+	 */
+	bool ContinuePathSearch(FPathSearch& Search, int32 MaxExpansions, TArray<FIntPoint>& OutPath, EPathRegenReason Reason, int32& OutExpansions);
+
+	TArray<FIntPoint> FindPathSimple(const FIntPoint& Start, const FIntPoint& Goal);
+
+	/**
+	 * Checks whether the cached path is still usable.
+	 * Only cells after PathIndex that changed since ValidatedStep are tested for obstacles, see SetCurrentStep().
+	 * @param PathIndex - Index of Start in InPath, the path is searched for Start when it does not match
+	 * @param ValidatedStep - Step the path was last found free at, INDEX_NONE tests every remaining cell
+	 * @return Why the path has to be regenerated, see ShouldRegenerate()
+	 */
+	EPathRegenReason ShouldRegeneratePath(const FIntPoint& Start, const FIntPoint& Goal, const TArray<FIntPoint>& InPath, int32 PathIndex, int32 ValidatedStep, int32 Range) const;
+
+	/**
+	 * Sets the step cells changing their occupancy or terrain from now on are stamped with.
+	 */
+	void SetCurrentStep(int32 Step);
+
+	/**
+	 * Clears ball occupancy of all cells, releasing chunks that stayed empty since the last reset.
+	 * Occupancy added until CommitObstacles() is compared with the cleared one, only cells that differ count as changed
+	 * and are passed on to the heatmap.
+	 */
+	void ResetObstacles();
+	void CommitObstacles();
+	void UpdateObstacle(const FIntPoint& PrevObstacle, const FIntPoint& NewObstacle);
+	void AddObstacle(const FIntPoint& Obstacle);
+	void RemoveObstacle(const FIntPoint& Obstacle);
+	// Cell occupied by a ball
+	bool HasObstacle(const FIntPoint& Cell) const;
+
+	void SetStaticObstacle(const FIntPoint& Cell, bool bBlocked);
+	// Cell blocked by terrain
+	bool HasStaticObstacle(const FIntPoint& Cell) const;
+
+	/**
+	 * Sets the terrain shared with other grids, kept across Initialize().
+	 */
+	void SetStaticObstacleMap(TSharedPtr<const FStaticObstacleMap> InStaticObstacleMap);
+	const FStaticObstacleMap* GetStaticObstacleMap() const { return StaticObstacleMap.Get(); }
+
+	/**
+	 * Sets landmark distances used to tighten the A* heuristic, ignored when built for a different grid size.
+	 */
+	void SetLandmarkTable(TSharedPtr<const FLandmarkTable> InLandmarkTable);
+
+	/**
+	 * Starts feeding occupancy and path changes to the heatmap, seeded with the current occupancy.
+	 * @param InHeatmap - Must outlive the grid or be unset, nullptr to stop
+	 */
+	void SetHeatmap(FGridHeatmap* InHeatmap);
+
+	// Cell occupied by a ball or blocked by terrain
+	bool IsBlocked(const FIntPoint& Cell) const;
+	bool IsInside(const FIntPoint& Cell) const { return Cell.X >= 0 && Cell.Y >= 0 && Cell.X < GridSize && Cell.Y < GridSize; }
+
+	// Helper methods
+	inline int64 GridPositionToIndex(const FIntPoint& GridPos) const;
+	inline FIntPoint IndexToGridPosition(int64 Index) const;
+	inline bool IsAtRange(const FIntPoint& A, const FIntPoint& B, int32 Range) const;
+
+	int32 GetGridSize() const { return GridSize; }
+	int32 GetNumChunks() const { return Chunks.Num(); }
+
+	// Number of A* searches since last reset, paths returned by the path cache are not counted
+	int32 GetNumPathsComputed() const { return NumPathsComputed; }
+	void ResetCounters() { NumPathsComputed = 0; }
+
+	SIZE_T GetAllocatedSize() const;
+
+	FPathTelemetry& GetTelemetry() { return Telemetry; }
+	const FPathTelemetry& GetTelemetry() const { return Telemetry; }
+
+	// Emptied by Initialize() and whenever terrain or steps go back, capacity is kept
+	FPathCache& GetPathCache() { return PathCache; }
+	const FPathCache& GetPathCache() const { return PathCache; }
+
+private:
+	struct FGridChunk
+	{
+		static constexpr int32 SizeLog2 = 5;
+		static constexpr int32 Size = 1 << SizeLog2;
+		static constexpr int32 NumCells = Size * Size;
+		static constexpr int32 NumWords = NumCells / 64;
+
+		// Ball occupancy bits
+		uint64 Occupied[NumWords] = {};
+		// Terrain bits
+		uint64 Static[NumWords] = {};
+		// Occupancy bits before the last ResetObstacles()
+		uint64 ResetOccupied[NumWords] = {};
+
+		// Step + 1 each cell last changed at, 0 if it never did
+		uint32 ChangeStamps[NumCells] = {};
+		// Latest of ChangeStamps per word, and of the whole chunk
+		uint32 WordStamps[NumWords] = {};
+		uint32 LastChangeStamp = 0;
+
+		int32 NumOccupied = 0;
+		int32 NumStatic = 0;
+
+		// Row-major index of a cell inside its chunk
+		static int32 GetLocalIndex(const FIntPoint& Cell) { return ((Cell.X & (Size - 1)) << SizeLog2) | (Cell.Y & (Size - 1)); }
+		static FIntPoint GetLocalCell(int32 Index) { return FIntPoint(Index >> SizeLog2, Index & (Size - 1)); }
+		static FIntPoint GetChunkCoord(const FIntPoint& Cell) { return FIntPoint(Cell.X >> SizeLog2, Cell.Y >> SizeLog2); }
+		static FIntPoint GetCell(const FIntPoint& ChunkCoord, int32 LocalIndex)
+		{
+			const FIntPoint LocalCell = GetLocalCell(LocalIndex);
+			return FIntPoint((ChunkCoord.X << SizeLog2) | LocalCell.X, (ChunkCoord.Y << SizeLog2) | LocalCell.Y);
+		}
+
+		static bool TestBit(const uint64* Bits, int32 Index) { return (Bits[Index >> 6] >> (Index & 63)) & 1; }
+		static bool SetBit(uint64* Bits, int32 Index, bool bValue);
+	};
+
+	const FGridChunk* FindChunk(const FIntPoint& Cell) const { return Chunks.Find(FGridChunk::GetChunkCoord(Cell)); }
+	FGridChunk* FindChunk(const FIntPoint& Cell) { return Chunks.Find(FGridChunk::GetChunkCoord(Cell)); }
+	FGridChunk& FindOrAddChunk(const FIntPoint& Cell);
+
+	void AddChunkOccupancyToHeatmap(const FIntPoint& ChunkCoord, const FGridChunk& Chunk, int32 Delta) const;
+
+	void StampChange(FGridChunk& Chunk, int32 LocalIndex)
+	{
+		Chunk.ChangeStamps[LocalIndex] = ChangeStamp;
+		Chunk.WordStamps[LocalIndex >> 6] = ChangeStamp;
+		Chunk.LastChangeStamp = ChangeStamp;
+		LastChangeStamp = ChangeStamp;
+	}
+
+	/**
+	 * @param OutRegions - Optional, receives the cells tested for obstacles
+	 */
+	void SearchAStar(const FIntPoint& Start, const FIntPoint& Goal, TArray<FIntPoint>& OutPath, int32& OutExpansions, TArray<FPathCacheRegion>* OutRegions = nullptr) const;
+
+	/**
+	 * Adds the start node.
+	 * @return false when there is nothing to search, the goal is the start or terrain separates them
+	 */
+	template<typename NodesType>
+	bool BeginSearch(NodesType& Nodes, const FIntPoint& Start, const FIntPoint& Goal) const;
+
+	/**
+	 * Expands nodes until the goal is reached, the open queue is empty or MaxExpansions nodes were expanded.
+	 * @param OutPath - Receives the path when the search finished, empty if there is none
+	 * @return false when the search stopped at MaxExpansions and can be expanded further
+	 */
+	template<typename NodesType>
+	bool ExpandSearch(NodesType& Nodes, const FIntPoint& Goal, int32 MaxExpansions, TArray<FIntPoint>& OutPath, int32& OutExpansions, TArray<FPathCacheRegion>* OutRegions) const;
+
+	// Counts a finished search and passes it on to the heatmap and telemetry
+	void RecordSearch(const TArray<FIntPoint>& Path, EPathRegenReason Reason, int32 Expansions, uint64 Cycles);
+	// Cache hits only feed the heatmap, the cache counts them itself
+	void RecordCacheHit(const TArray<FIntPoint>& Path);
+	// No region the search tested changed since
+	bool IsCachedPathValid(const FPathCacheEntry& Entry) const;
+	EPathRegenReason CheckPath(const FIntPoint& Start, const FIntPoint& Goal, const TArray<FIntPoint>& InPath, int32 PathIndex, int32 ValidatedStep, int32 Range, int32& OutTestedCells) const;
+	bool HasChangedObstacle(const FIntPoint& Goal, const TArray<FIntPoint>& InPath, int32 PathIndex, int32 ValidatedStep, int32& OutTestedCells) const;
+
+	// Allocated chunks by chunk coordinate
+	TMap<FIntPoint, FGridChunk> Chunks;
+
+	TSharedPtr<const FStaticObstacleMap> StaticObstacleMap;
+	TSharedPtr<const FLandmarkTable> LandmarkTable;
+
+	// Debug view, not owned
+	FGridHeatmap* Heatmap = nullptr;
+
+	int32 GridSize = 100;
+
+	// Step + 1 stamped on changed cells
+	uint32 ChangeStamp = 1;
+	// Latest stamp of any cell
+	uint32 LastChangeStamp = 0;
+	// Set between ResetObstacles() and CommitObstacles()
+	bool bRebuildingOccupancy = false;
+
+	int32 NumPathsComputed = 0;
+
+	// Recorded from const path checks as well
+	mutable FPathTelemetry Telemetry;
+
+	FPathCache PathCache;
+};
+
+int64 FSimulationGrid::GridPositionToIndex(const FIntPoint& GridPos) const
+{
+	return static_cast<int64>(FMath::Clamp(GridPos.X, 0, GridSize - 1)) * GridSize + FMath::Clamp(GridPos.Y, 0, GridSize - 1);
+}
+
+FIntPoint FSimulationGrid::IndexToGridPosition(int64 Index) const
+{
+	return FIntPoint(static_cast<int32>(Index / GridSize), static_cast<int32>(Index % GridSize));
+}
+
+bool FSimulationGrid::IsAtRange(const FIntPoint& A, const FIntPoint& B, int32 Range) const
+{
+	return FMath::Abs(A.X - B.X) + FMath::Abs(A.Y - B.Y) <= Range;
+}
@@ -0,0 +1,33 @@
+#include "SimulationInstance.h"
+
+#include "SimulationConfig.h"
+
+FSimulationInstance::FSimulationInstance(int32 InID, const USimulationConfig& Settings, int32 Seed)
+	// Settings act as the template, the copy starts with all of their values
+	: Config(NewObject<USimulationConfig>(GetTransientPackage(), NAME_None, RF_Transient, const_cast<USimulationConfig*>(&Settings)))
+	, ID(InID)
+{
+	Config->Seed = Seed;
+
+	Simulation.Initialize(Config.Get(), Grid);
+	Simulation.InitializeBalls();
+}
+
+FSimulationInstance::~FSimulationInstance() = default;
+
+int32 FSimulationInstance::AdvanceTo(double Time, int32 MaxSteps)
+{
+	int32 NumSteps = 0;
+	while (Time > SimulationTime && NumSteps < MaxSteps)
+	{
+		Simulation.AdvanceSimulation(SimulationTime);
+		SimulationTime += Config->SimulationTimeStep;
+		NumSteps++;
+	}
+	return NumSteps;
+}
+
+SIZE_T FSimulationInstance::GetAllocatedSize() const
+{
+	return Grid.GetAllocatedSize() + Simulation.GetAllocatedSize();
+}
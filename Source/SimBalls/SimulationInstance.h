@@ -0,0 +1,57 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "BallSimulation.h"
+#include "SimulationGrid.h"
+#include "UObject/StrongObjectPtr.h"
+
+class USimulationConfig;
+
+/**
+ * Self-contained match - settings, grid, balls and random stream - independent of any actor or other instance.
+ * Created and destroyed on the game thread, stepping only touches the instance and may run on any thread.
+ */
+class SIMBALLS_API FSimulationInstance
+{
+public:
+	/**
+	 * @param InID - Identifier of the instance within its owner
+	 * @param Settings - Copied, later changes to it do not affect the instance
+	 * @param Seed - Seed of the instance random stream, overrides the one in Settings
+	 */
+	FSimulationInstance(int32 InID, const USimulationConfig& Settings, int32 Seed);
+	~FSimulationInstance();
+
+	FSimulationInstance(const FSimulationInstance&) = delete;
+	FSimulationInstance& operator=(const FSimulationInstance&) = delete;
+
+	/**
+	 * Runs pending steps until the simulation reaches Time.
+	 * @param Time - Time since the instance was created
+	 * @param MaxSteps - Steps left for later calls once reached
+	 * @return Number of steps run
+	 */
+	int32 AdvanceTo(double Time, int32 MaxSteps);
+
+	int32 GetID() const { return ID; }
+	double GetSimulationTime() const { return SimulationTime; }
+
+	const USimulationConfig& GetConfig() const { return *Config; }
+	const FBallSimulation& GetSimulation() const { return Simulation; }
+	FBallSimulation& GetSimulation() { return Simulation; }
+	const FSimulationGrid& GetGrid() const { return Grid; }
+
+	/**
+	 * Memory owned by the grid and the simulation.
+	 */
+	SIZE_T GetAllocatedSize() const;
+
+private:
+	TStrongObjectPtr<USimulationConfig> Config;
+
+	FSimulationGrid Grid;
+	FBallSimulation Simulation;
+
+	double SimulationTime = 0.0;
+	int32 ID = INDEX_NONE;
+};
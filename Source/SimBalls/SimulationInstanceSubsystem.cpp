@@ -0,0 +1,167 @@
+#include "SimulationInstanceSubsystem.h"
+
+#include "SimBalls.h"
+#include "SimulationConfig.h"
+#include "Async/ParallelFor.h"
+#include "Misc/CommandLine.h"
+
+#include <atomic>
+
+DEFINE_LOG_CATEGORY_STATIC(LogSimInstances, Log, All)
+
+DECLARE_DWORD_COUNTER_STAT(TEXT("Hosted Instances"), STAT_SimHostedInstances, STATGROUP_SimBalls);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Hosted Instance Steps"), STAT_SimHostedInstanceSteps, STATGROUP_SimBalls);
+
+static int32 InstanceMaxStepsPerTick = 10;
+static FAutoConsoleVariableRef CVarInstanceMaxStepsPerTick(
+		TEXT("Sim.Instances.MaxStepsPerTick"),
+		InstanceMaxStepsPerTick,
+		TEXT("Steps a hosted simulation instance may run per tick, the rest is caught up over the following ticks."),
+		ECVF_Default
+	);
+
+static FAutoConsoleCommandWithWorldArgsAndOutputDevice CmdInstances(
+		TEXT("Sim.Instances"),
+		TEXT("Lists hosted simulation instances. 'create N [Seed]' adds N instances with the project settings, 'destroy ID|all' removes them."),
+		FConsoleCommandWithWorldArgsAndOutputDeviceDelegate::CreateStatic([](const TArray<FString>& Args, UWorld* World, FOutputDevice& Ar)
+		{
+			USimulationInstanceSubsystem* Subsystem = World ? World->GetSubsystem<USimulationInstanceSubsystem>() : nullptr;
+			if (!Subsystem)
+			{
+				return;
+			}
+
+			if (Args.Num() > 1 && Args[0] == TEXT("create"))
+			{
+				const USimulationConfig* Settings = USimulationConfig::Get();
+				const int32 Count = FCString::Atoi(*Args[1]);
+				const int32 FirstSeed = Args.Num() > 2 ? FCString::Atoi(*Args[2]) : Settings->Seed + Subsystem->GetNumInstances();
+				for (int32 Index = 0; Index < Count; ++Index)
+				{
+					Subsystem->CreateInstance(*Settings, FirstSeed + Index);
+				}
+			}
+			else if (Args.Num() > 1 && Args[0] == TEXT("destroy"))
+			{
+				if (Args[1] == TEXT("all"))
+				{
+					Subsystem->DestroyAllInstances();
+				}
+				else
+				{
+					Subsystem->DestroyInstance(FCString::Atoi(*Args[1]));
+				}
+			}
+
+			Subsystem->Dump(Ar);
+		})
+	);
+
+int32 USimulationInstanceSubsystem::CreateInstance(const USimulationConfig& Settings, int32 Seed)
+{
+	check(IsInGameThread());
+
+	FHostedInstance& Hosted = Instances.AddDefaulted_GetRef();
+	Hosted.Instance = MakeUnique<FSimulationInstance>(NextInstanceID++, Settings, Seed);
+	Hosted.StartTime = GetWorld()->GetTimeSeconds();
+
+	UE_LOG(LogSimInstances, Log, TEXT("Created simulation instance %d with seed %d, %d hosted"), Hosted.Instance->GetID(), Seed, Instances.Num());
+	return Hosted.Instance->GetID();
+}
+
+bool USimulationInstanceSubsystem::DestroyInstance(int32 InstanceID)
+{
+	check(IsInGameThread());
+
+	const int32 Removed = Instances.RemoveAll([InstanceID](const FHostedInstance& Hosted)
+	{
+		return Hosted.Instance->GetID() == InstanceID;
+	});
+
+	return Removed > 0;
+}
+
+void USimulationInstanceSubsystem::DestroyAllInstances()
+{
+	check(IsInGameThread());
+
+	Instances.Reset();
+}
+
+const FSimulationInstance* USimulationInstanceSubsystem::FindInstance(int32 InstanceID) const
+{
+	const FHostedInstance* Hosted = Instances.FindByPredicate([InstanceID](const FHostedInstance& Other)
+	{
+		return Other.Instance->GetID() == InstanceID;
+	});
+
+	return Hosted ? Hosted->Instance.Get() : nullptr;
+}
+
+void USimulationInstanceSubsystem::Dump(FOutputDevice& Ar) const
+{
+	SIZE_T TotalSize = 0;
+	for (const FHostedInstance& Hosted : Instances)
+	{
+		const FSimulationInstance& Instance = *Hosted.Instance;
+		const SIZE_T Size = Instance.GetAllocatedSize();
+		TotalSize += Size;
+
+		Ar.Logf(TEXT("Instance %d: seed %d, step %d, %d balls, %.1f KB"),
+			Instance.GetID(), Instance.GetConfig().Seed, Instance.GetSimulation().GetCurrentStep(),
+			Instance.GetSimulation().GetBallStates().Num(), Size / 1024.0);
+	}
+
+	Ar.Logf(TEXT("%d hosted instances, %.1f KB"), Instances.Num(), TotalSize / 1024.0);
+}
+
+void USimulationInstanceSubsystem::OnWorldBeginPlay(UWorld& InWorld)
+{
+	Super::OnWorldBeginPlay(InWorld);
+
+	int32 NumInstances = 0;
+	if (FParse::Value(FCommandLine::Get(), TEXT("SimInstances="), NumInstances))
+	{
+		const USimulationConfig* Settings = USimulationConfig::Get();
+		for (int32 Index = 0; Index < NumInstances; ++Index)
+		{
+			CreateInstance(*Settings, Settings->Seed + Index);
+		}
+	}
+}
+
+void USimulationInstanceSubsystem::Deinitialize()
+{
+	DestroyAllInstances();
+
+	Super::Deinitialize();
+}
+
+void USimulationInstanceSubsystem::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	const double WorldTime = GetWorld()->GetTimeSeconds();
+	const int32 MaxSteps = FMath::Max(InstanceMaxStepsPerTick, 1);
+
+	// Instances share nothing but read-only static maps, each one is stepped by a single worker
+	std::atomic<int32> NumSteps = 0;
+	ParallelFor(TEXT("SimBalls.StepInstances"), Instances.Num(), 1, [this, WorldTime, MaxSteps, &NumSteps](int32 Index)
+	{
+		FHostedInstance& Hosted = Instances[Index];
+		NumSteps += Hosted.Instance->AdvanceTo(WorldTime - Hosted.StartTime, MaxSteps);
+	});
+
+	SET_DWORD_STAT(STAT_SimHostedInstances, Instances.Num());
+	SET_DWORD_STAT(STAT_SimHostedInstanceSteps, NumSteps.load());
+}
+
+TStatId USimulationInstanceSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(USimulationInstanceSubsystem, STATGROUP_SimBalls);
+}
+
+bool USimulationInstanceSubsystem::DoesSupportWorldType(const EWorldType::Type WorldType) const
+{
+	return WorldType == EWorldType::Game || WorldType == EWorldType::PIE;
+}
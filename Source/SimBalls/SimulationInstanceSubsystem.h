@@ -0,0 +1,64 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "SimulationInstance.h"
+#include "SimulationInstanceSubsystem.generated.h"
+
+/**
+ * Hosts headless simulation instances next to the match of the game state, so one server process can run many matches.
+ * Instances are stepped in parallel on the task graph workers every tick, each catching up with the world time on its own.
+ *
+ * Dedicated servers create instances from the command line with -SimInstances=N, seeds follow the project seed.
+ */
+UCLASS()
+class SIMBALLS_API USimulationInstanceSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	/**
+	 * Creates and starts a new instance, stepping begins with the next tick.
+	 * @param Settings - Copied into the instance
+	 * @param Seed - Random seed of the instance
+	 * @return Identifier of the new instance
+	 */
+	int32 CreateInstance(const USimulationConfig& Settings, int32 Seed);
+	/**
+	 * @return false if there was no instance with the identifier
+	 */
+	bool DestroyInstance(int32 InstanceID);
+	void DestroyAllInstances();
+
+	const FSimulationInstance* FindInstance(int32 InstanceID) const;
+	int32 GetNumInstances() const { return Instances.Num(); }
+
+	/**
+	 * Lists instances with their step, ball count and memory.
+	 */
+	void Dump(FOutputDevice& Ar) const;
+
+	// Begin UTickableWorldSubsystem Interface
+	virtual void OnWorldBeginPlay(UWorld& InWorld) override;
+	virtual void Deinitialize() override;
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+	// End UTickableWorldSubsystem Interface
+
+protected:
+	// Begin USubsystem Interface
+	virtual bool DoesSupportWorldType(const EWorldType::Type WorldType) const override;
+	// End USubsystem Interface
+
+private:
+	struct FHostedInstance
+	{
+		TUniquePtr<FSimulationInstance> Instance;
+		// World time the instance was created at
+		double StartTime = 0.0;
+	};
+
+	TArray<FHostedInstance> Instances;
+
+	int32 NextInstanceID = 0;
+};
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * What a random draw is used for, draws for different purposes never share numbers.
+ */
+enum class ESimulationRandomPurpose : uint8
+{
+	SpawnHP,
+	SpawnCell,
+};
+
+/**
+ * Counter based random numbers for the simulation (Squares, Widynski 2020).
+ * Every number is a pure function of seed, ball ID, step, purpose and draw index, there is no state shared between balls,
+ * so balls draw in any order or in parallel and adding draws for one purpose does not shift the numbers of another.
+ */
+struct FSimulationRandom
+{
+	FSimulationRandom(int32 Seed, int32 BallID, int32 Step, ESimulationRandomPurpose Purpose)
+		: Counter((static_cast<uint64>(static_cast<uint32>(BallID)) << 32) | static_cast<uint32>(Step))
+		, BaseKey(MixBits((static_cast<uint64>(static_cast<uint32>(Seed)) << 8) | static_cast<uint8>(Purpose)))
+	{
+	}
+
+	uint32 GetUnsignedInt()
+	{
+		// Each draw uses its own key, the counter is taken by ball and step
+		const uint64 Key = MixBits(BaseKey + NumDraws++) | 1;
+		return Squares32(Counter, Key);
+	}
+
+	/**
+	 * @return Number in [Min, Max], Min when the range is empty
+	 */
+	int32 RandRange(int32 Min, int32 Max)
+	{
+		const int64 Range = static_cast<int64>(Max) - Min + 1;
+		if (Range <= 0)
+		{
+			return Min;
+		}
+		return static_cast<int32>(Min + ((static_cast<uint64>(GetUnsignedInt()) * static_cast<uint64>(Range)) >> 32));
+	}
+
+	// Four rounds of squaring the counter times the key, the upper half of the last one is the result
+	static uint32 Squares32(uint64 Counter, uint64 Key)
+	{
+		uint64 X = Counter * Key;
+		const uint64 Y = X;
+		const uint64 Z = Y + Key;
+		X = X * X + Y;
+		X = (X >> 32) | (X << 32);
+		X = X * X + Z;
+		X = (X >> 32) | (X << 32);
+		X = X * X + Y;
+		X = (X >> 32) | (X << 32);
+		return static_cast<uint32>((X * X + Z) >> 32);
+	}
+
+	// SplitMix64 finalizer, spreads seeds and draw indices into well mixed keys
+	static uint64 MixBits(uint64 Value)
+	{
+		Value += 0x9E3779B97F4A7C15ull;
+		Value = (Value ^ (Value >> 30)) * 0xBF58476D1CE4E5B9ull;
+		Value = (Value ^ (Value >> 27)) * 0x94D049BB133111EBull;
+		return Value ^ (Value >> 31);
+	}
+
+private:
+	uint64 Counter = 0;
+	uint64 BaseKey = 0;
+	uint32 NumDraws = 0;
+};
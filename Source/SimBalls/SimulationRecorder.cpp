@@ -0,0 +1,426 @@
+#include "SimulationRecorder.h"
+
+#include "BallSimulation.h"
+#include "SimulationConfig.h"
+#include "Async/MappedFileHandle.h"
+#include "HAL/FileManager.h"
+#include "HAL/PlatformFileManager.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogSimRecorder, Log, All)
+
+namespace
+{
+	constexpr uint32 RecordingMagic = 0x43524253; // 'SBRC'
+	constexpr uint32 RecordingVersion = 11;
+
+	constexpr uint8 Tag_Step = 1;
+
+	// Flush written steps to disk so a crashed run still leaves a usable recording
+	constexpr int32 FlushInterval = 64;
+
+	// Maximum balls listed when a replay diverges
+	constexpr int32 MaxReportedDivergences = 8;
+
+	// Bytes of the smallest ball change in a step record, its ID and flags
+	constexpr int64 MinBallChangeSize = sizeof(int32) + sizeof(uint8);
+
+	enum EBallDeltaFlags : uint8
+	{
+		Delta_Position		= 1 << 0,
+		Delta_Target		= 1 << 1,
+		Delta_HP			= 1 << 2,
+		Delta_StepsToAttack	= 1 << 3,
+		Delta_Dead			= 1 << 4,
+	};
+
+	/**
+	 * Read-only archive over a memory mapped recording.
+	 */
+	class FMappedReplayArchive : public FArchive
+	{
+	public:
+		FMappedReplayArchive(const uint8* InData, int64 InSize)
+			: Data(InData)
+			, Size(InSize)
+		{
+			SetIsLoading(true);
+			SetIsPersistent(true);
+		}
+
+		// Begin FArchive Interface
+		virtual void Serialize(void* V, int64 Length) override
+		{
+			if (Length <= 0)
+			{
+				return;
+			}
+
+			if (Offset + Length > Size)
+			{
+				SetError();
+				FMemory::Memzero(V, Length);
+				return;
+			}
+
+			FMemory::Memcpy(V, Data + Offset, Length);
+			Offset += Length;
+		}
+		virtual int64 Tell() override { return Offset; }
+		virtual int64 TotalSize() override { return Size; }
+		virtual void Seek(int64 InPos) override { Offset = FMath::Clamp<int64>(InPos, 0, Size); }
+		virtual FString GetArchiveName() const override { return TEXT("FMappedReplayArchive"); }
+		// End FArchive Interface
+
+	private:
+		const uint8* Data = nullptr;
+		int64 Size = 0;
+		int64 Offset = 0;
+	};
+}
+
+uint8 FBallRecordState::MakeDeltaFlags(const FBallRecordState& Prev, const FBallRecordState& Next)
+{
+	uint8 Flags = 0;
+	Flags |= Prev.GridPosition != Next.GridPosition ? Delta_Position : 0;
+	Flags |= Prev.TargetID != Next.TargetID ? Delta_Target : 0;
+	Flags |= Prev.HP != Next.HP ? Delta_HP : 0;
+	Flags |= Prev.StepsToAttack != Next.StepsToAttack ? Delta_StepsToAttack : 0;
+	Flags |= Prev.bIsDead != Next.bIsDead ? Delta_Dead : 0;
+	return Flags;
+}
+
+void FBallRecordState::SerializeDelta(FArchive& Ar, uint8 Flags, FBallRecordState& State)
+{
+	if (Flags & Delta_Position)
+	{
+		Ar << State.GridPosition;
+	}
+	if (Flags & Delta_Target)
+	{
+		Ar << State.TargetID;
+	}
+	if (Flags & Delta_HP)
+	{
+		Ar << State.HP;
+	}
+	if (Flags & Delta_StepsToAttack)
+	{
+		Ar << State.StepsToAttack;
+	}
+	if (Flags & Delta_Dead)
+	{
+		uint8 bDead = State.bIsDead ? 1 : 0;
+		Ar << bDead;
+		State.bIsDead = bDead != 0;
+	}
+}
+
+void FRecordedConfig::CopyFrom(const USimulationConfig& Config)
+{
+	SimulationTimeStep = Config.SimulationTimeStep;
+	Seed = Config.Seed;
+	GridSize = Config.GridSize;
+	CellSize = Config.CellSize;
+	MinHP = Config.MinHP;
+	MaxHP = Config.MaxHP;
+	MoveRate = Config.MoveRate;
+	AttackRange = Config.AttackRange;
+	AttackInterval = Config.AttackInterval;
+	NumBalls = Config.NumBalls;
+	NumTeams = Config.NumTeams;
+	TeamAlliances = Config.TeamAlliances;
+	DyingDuration = Config.DyingDuration;
+	StaticObstacleMap = Config.StaticObstacleMap;
+	NumLandmarks = Config.NumLandmarks;
+	PathExpansionBudget = Config.PathExpansionBudget;
+}
+
+void FRecordedConfig::ApplyTo(USimulationConfig& Config) const
+{
+	Config.SimulationTimeStep = SimulationTimeStep;
+	Config.Seed = Seed;
+	Config.GridSize = GridSize;
+	Config.CellSize = CellSize;
+	Config.MinHP = MinHP;
+	Config.MaxHP = MaxHP;
+	Config.MoveRate = MoveRate;
+	Config.AttackRange = AttackRange;
+	Config.AttackInterval = AttackInterval;
+	Config.NumBalls = NumBalls;
+	Config.NumTeams = NumTeams;
+	Config.TeamAlliances = TeamAlliances;
+	Config.DyingDuration = DyingDuration;
+	Config.StaticObstacleMap = StaticObstacleMap;
+	Config.NumLandmarks = NumLandmarks;
+	Config.PathExpansionBudget = PathExpansionBudget;
+}
+
+FArchive& operator<<(FArchive& Ar, FRecordedConfig& Config)
+{
+	Ar << Config.SimulationTimeStep << Config.Seed << Config.GridSize << Config.CellSize;
+	Ar << Config.MinHP << Config.MaxHP << Config.MoveRate << Config.AttackRange << Config.AttackInterval;
+	Ar << Config.NumBalls << Config.NumTeams << Config.TeamAlliances << Config.DyingDuration << Config.StaticObstacleMap << Config.NumLandmarks << Config.PathExpansionBudget;
+	return Ar;
+}
+
+FSimulationRecorder::~FSimulationRecorder()
+{
+	Close();
+}
+
+bool FSimulationRecorder::Open(const FString& InFilename, const USimulationConfig& Config, FBallSimulation& Simulation, double Timestamp)
+{
+	Close();
+
+	Writer.Reset(IFileManager::Get().CreateFileWriter(*InFilename));
+	if (!Writer)
+	{
+		UE_LOG(LogSimRecorder, Error, TEXT("Failed to create recording %s"), *InFilename);
+		return false;
+	}
+
+	Filename = InFilename;
+	NumRecordedSteps = 0;
+
+	uint32 Magic = RecordingMagic;
+	uint32 Version = RecordingVersion;
+	FRecordedConfig RecordedConfig;
+	RecordedConfig.CopyFrom(Config);
+
+	*Writer << Magic << Version << RecordedConfig << Timestamp;
+	Simulation.SerializeState(*Writer);
+
+	LastStates.Reset(Simulation.GetNumBalls());
+	for (int32 BallID = 0; BallID < Simulation.GetNumBalls(); ++BallID)
+	{
+		LastStates.Emplace(Simulation.GetBallState(BallID));
+	}
+
+	UE_LOG(LogSimRecorder, Log, TEXT("Recording simulation to %s from step %d"), *Filename, Simulation.GetCurrentStep());
+	return true;
+}
+
+void FSimulationRecorder::RecordStep(const FBallSimulation& Simulation, double Timestamp)
+{
+	if (!Writer)
+	{
+		return;
+	}
+
+	// Deltas are by ball ID
+	const int32 NumBalls = Simulation.GetNumBalls();
+
+	// Balls added since last step are written in full
+	const int32 NumPrevBalls = LastStates.Num();
+	LastStates.SetNum(NumBalls);
+
+	int32 NumChanges = 0;
+	for (int32 Index = 0; Index < NumBalls; ++Index)
+	{
+		NumChanges += Index >= NumPrevBalls || FBallRecordState(Simulation.GetBallState(Index)) != LastStates[Index] ? 1 : 0;
+	}
+
+	uint8 Tag = Tag_Step;
+	int32 Step = Simulation.GetCurrentStep();
+	uint32 Hash = Simulation.ComputeStateHash();
+	int32 SavedNumBalls = NumBalls;
+
+	*Writer << Tag << Step << Timestamp << Hash << SavedNumBalls << NumChanges;
+
+	// Inputs are replayed, their results are checked through the hash and deltas like everything else
+	TArray<FSimulationCommand> Commands = Simulation.GetAppliedCommands();
+	*Writer << Commands;
+
+	for (int32 Index = 0; Index < NumBalls; ++Index)
+	{
+		FBallRecordState NewState(Simulation.GetBallState(Index));
+		uint8 Flags = Index >= NumPrevBalls ? FBallRecordState::AllFields : FBallRecordState::MakeDeltaFlags(LastStates[Index], NewState);
+
+		if (Flags != 0)
+		{
+			int32 ID = Index;
+			*Writer << ID << Flags;
+			FBallRecordState::SerializeDelta(*Writer, Flags, NewState);
+
+			LastStates[Index] = NewState;
+		}
+	}
+
+	if (++NumRecordedSteps % FlushInterval == 0)
+	{
+		Writer->Flush();
+	}
+}
+
+void FSimulationRecorder::Close()
+{
+	if (Writer)
+	{
+		Writer->Close();
+		Writer.Reset();
+
+		UE_LOG(LogSimRecorder, Log, TEXT("Recorded %d steps to %s"), NumRecordedSteps, *Filename);
+	}
+}
+
+FSimulationReplay::~FSimulationReplay()
+{
+	Reader.Reset();
+	MappedRegion.Reset();
+	MappedHandle.Reset();
+}
+
+bool FSimulationReplay::Open(const FString& InFilename)
+{
+	IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+
+	MappedHandle.Reset(PlatformFile.OpenMapped(*InFilename));
+	if (!MappedHandle)
+	{
+		UE_LOG(LogSimRecorder, Error, TEXT("Failed to map recording %s"), *InFilename);
+		return false;
+	}
+
+	MappedRegion.Reset(MappedHandle->MapRegion(0, MappedHandle->GetFileSize()));
+	if (!MappedRegion)
+	{
+		UE_LOG(LogSimRecorder, Error, TEXT("Failed to map region of recording %s"), *InFilename);
+		return false;
+	}
+
+	Reader = MakeUnique<FMappedReplayArchive>(MappedRegion->GetMappedPtr(), MappedRegion->GetMappedSize());
+
+	uint32 Magic = 0;
+	uint32 Version = 0;
+	*Reader << Magic << Version;
+
+	if (Magic != RecordingMagic || Version != RecordingVersion)
+	{
+		UE_LOG(LogSimRecorder, Error, TEXT("%s is not a supported recording (magic %08x, version %u)"), *InFilename, Magic, Version);
+		return false;
+	}
+
+	*Reader << RecordedConfig << StartTimestamp;
+	FirstDivergentStep = INDEX_NONE;
+
+	return !Reader->IsError();
+}
+
+bool FSimulationReplay::RestoreSimulation(FBallSimulation& Simulation)
+{
+	if (!Reader)
+	{
+		return false;
+	}
+
+	Simulation.SerializeState(*Reader);
+	if (Reader->IsError())
+	{
+		UE_LOG(LogSimRecorder, Error, TEXT("Recorded start state is broken"));
+		return false;
+	}
+
+	RecordedStates.Reset(Simulation.GetNumBalls());
+	for (int32 BallID = 0; BallID < Simulation.GetNumBalls(); ++BallID)
+	{
+		RecordedStates.Emplace(Simulation.GetBallState(BallID));
+	}
+
+	return !Reader->IsError();
+}
+
+bool FSimulationReplay::AdvanceSimulation(FBallSimulation& Simulation, double& OutTimestamp)
+{
+	if (!Reader || Reader->IsError() || Reader->AtEnd())
+	{
+		return false;
+	}
+
+	uint8 Tag = 0;
+	int32 Step = 0;
+	uint32 Hash = 0;
+	int32 NumBalls = 0;
+	int32 NumChanges = 0;
+
+	*Reader << Tag;
+	if (Tag != Tag_Step)
+	{
+		UE_LOG(LogSimRecorder, Error, TEXT("Unexpected record %u in replay"), Tag);
+		return false;
+	}
+
+	*Reader << Step << OutTimestamp << Hash << NumBalls << NumChanges;
+
+	TArray<FSimulationCommand> Commands;
+	*Reader << Commands;
+
+	// Balls are never removed and added ones are written as changes, changes have to fit in the rest of the file
+	const int32 NumPrevBalls = RecordedStates.Num();
+	if (NumChanges < 0 || NumChanges > (Reader->TotalSize() - Reader->Tell()) / MinBallChangeSize
+		|| NumBalls < NumPrevBalls || NumBalls - NumPrevBalls > NumChanges)
+	{
+		Reader->SetError();
+	}
+	else
+	{
+		RecordedStates.SetNum(NumBalls);
+	}
+
+	for (int32 Change = 0; Change < NumChanges && !Reader->IsError(); ++Change)
+	{
+		int32 ID = INDEX_NONE;
+		uint8 Flags = 0;
+		*Reader << ID << Flags;
+
+		if (!RecordedStates.IsValidIndex(ID))
+		{
+			Reader->SetError();
+			break;
+		}
+		FBallRecordState::SerializeDelta(*Reader, Flags, RecordedStates[ID]);
+	}
+
+	if (Reader->IsError())
+	{
+		UE_LOG(LogSimRecorder, Error, TEXT("Replay truncated or broken at step %d"), Step);
+		return false;
+	}
+
+	// Applied at the step they were recorded at, queued before the step starts
+	for (FSimulationCommand& Command : Commands)
+	{
+		Command.TargetStep = Simulation.GetCurrentStep();
+		Simulation.SubmitCommand(Command);
+	}
+
+	Simulation.AdvanceSimulation(OutTimestamp);
+
+	if (FirstDivergentStep == INDEX_NONE && (Simulation.GetCurrentStep() != Step || Simulation.ComputeStateHash() != Hash))
+	{
+		FirstDivergentStep = Step;
+		ReportDivergence(Simulation, Step);
+	}
+
+	return true;
+}
+
+void FSimulationReplay::ReportDivergence(const FBallSimulation& Simulation, int32 Step) const
+{
+	UE_LOG(LogSimRecorder, Warning, TEXT("Replay diverged at recorded step %d (simulated step %d, %d/%d balls)"),
+		Step, Simulation.GetCurrentStep(), Simulation.GetNumBalls(), RecordedStates.Num());
+
+	int32 NumReported = 0;
+	for (int32 Index = 0; Index < FMath::Min(Simulation.GetNumBalls(), RecordedStates.Num()) && NumReported < MaxReportedDivergences; ++Index)
+	{
+		const FBallRecordState Simulated(Simulation.GetBallState(Index));
+		const FBallRecordState& Recorded = RecordedStates[Index];
+
+		if (Simulated != Recorded)
+		{
+			UE_LOG(LogSimRecorder, Warning, TEXT("  Ball %d: pos %s/%s target %d/%d HP %d/%d attack %d/%d dead %d/%d (simulated/recorded)"), Index,
+				*Simulated.GridPosition.ToString(), *Recorded.GridPosition.ToString(), Simulated.TargetID, Recorded.TargetID,
+				Simulated.HP, Recorded.HP, Simulated.StepsToAttack, Recorded.StepsToAttack, Simulated.bIsDead, Recorded.bIsDead);
+			NumReported++;
+		}
+	}
+}
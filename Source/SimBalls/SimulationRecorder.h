@@ -0,0 +1,159 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "BallsTypes.h"
+
+class FBallSimulation;
+class IMappedFileHandle;
+class IMappedFileRegion;
+class USimulationConfig;
+
+/**
+ * Simulation settings stored in a recording, everything that affects the step result.
+ */
+struct FRecordedConfig
+{
+	float SimulationTimeStep = 0.0f;
+	int32 Seed = 0;
+	int32 GridSize = 0;
+	int32 CellSize = 0;
+	int32 MinHP = 0;
+	int32 MaxHP = 0;
+	int32 MoveRate = 0;
+	int32 AttackRange = 0;
+	int32 AttackInterval = 0;
+	int32 NumBalls = 0;
+	int32 NumTeams = 0;
+	TArray<int32> TeamAlliances;
+	float DyingDuration = 0.0f;
+	FString StaticObstacleMap;
+	int32 NumLandmarks = 0;
+	int32 PathExpansionBudget = 0;
+
+	void CopyFrom(const USimulationConfig& Config);
+	void ApplyTo(USimulationConfig& Config) const;
+
+	friend FArchive& operator<<(FArchive& Ar, FRecordedConfig& Config);
+};
+
+/**
+ * Compact copy of the fields tracked per step in a recording.
+ */
+struct FBallRecordState
+{
+	FIntPoint GridPosition = FIntPoint::ZeroValue;
+	int32 TargetID = INDEX_NONE;
+	int32 HP = 0;
+	int32 StepsToAttack = 0;
+	bool bIsDead = false;
+
+	FBallRecordState() = default;
+	explicit FBallRecordState(const FBallSimulatedState& State)
+		: GridPosition(State.GridPosition)
+		, TargetID(State.TargetID)
+		, HP(State.HP)
+		, StepsToAttack(State.StepsToAttack)
+		, bIsDead(State.bIsDead)
+	{}
+
+	bool operator==(const FBallRecordState& Other) const
+	{
+		return GridPosition == Other.GridPosition && TargetID == Other.TargetID && HP == Other.HP
+			&& StepsToAttack == Other.StepsToAttack && bIsDead == Other.bIsDead;
+	}
+
+	// Delta flags selecting every field
+	static constexpr uint8 AllFields = 0xFF;
+
+	/**
+	 * @return Flags of the fields that differ between Prev and Next, 0 if none
+	 */
+	static uint8 MakeDeltaFlags(const FBallRecordState& Prev, const FBallRecordState& Next);
+	/**
+	 * Writes or reads the fields selected by Flags.
+	 */
+	static void SerializeDelta(FArchive& Ar, uint8 Flags, FBallRecordState& State);
+};
+
+/**
+ * Streams a simulation run to an append-only binary file.
+ *
+ * Layout: header (magic, version, settings, start time), full simulation state,
+ * then one record per step with its timestamp, state hash, the commands it applied and the balls that changed.
+ */
+class SIMBALLS_API FSimulationRecorder
+{
+public:
+	~FSimulationRecorder();
+
+	/**
+	 * Creates the file and writes the header and the current simulation state.
+	 * @param Timestamp - Simulation time of the next step
+	 */
+	bool Open(const FString& InFilename, const USimulationConfig& Config, FBallSimulation& Simulation, double Timestamp);
+	/**
+	 * Appends the result of the step that was just advanced.
+	 * @param Timestamp - Time the step was advanced with
+	 */
+	void RecordStep(const FBallSimulation& Simulation, double Timestamp);
+	void Close();
+
+	bool IsOpen() const { return Writer.IsValid(); }
+	const FString& GetFilename() const { return Filename; }
+
+private:
+	TUniquePtr<FArchive> Writer;
+	FString Filename;
+
+	// Last written state, deltas are recorded against it
+	TArray<FBallRecordState> LastStates;
+
+	int32 NumRecordedSteps = 0;
+};
+
+/**
+ * Reads a recording through a memory mapped file and drives a simulation with it.
+ * Every recorded step is re-simulated and its state hash compared with the recorded one.
+ */
+class SIMBALLS_API FSimulationReplay
+{
+public:
+	~FSimulationReplay();
+
+	/**
+	 * Maps the file and reads the header.
+	 */
+	bool Open(const FString& InFilename);
+	/**
+	 * Restores the recorded start state.
+	 * The simulation has to be initialized with settings from GetRecordedConfig() first.
+	 */
+	bool RestoreSimulation(FBallSimulation& Simulation);
+	/**
+	 * Advances the simulation by the next recorded step.
+	 * @param OutTimestamp - Time the step was advanced with
+	 * @return false when the recording has no more steps
+	 */
+	bool AdvanceSimulation(FBallSimulation& Simulation, double& OutTimestamp);
+
+	const FRecordedConfig& GetRecordedConfig() const { return RecordedConfig; }
+	double GetStartTimestamp() const { return StartTimestamp; }
+
+	// First step whose simulated hash did not match the recording, INDEX_NONE if all matched so far
+	int32 GetFirstDivergentStep() const { return FirstDivergentStep; }
+
+private:
+	void ReportDivergence(const FBallSimulation& Simulation, int32 Step) const;
+
+	TUniquePtr<IMappedFileHandle> MappedHandle;
+	TUniquePtr<IMappedFileRegion> MappedRegion;
+	TUniquePtr<FArchive> Reader;
+
+	FRecordedConfig RecordedConfig;
+	double StartTimestamp = 0.0;
+
+	// Recorded states with all deltas read so far applied
+	TArray<FBallRecordState> RecordedStates;
+
+	int32 FirstDivergentStep = INDEX_NONE;
+};
@@ -0,0 +1,59 @@
+#include "SimulationScheduler.h"
+
+#include "SimBalls.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogSimScheduler, Log, All)
+
+DECLARE_DWORD_COUNTER_STAT(TEXT("Step Backlog"), STAT_SimStepBacklog, STATGROUP_SimBalls);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Steps Per Frame"), STAT_SimStepsPerFrame, STATGROUP_SimBalls);
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Average Step (ms)"), STAT_SimAverageStepMs, STATGROUP_SimBalls);
+
+void FSimulationScheduler::BeginFrame(int32 InBacklog)
+{
+	Backlog = InBacklog;
+	StepsThisFrame = 0;
+	FrameMs = 0.0;
+
+	const bool bWasCatchingUp = bCatchingUp;
+	if (Backlog > CatchUpBacklog)
+	{
+		bCatchingUp = true;
+	}
+	else if (Backlog <= 1)
+	{
+		bCatchingUp = false;
+	}
+
+	if (bCatchingUp != bWasCatchingUp)
+	{
+		UE_LOG(LogSimScheduler, Log, TEXT("%s catching up, backlog %d steps, average step %.3fms"),
+			bCatchingUp ? TEXT("Started") : TEXT("Finished"), Backlog, AverageStepMs);
+	}
+}
+
+bool FSimulationScheduler::CanRunStep() const
+{
+	// Always progress, a step costing more than the whole budget would otherwise never run
+	if (StepsThisFrame == 0)
+	{
+		return true;
+	}
+
+	return FrameMs + AverageStepMs <= (bCatchingUp ? CatchUpBudgetMs : BudgetMs);
+}
+
+void FSimulationScheduler::EndStep(double StepMs)
+{
+	AverageStepMs = AverageStepMs > 0.0 ? FMath::Lerp(AverageStepMs, StepMs, AverageWeight) : StepMs;
+	FrameMs += StepMs;
+	StepsThisFrame++;
+}
+
+void FSimulationScheduler::EndFrame(int32 InBacklog)
+{
+	Backlog = InBacklog;
+
+	SET_DWORD_STAT(STAT_SimStepBacklog, Backlog);
+	SET_DWORD_STAT(STAT_SimStepsPerFrame, StepsThisFrame);
+	SET_FLOAT_STAT(STAT_SimAverageStepMs, AverageStepMs);
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Decides how many simulation steps run in a frame from the measured step cost and a time budget.
+ * A backlog deeper than CatchUpBacklog switches to the larger catch-up budget until the simulation is back on time.
+ */
+class SIMBALLS_API FSimulationScheduler
+{
+public:
+	/**
+	 * Starts a frame.
+	 * @param InBacklog - Steps the simulation is behind the current time
+	 */
+	void BeginFrame(int32 InBacklog);
+	/**
+	 * @return true when another step is expected to fit the budget of this frame, always true for the first step
+	 */
+	bool CanRunStep() const;
+	/**
+	 * Records the cost of a step that just ran.
+	 */
+	void EndStep(double StepMs);
+	/**
+	 * Finishes the frame and publishes its stats.
+	 * @param InBacklog - Steps still left behind the current time
+	 */
+	void EndFrame(int32 InBacklog);
+
+	int32 GetBacklog() const { return Backlog; }
+	bool IsCatchingUp() const { return bCatchingUp; }
+	double GetAverageStepMs() const { return AverageStepMs; }
+	int32 GetStepsThisFrame() const { return StepsThisFrame; }
+
+	// Time per frame for simulation steps
+	double BudgetMs = 4.0;
+	// Time per frame while catching up
+	double CatchUpBudgetMs = 12.0;
+	// Backlog that switches to the catch-up budget
+	int32 CatchUpBacklog = 10;
+
+private:
+	// Moving average of the step cost, weights the latest step by this factor
+	static constexpr double AverageWeight = 0.1;
+
+	double AverageStepMs = 0.0;
+	double FrameMs = 0.0;
+
+	int32 Backlog = 0;
+	int32 StepsThisFrame = 0;
+
+	bool bCatchingUp = false;
+};
@@ -0,0 +1,511 @@
+#include "SimulationSnapshots.h"
+
+#include "BallSimulation.h"
+#include "SimBalls.h"
+#include "Misc/FileHelper.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogSimSnapshots, Log, All)
+
+DECLARE_CYCLE_STAT(TEXT("RecordSnapshot"), STAT_SimRecordSnapshot, STATGROUP_SimBalls);
+
+namespace
+{
+	constexpr uint32 SnapshotMagic = 0x4E534253; // 'SBSN'
+	constexpr uint32 SnapshotVersion = 1;
+
+	// Applies a step delta written by RecordStep to states by ball ID
+	void ApplyDelta(const TArray<uint8>& Delta, TArray<FBallRecordState>& States)
+	{
+		FMemoryReader Reader(Delta);
+		while (!Reader.AtEnd() && !Reader.IsError())
+		{
+			int32 BallID = INDEX_NONE;
+			uint8 Flags = 0;
+			Reader << BallID << Flags;
+
+			FBallRecordState Dummy;
+			FBallRecordState::SerializeDelta(Reader, Flags, States.IsValidIndex(BallID) ? States[BallID] : Dummy);
+		}
+	}
+}
+
+void FSimulationSnapshotRing::Configure(int32 InNumSteps, int32 InKeyframeInterval)
+{
+	InNumSteps = FMath::Max(InNumSteps, 0);
+	InKeyframeInterval = FMath::Clamp(InKeyframeInterval, 1, FMath::Max(InNumSteps, 1));
+	if (InNumSteps == NumSteps && InKeyframeInterval == KeyframeInterval)
+	{
+		return;
+	}
+
+	NumSteps = InNumSteps;
+	KeyframeInterval = InKeyframeInterval;
+
+	Snapshots.Empty(NumSteps);
+	Snapshots.SetNum(NumSteps);
+	// Steps in the ring may still refer to the keyframe before the oldest one
+	Keyframes.Empty();
+	Keyframes.SetNum(NumSteps > 0 ? NumSteps / KeyframeInterval + 2 : 0);
+
+	Reset();
+}
+
+void FSimulationSnapshotRing::Reset()
+{
+	for (FStepSnapshot& Snapshot : Snapshots)
+	{
+		Snapshot.Step = INDEX_NONE;
+	}
+	for (FKeyframe& Keyframe : Keyframes)
+	{
+		Keyframe.Step = INDEX_NONE;
+	}
+
+	LastStates.Reset();
+	PathHistory.Reset();
+	PathRevisions.Reset();
+
+	NewestStep = INDEX_NONE;
+	CurrentKeyframe = INDEX_NONE;
+	NextKeyframe = 0;
+}
+
+void FSimulationSnapshotRing::RecordStep(FBallSimulation& Simulation, double Timestamp)
+{
+	if (!IsEnabled())
+	{
+		return;
+	}
+
+	SCOPE_CYCLE_COUNTER(STAT_SimRecordSnapshot);
+
+	const int32 Step = Simulation.GetCurrentStep();
+	if (NewestStep != INDEX_NONE && Step != NewestStep + 1)
+	{
+		Reset();
+	}
+
+	const int32 NumBalls = Simulation.GetNumBalls();
+
+	FStepSnapshot& Snapshot = Snapshots[Step % NumSteps];
+	Snapshot.Step = Step;
+	Snapshot.Timestamp = Timestamp;
+	Snapshot.Hash = Simulation.ComputeStateHash();
+	Snapshot.NumBalls = NumBalls;
+	Snapshot.Commands = Simulation.GetAppliedCommands();
+	Snapshot.Delta.Reset();
+
+	const bool bKeyframe = CurrentKeyframe == INDEX_NONE || Step - Keyframes[CurrentKeyframe].Step >= KeyframeInterval;
+
+	// Fields that changed since the previous step, keyframes keep all of them instead
+	const int32 NumPrevBalls = LastStates.Num();
+	LastStates.SetNum(NumBalls);
+	FMemoryWriter Writer(Snapshot.Delta);
+	for (int32 BallID = 0; BallID < NumBalls; ++BallID)
+	{
+		FBallRecordState State(Simulation.GetBallState(BallID));
+		uint8 Flags = BallID < NumPrevBalls ? FBallRecordState::MakeDeltaFlags(LastStates[BallID], State) : FBallRecordState::AllFields;
+		if (Flags != 0)
+		{
+			LastStates[BallID] = State;
+			if (!bKeyframe)
+			{
+				int32 ID = BallID;
+				Writer << ID << Flags;
+				FBallRecordState::SerializeDelta(Writer, Flags, State);
+			}
+		}
+	}
+
+	RecordPaths(Simulation, Step);
+
+	if (bKeyframe)
+	{
+		const bool bReplacesKeyframe = Keyframes[NextKeyframe].Step != INDEX_NONE;
+
+		CurrentKeyframe = NextKeyframe;
+		NextKeyframe = (NextKeyframe + 1) % Keyframes.Num();
+
+		FKeyframe& Keyframe = Keyframes[CurrentKeyframe];
+		Keyframe.Step = Step;
+		Keyframe.State.Reset();
+		FMemoryWriter StateWriter(Keyframe.State);
+		Simulation.SerializeState(StateWriter, false);
+		Keyframe.BallStates = LastStates;
+
+		if (bReplacesKeyframe)
+		{
+			PrunePaths();
+		}
+	}
+
+	Snapshot.KeyframeStep = Keyframes[CurrentKeyframe].Step;
+	NewestStep = Step;
+}
+
+void FSimulationSnapshotRing::RecordPaths(const FBallSimulation& Simulation, int32 Step)
+{
+	const int32 NumBalls = Simulation.GetNumBalls();
+	const int32 NumPrevBalls = PathRevisions.Num();
+	PathRevisions.SetNum(NumBalls);
+	PathHistory.SetNum(NumBalls);
+
+	for (int32 BallID = 0; BallID < NumBalls; ++BallID)
+	{
+		const FBallSimulatedState& State = Simulation.GetBallState(BallID);
+		if (BallID < NumPrevBalls && State.PathRevision == PathRevisions[BallID])
+		{
+			continue;
+		}
+
+		PathRevisions[BallID] = State.PathRevision;
+		FPathVersion& Version = PathHistory[BallID].AddDefaulted_GetRef();
+		Version.Step = Step;
+		Version.Path = State.GridPath;
+	}
+}
+
+void FSimulationSnapshotRing::PrunePaths()
+{
+	int32 OldestKeyframeStep = MAX_int32;
+	for (const FKeyframe& Keyframe : Keyframes)
+	{
+		if (Keyframe.Step != INDEX_NONE)
+		{
+			OldestKeyframeStep = FMath::Min(OldestKeyframeStep, Keyframe.Step);
+		}
+	}
+
+	for (TArray<FPathVersion>& Versions : PathHistory)
+	{
+		int32 NumUnused = 0;
+		while (NumUnused + 1 < Versions.Num() && Versions[NumUnused + 1].Step <= OldestKeyframeStep)
+		{
+			NumUnused++;
+		}
+		Versions.RemoveAt(0, NumUnused, EAllowShrinking::No);
+	}
+}
+
+const TArray<FIntPoint>* FSimulationSnapshotRing::FindPath(int32 BallID, int32 Step) const
+{
+	if (!PathHistory.IsValidIndex(BallID))
+	{
+		return nullptr;
+	}
+
+	const TArray<FPathVersion>& Versions = PathHistory[BallID];
+	for (int32 Index = Versions.Num() - 1; Index >= 0; --Index)
+	{
+		if (Versions[Index].Step <= Step)
+		{
+			return &Versions[Index].Path;
+		}
+	}
+	return nullptr;
+}
+
+int32 FSimulationSnapshotRing::GetOldestStep() const
+{
+	if (NewestStep == INDEX_NONE)
+	{
+		return INDEX_NONE;
+	}
+
+	// Wrapped slots may refer to an overwritten keyframe
+	for (int32 Step = FMath::Max(NewestStep - NumSteps + 1, 0); Step <= NewestStep; ++Step)
+	{
+		if (FindKeyframeChain(Step))
+		{
+			return Step;
+		}
+	}
+
+	return INDEX_NONE;
+}
+
+bool FSimulationSnapshotRing::GetStates(int32 Step, TArray<FBallRecordState>& OutStates, uint32* OutHash) const
+{
+	const FKeyframe* Keyframe = FindKeyframeChain(Step);
+	if (!Keyframe)
+	{
+		return false;
+	}
+
+	OutStates = Keyframe->BallStates;
+	for (int32 Next = Keyframe->Step + 1; Next <= Step; ++Next)
+	{
+		const FStepSnapshot& Snapshot = *FindSnapshot(Next);
+		OutStates.SetNum(Snapshot.NumBalls);
+		ApplyDelta(Snapshot.Delta, OutStates);
+	}
+
+	if (OutHash)
+	{
+		*OutHash = FindSnapshot(Step)->Hash;
+	}
+	return true;
+}
+
+bool FSimulationSnapshotRing::CanRewind(int32 Step) const
+{
+	return FindKeyframeChain(Step) != nullptr;
+}
+
+bool FSimulationSnapshotRing::Rewind(FBallSimulation& Simulation, int32 Step, double& OutTimestamp)
+{
+	if (!CanRewind(Step))
+	{
+		return false;
+	}
+
+	const FStepSnapshot& Target = *FindSnapshot(Step);
+	const FKeyframe& Keyframe = *FindKeyframe(Target.KeyframeStep);
+
+	FMemoryReader Reader(Keyframe.State);
+	Simulation.SerializeState(Reader, false);
+	if (Reader.IsError())
+	{
+		return false;
+	}
+
+	for (int32 BallID = 0; BallID < Simulation.GetNumBalls(); ++BallID)
+	{
+		if (const TArray<FIntPoint>* Path = FindPath(BallID, Keyframe.Step))
+		{
+			Simulation.RestoreBallPath(BallID, *Path);
+		}
+	}
+
+	for (int32 Next = Keyframe.Step + 1; Next <= Step; ++Next)
+	{
+		const FStepSnapshot& Snapshot = *FindSnapshot(Next);
+		for (FSimulationCommand Command : Snapshot.Commands)
+		{
+			Command.TargetStep = Simulation.GetCurrentStep();
+			Simulation.SubmitCommand(MoveTemp(Command));
+		}
+		Simulation.AdvanceSimulation(Snapshot.Timestamp);
+	}
+
+	OutTimestamp = Target.Timestamp;
+
+	// Newer steps belong to the abandoned timeline
+	NewestStep = Step;
+	for (int32 Index = 0; Index < Keyframes.Num(); ++Index)
+	{
+		if (Keyframes[Index].Step > Step)
+		{
+			Keyframes[Index].Step = INDEX_NONE;
+		}
+		else if (Keyframes[Index].Step == Keyframe.Step)
+		{
+			CurrentKeyframe = Index;
+		}
+	}
+
+	for (TArray<FPathVersion>& Versions : PathHistory)
+	{
+		while (Versions.Num() > 0 && Versions.Last().Step > Step)
+		{
+			Versions.Pop(EAllowShrinking::No);
+		}
+	}
+
+	// Loaded states start their path revisions over
+	PathHistory.SetNum(Simulation.GetNumBalls());
+	PathRevisions.SetNum(Simulation.GetNumBalls());
+	for (int32 BallID = 0; BallID < Simulation.GetNumBalls(); ++BallID)
+	{
+		PathRevisions[BallID] = Simulation.GetBallState(BallID).PathRevision;
+	}
+	GetStates(Step, LastStates);
+
+	if (Simulation.GetCurrentStep() != Step || Simulation.ComputeStateHash() != Target.Hash)
+	{
+		UE_LOG(LogSimSnapshots, Warning, TEXT("Rewind to step %d did not reproduce the recorded state (step %d, hash %08x, expected %08x)"),
+			Step, Simulation.GetCurrentStep(), Simulation.ComputeStateHash(), Target.Hash);
+		Reset();
+		return false;
+	}
+
+	return true;
+}
+
+bool FSimulationSnapshotRing::Export(int32 Step, const FString& Filename) const
+{
+	TArray<FBallRecordState> States;
+	uint32 Hash = 0;
+	if (!GetStates(Step, States, &Hash))
+	{
+		return false;
+	}
+
+	TArray<uint8> Data;
+	FMemoryWriter Writer(Data);
+
+	uint32 Magic = SnapshotMagic;
+	uint32 Version = SnapshotVersion;
+	int32 SavedStep = Step;
+	int32 NumBalls = States.Num();
+	Writer << Magic << Version << SavedStep << Hash << NumBalls;
+	for (FBallRecordState& State : States)
+	{
+		FBallRecordState::SerializeDelta(Writer, FBallRecordState::AllFields, State);
+	}
+
+	return FFileHelper::SaveArrayToFile(Data, *Filename);
+}
+
+bool FSimulationSnapshotRing::Import(const FString& Filename, int32& OutStep, uint32& OutHash, TArray<FBallRecordState>& OutStates)
+{
+	TArray<uint8> Data;
+	if (!FFileHelper::LoadFileToArray(Data, *Filename))
+	{
+		return false;
+	}
+
+	FMemoryReader Reader(Data);
+
+	uint32 Magic = 0;
+	uint32 Version = 0;
+	int32 NumBalls = 0;
+	Reader << Magic << Version << OutStep << OutHash << NumBalls;
+	if (Magic != SnapshotMagic || Version != SnapshotVersion || NumBalls < 0)
+	{
+		UE_LOG(LogSimSnapshots, Error, TEXT("%s is not a supported snapshot (magic %08x, version %u)"), *Filename, Magic, Version);
+		return false;
+	}
+
+	OutStates.SetNum(NumBalls);
+	for (FBallRecordState& State : OutStates)
+	{
+		FBallRecordState::SerializeDelta(Reader, FBallRecordState::AllFields, State);
+	}
+
+	return !Reader.IsError();
+}
+
+int32 FSimulationSnapshotRing::DiffStates(const TArray<FBallRecordState>& A, const TArray<FBallRecordState>& B, FOutputDevice& Ar, int32 MaxListed)
+{
+	int32 NumDiffering = FMath::Abs(A.Num() - B.Num());
+
+	for (int32 BallID = 0; BallID < FMath::Min(A.Num(), B.Num()); ++BallID)
+	{
+		const FBallRecordState& StateA = A[BallID];
+		const FBallRecordState& StateB = B[BallID];
+		if (StateA == StateB)
+		{
+			continue;
+		}
+
+		if (NumDiffering++ < MaxListed)
+		{
+			Ar.Logf(TEXT("  Ball %d: pos %s/%s target %d/%d HP %d/%d attack %d/%d dead %d/%d"), BallID,
+				*StateA.GridPosition.ToString(), *StateB.GridPosition.ToString(), StateA.TargetID, StateB.TargetID,
+				StateA.HP, StateB.HP, StateA.StepsToAttack, StateB.StepsToAttack, StateA.bIsDead, StateB.bIsDead);
+		}
+	}
+
+	Ar.Logf(TEXT("%d of %d balls differ (%d/%d balls)"), NumDiffering, FMath::Max(A.Num(), B.Num()), A.Num(), B.Num());
+	return NumDiffering;
+}
+
+void FSimulationSnapshotRing::Dump(FOutputDevice& Ar) const
+{
+	if (!IsEnabled())
+	{
+		Ar.Logf(TEXT("Snapshots disabled"));
+		return;
+	}
+
+	SIZE_T DeltaBytes = 0;
+	int32 NumDeltas = 0;
+	for (const FStepSnapshot& Snapshot : Snapshots)
+	{
+		if (Snapshot.Step != INDEX_NONE && Snapshot.Step <= NewestStep && Snapshot.Step != Snapshot.KeyframeStep)
+		{
+			DeltaBytes += Snapshot.Delta.Num();
+			NumDeltas++;
+		}
+	}
+
+	Ar.Logf(TEXT("Snapshots: steps %d to %d of last %d, keyframe every %d steps, %.1f KB per step delta, %.1f KB paths, %.1f KB"),
+		GetOldestStep(), NewestStep, NumSteps, KeyframeInterval,
+		NumDeltas > 0 ? DeltaBytes / 1024.0 / NumDeltas : 0.0, GetPathsAllocatedSize() / 1024.0, GetAllocatedSize() / 1024.0);
+}
+
+SIZE_T FSimulationSnapshotRing::GetAllocatedSize() const
+{
+	SIZE_T Size = Snapshots.GetAllocatedSize() + Keyframes.GetAllocatedSize();
+	for (const FStepSnapshot& Snapshot : Snapshots)
+	{
+		Size += Snapshot.Commands.GetAllocatedSize() + Snapshot.Delta.GetAllocatedSize();
+	}
+	for (const FKeyframe& Keyframe : Keyframes)
+	{
+		Size += Keyframe.State.GetAllocatedSize() + Keyframe.BallStates.GetAllocatedSize();
+	}
+	Size += LastStates.GetAllocatedSize() + GetPathsAllocatedSize();
+	return Size;
+}
+
+SIZE_T FSimulationSnapshotRing::GetPathsAllocatedSize() const
+{
+	SIZE_T Size = PathHistory.GetAllocatedSize() + PathRevisions.GetAllocatedSize();
+	for (const TArray<FPathVersion>& Versions : PathHistory)
+	{
+		Size += Versions.GetAllocatedSize();
+		for (const FPathVersion& Version : Versions)
+		{
+			Size += Version.Path.GetAllocatedSize();
+		}
+	}
+	return Size;
+}
+
+const FSimulationSnapshotRing::FStepSnapshot* FSimulationSnapshotRing::FindSnapshot(int32 Step) const
+{
+	if (!IsEnabled() || Step < 0 || Step > NewestStep)
+	{
+		return nullptr;
+	}
+
+	const FStepSnapshot& Snapshot = Snapshots[Step % NumSteps];
+	return Snapshot.Step == Step ? &Snapshot : nullptr;
+}
+
+const FSimulationSnapshotRing::FKeyframe* FSimulationSnapshotRing::FindKeyframe(int32 Step) const
+{
+	if (Step == INDEX_NONE)
+	{
+		return nullptr;
+	}
+
+	return Keyframes.FindByPredicate([Step](const FKeyframe& Keyframe)
+	{
+		return Keyframe.Step == Step;
+	});
+}
+
+const FSimulationSnapshotRing::FKeyframe* FSimulationSnapshotRing::FindKeyframeChain(int32 Step) const
+{
+	const FStepSnapshot* Snapshot = FindSnapshot(Step);
+	const FKeyframe* Keyframe = Snapshot ? FindKeyframe(Snapshot->KeyframeStep) : nullptr;
+	if (!Keyframe)
+	{
+		return nullptr;
+	}
+
+	// Deltas are applied one after another and the steps re-simulated from their commands
+	for (int32 Next = Keyframe->Step + 1; Next < Step; ++Next)
+	{
+		if (!FindSnapshot(Next))
+		{
+			return nullptr;
+		}
+	}
+	return Keyframe;
+}
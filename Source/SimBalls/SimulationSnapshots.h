@@ -0,0 +1,142 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "SimulationCommand.h"
+#include "SimulationRecorder.h"
+
+class FBallSimulation;
+
+/**
+ * In-memory ring of the last simulation steps for rewinding and divergence debugging.
+ *
+ * Every KeyframeInterval steps a keyframe keeps the simulation state without cached paths and the recorded ball fields.
+ * Every step keeps the ball fields that differ from the previous step, in the recording delta encoding,
+ * and the commands it applied. Paths are kept apart, one copy per ball each time it changes,
+ * since most balls keep following the same path for many steps.
+ * A kept step is inspected by applying the deltas since its keyframe,
+ * rewinding restores the keyframe with its paths and re-simulates at most KeyframeInterval - 1 steps.
+ */
+class SIMBALLS_API FSimulationSnapshotRing
+{
+public:
+	/**
+	 * Drops all snapshots when the sizes change.
+	 * @param InNumSteps - Steps kept, 0 disables the ring
+	 * @param InKeyframeInterval - Steps between keyframes
+	 */
+	void Configure(int32 InNumSteps, int32 InKeyframeInterval);
+	bool IsEnabled() const { return NumSteps > 0; }
+
+	// Drops all snapshots, for a simulation that was initialized or restored
+	void Reset();
+
+	/**
+	 * Captures the step the simulation just advanced, steps that do not follow the newest one start over.
+	 * @param Timestamp - Time the step was advanced with
+	 */
+	void RecordStep(FBallSimulation& Simulation, double Timestamp);
+
+	// Kept steps, INDEX_NONE when empty. Steps are numbered like FBallSimulation::GetCurrentStep() after advancing them
+	int32 GetOldestStep() const;
+	int32 GetNewestStep() const { return NewestStep; }
+
+	/**
+	 * Recorded ball fields after Step, by ball ID.
+	 * @param OutHash - Optional, receives the state hash after Step
+	 * @return false if the step is not kept
+	 */
+	bool GetStates(int32 Step, TArray<FBallRecordState>& OutStates, uint32* OutHash = nullptr) const;
+
+	/**
+	 * Restores the simulation to the state after Step, newer snapshots are dropped.
+	 * Commands submitted but not applied yet are not part of the snapshots, they may still apply during the re-simulation.
+	 * @param OutTimestamp - Time Step was advanced with
+	 * @return false if the step can not be rewound to or re-simulating it did not reproduce the recorded hash
+	 */
+	bool Rewind(FBallSimulation& Simulation, int32 Step, double& OutTimestamp);
+	// Step has its keyframe and every step after it kept
+	bool CanRewind(int32 Step) const;
+
+	/**
+	 * Writes the recorded ball fields after Step, to be compared on another peer with Import() and DiffStates().
+	 */
+	bool Export(int32 Step, const FString& Filename) const;
+	static bool Import(const FString& Filename, int32& OutStep, uint32& OutHash, TArray<FBallRecordState>& OutStates);
+
+	/**
+	 * Lists balls whose recorded fields differ between two sets of states.
+	 * @return Number of differing balls, a ball missing on one side counts as differing
+	 */
+	static int32 DiffStates(const TArray<FBallRecordState>& A, const TArray<FBallRecordState>& B, FOutputDevice& Ar, int32 MaxListed = 16);
+
+	/**
+	 * Writes kept steps, keyframes and memory to the given output.
+	 */
+	void Dump(FOutputDevice& Ar) const;
+
+	SIZE_T GetAllocatedSize() const;
+	// Part of GetAllocatedSize() taken by path copies
+	SIZE_T GetPathsAllocatedSize() const;
+
+private:
+	struct FKeyframe
+	{
+		int32 Step = INDEX_NONE;
+		// FBallSimulation::SerializeState() after the step, without paths
+		TArray<uint8> State;
+		TArray<FBallRecordState> BallStates;
+	};
+
+	struct FStepSnapshot
+	{
+		int32 Step = INDEX_NONE;
+		double Timestamp = 0.0;
+		uint32 Hash = 0;
+		int32 NumBalls = 0;
+		int32 KeyframeStep = INDEX_NONE;
+		// Commands applied by the step, for re-simulating it
+		TArray<FSimulationCommand> Commands;
+		// Ball ID, delta flags and fields of every ball that differs from the previous step, empty for keyframes
+		TArray<uint8> Delta;
+	};
+
+	struct FPathVersion
+	{
+		// Step the path was first seen after
+		int32 Step = INDEX_NONE;
+		TArray<FIntPoint> Path;
+	};
+
+	const FStepSnapshot* FindSnapshot(int32 Step) const;
+	const FKeyframe* FindKeyframe(int32 Step) const;
+	/**
+	 * @return Keyframe of Step when Step and every step since the keyframe are kept
+	 */
+	const FKeyframe* FindKeyframeChain(int32 Step) const;
+
+	// Copies the paths replaced since the last recorded step
+	void RecordPaths(const FBallSimulation& Simulation, int32 Step);
+	// Drops path versions no kept keyframe refers to
+	void PrunePaths();
+	const TArray<FIntPoint>* FindPath(int32 BallID, int32 Step) const;
+
+	// Indexed by step modulo NumSteps, buffers are reused when the ring wraps
+	TArray<FStepSnapshot> Snapshots;
+	TArray<FKeyframe> Keyframes;
+
+	// Recorded fields after the newest step by ball ID, the next delta is taken against them
+	TArray<FBallRecordState> LastStates;
+
+	// Path versions by ball ID, the newest one at or before the oldest keyframe followed by every later change
+	TArray<TArray<FPathVersion>> PathHistory;
+	// FBallSimulatedState::PathRevision when each path was last copied
+	TArray<uint32> PathRevisions;
+
+	int32 NumSteps = 0;
+	int32 KeyframeInterval = 1;
+
+	int32 NewestStep = INDEX_NONE;
+	// Keyframe the next steps are recorded against, and the slot the next keyframe goes to
+	int32 CurrentKeyframe = INDEX_NONE;
+	int32 NextKeyframe = 0;
+};
@@ -0,0 +1,232 @@
+#include "StaticObstacleMap.h"
+
+#include "Async/MappedFileHandle.h"
+#include "HAL/FileManager.h"
+#include "HAL/PlatformFileManager.h"
+#include "Misc/Paths.h"
+#include "Misc/ScopeLock.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogStaticObstacles, Log, All)
+
+namespace
+{
+	constexpr uint32 ObstacleMapMagic = 0x4D4F4253; // 'SBOM'
+	constexpr uint32 ObstacleMapVersion = 1;
+
+	// Tiles are read as uint64 straight from the mapped pages
+	constexpr int64 TileAlignment = 16;
+
+	FArchive& operator<<(FArchive& Ar, FStaticObstacleMap::FHeader& Header)
+	{
+		Ar << Header.Magic << Header.Version << Header.GridSize << Header.ChunkSizeLog2;
+		Ar << Header.NumChunksPerSide << Header.NumTiles << Header.DirectoryOffset << Header.TilesOffset;
+		return Ar;
+	}
+
+	// Maps shared by all grids, keyed by full path
+	FCriticalSection LoadedMapsLock;
+	TMap<FString, TWeakPtr<const FStaticObstacleMap>> LoadedMaps;
+}
+
+FStaticObstacleMap::~FStaticObstacleMap()
+{
+	MappedRegion.Reset();
+	MappedHandle.Reset();
+}
+
+TSharedPtr<const FStaticObstacleMap> FStaticObstacleMap::FindOrLoad(const FString& Filename)
+{
+	if (Filename.IsEmpty())
+	{
+		return nullptr;
+	}
+
+	const FString FullPath = FPaths::ConvertRelativePathToFull(FPaths::ProjectDir(), Filename);
+
+	FScopeLock Lock(&LoadedMapsLock);
+
+	if (TSharedPtr<const FStaticObstacleMap> Existing = LoadedMaps.FindRef(FullPath).Pin())
+	{
+		return Existing;
+	}
+
+	const uint64 StartCycles = FPlatformTime::Cycles64();
+
+	TSharedPtr<FStaticObstacleMap> Map = MakeShared<FStaticObstacleMap>();
+	if (!Map->Load(FullPath))
+	{
+		return nullptr;
+	}
+
+	UE_LOG(LogStaticObstacles, Log, TEXT("Mapped %s: %dx%d cells, %d tiles in %.2fms"),
+		*FullPath, Map->GridSize, Map->GridSize, Map->NumTiles, FPlatformTime::ToMilliseconds64(FPlatformTime::Cycles64() - StartCycles));
+
+	LoadedMaps.Add(FullPath, Map);
+	return Map;
+}
+
+bool FStaticObstacleMap::Load(const FString& InFilename)
+{
+	Filename = InFilename;
+
+	IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+
+	MappedHandle.Reset(PlatformFile.OpenMapped(*Filename));
+	if (!MappedHandle)
+	{
+		UE_LOG(LogStaticObstacles, Error, TEXT("Failed to map static obstacles %s"), *Filename);
+		return false;
+	}
+
+	const int64 FileSize = MappedHandle->GetFileSize();
+	MappedRegion.Reset(MappedHandle->MapRegion(0, FileSize));
+	if (!MappedRegion)
+	{
+		UE_LOG(LogStaticObstacles, Error, TEXT("Failed to map region of static obstacles %s"), *Filename);
+		return false;
+	}
+
+	const uint8* Data = MappedRegion->GetMappedPtr();
+
+	FHeader Header;
+	if (FileSize < static_cast<int64>(sizeof(FHeader)))
+	{
+		UE_LOG(LogStaticObstacles, Error, TEXT("%s is too small for a static obstacle map"), *Filename);
+		return false;
+	}
+	FMemory::Memcpy(&Header, Data, sizeof(FHeader));
+
+	if (Header.Magic != ObstacleMapMagic || Header.Version != ObstacleMapVersion || Header.ChunkSizeLog2 != ChunkSizeLog2)
+	{
+		UE_LOG(LogStaticObstacles, Error, TEXT("%s is not a supported static obstacle map (magic %08x, version %u)"), *Filename, Header.Magic, Header.Version);
+		return false;
+	}
+
+	const int64 NumChunks = static_cast<int64>(Header.NumChunksPerSide) * Header.NumChunksPerSide;
+	const int64 DirectorySize = NumChunks * sizeof(int32);
+	const int64 TilesSize = static_cast<int64>(Header.NumTiles) * NumTileWords * sizeof(uint64);
+	if (Header.GridSize <= 0 || Header.NumChunksPerSide != FMath::DivideAndRoundUp(Header.GridSize, ChunkSize) || Header.NumTiles < 0
+		|| Header.DirectoryOffset < static_cast<int64>(sizeof(FHeader)) || Header.DirectoryOffset % sizeof(int32) != 0
+		|| Header.DirectoryOffset + DirectorySize > FileSize || Header.TilesOffset < 0 || Header.TilesOffset + TilesSize > FileSize
+		|| Header.TilesOffset % TileAlignment != 0)
+	{
+		UE_LOG(LogStaticObstacles, Error, TEXT("%s has an invalid layout"), *Filename);
+		return false;
+	}
+
+	// IsBlocked reads tiles through the directory without bounds checks
+	const int32* MappedDirectory = reinterpret_cast<const int32*>(Data + Header.DirectoryOffset);
+	for (int64 ChunkIndex = 0; ChunkIndex < NumChunks; ++ChunkIndex)
+	{
+		const int32 TileIndex = MappedDirectory[ChunkIndex];
+		if (TileIndex != INDEX_NONE && (TileIndex < 0 || TileIndex >= Header.NumTiles))
+		{
+			UE_LOG(LogStaticObstacles, Error, TEXT("%s has chunk %lld pointing at tile %d of %d"), *Filename, ChunkIndex, TileIndex, Header.NumTiles);
+			return false;
+		}
+	}
+
+	GridSize = Header.GridSize;
+	NumChunksPerSide = Header.NumChunksPerSide;
+	NumTiles = Header.NumTiles;
+	Directory = MappedDirectory;
+	Tiles = reinterpret_cast<const uint64*>(Data + Header.TilesOffset);
+
+	return true;
+}
+
+FStaticObstacleMapBuilder::FStaticObstacleMapBuilder(int32 InGridSize)
+	: GridSize(InGridSize)
+{
+}
+
+void FStaticObstacleMapBuilder::AddBlockedCell(const FIntPoint& Cell)
+{
+	if (Cell.X < 0 || Cell.Y < 0 || Cell.X >= GridSize || Cell.Y >= GridSize)
+	{
+		return;
+	}
+
+	constexpr int32 ChunkMask = FStaticObstacleMap::ChunkSize - 1;
+
+	FTile& Tile = Tiles.FindOrAdd(FIntPoint(Cell.X >> FStaticObstacleMap::ChunkSizeLog2, Cell.Y >> FStaticObstacleMap::ChunkSizeLog2));
+	const int32 LocalIndex = ((Cell.X & ChunkMask) << FStaticObstacleMap::ChunkSizeLog2) | (Cell.Y & ChunkMask);
+	const uint64 Mask = 1ull << (LocalIndex & 63);
+
+	if (!(Tile.Bits[LocalIndex >> 6] & Mask))
+	{
+		Tile.Bits[LocalIndex >> 6] |= Mask;
+		NumBlockedCells++;
+	}
+}
+
+void FStaticObstacleMapBuilder::AddBlockedRect(const FIntPoint& Min, const FIntPoint& Max)
+{
+	for (int32 X = FMath::Max(Min.X, 0); X <= FMath::Min(Max.X, GridSize - 1); ++X)
+	{
+		for (int32 Y = FMath::Max(Min.Y, 0); Y <= FMath::Min(Max.Y, GridSize - 1); ++Y)
+		{
+			AddBlockedCell(FIntPoint(X, Y));
+		}
+	}
+}
+
+bool FStaticObstacleMapBuilder::Save(const FString& Filename) const
+{
+	const int32 NumChunksPerSide = FMath::DivideAndRoundUp(GridSize, FStaticObstacleMap::ChunkSize);
+	const int64 NumChunks64 = static_cast<int64>(NumChunksPerSide) * NumChunksPerSide;
+	if (NumChunks64 > MAX_int32)
+	{
+		UE_LOG(LogStaticObstacles, Error, TEXT("Static obstacle map %s is too large, %lld chunks"), *Filename, NumChunks64);
+		return false;
+	}
+	const int32 NumChunks = static_cast<int32>(NumChunks64);
+
+	TUniquePtr<FArchive> Writer(IFileManager::Get().CreateFileWriter(*Filename));
+	if (!Writer)
+	{
+		UE_LOG(LogStaticObstacles, Error, TEXT("Failed to create static obstacle map %s"), *Filename);
+		return false;
+	}
+
+	FStaticObstacleMap::FHeader Header;
+	Header.Magic = ObstacleMapMagic;
+	Header.Version = ObstacleMapVersion;
+	Header.GridSize = GridSize;
+	Header.ChunkSizeLog2 = FStaticObstacleMap::ChunkSizeLog2;
+	Header.NumChunksPerSide = NumChunksPerSide;
+	Header.NumTiles = Tiles.Num();
+	Header.DirectoryOffset = sizeof(FStaticObstacleMap::FHeader);
+
+	Header.TilesOffset = Align(Header.DirectoryOffset + NumChunks * static_cast<int64>(sizeof(int32)), TileAlignment);
+
+	// Tiles are written in chunk order so neighbouring chunks share pages
+	TArray<FIntPoint> ChunkCoords;
+	Tiles.GenerateKeyArray(ChunkCoords);
+	ChunkCoords.Sort([](const FIntPoint& A, const FIntPoint& B) { return A.X != B.X ? A.X < B.X : A.Y < B.Y; });
+
+	TArray<int32> Directory;
+	Directory.Init(INDEX_NONE, NumChunks);
+	for (int32 TileIndex = 0; TileIndex < ChunkCoords.Num(); ++TileIndex)
+	{
+		Directory[static_cast<int64>(ChunkCoords[TileIndex].X) * Header.NumChunksPerSide + ChunkCoords[TileIndex].Y] = TileIndex;
+	}
+
+	*Writer << Header;
+	Writer->Serialize(Directory.GetData(), Directory.Num() * sizeof(int32));
+
+	uint8 Padding[TileAlignment] = {};
+	Writer->Serialize(Padding, Header.TilesOffset - Writer->Tell());
+
+	for (const FIntPoint& ChunkCoord : ChunkCoords)
+	{
+		FTile Tile = Tiles.FindChecked(ChunkCoord);
+		Writer->Serialize(Tile.Bits, sizeof(Tile.Bits));
+	}
+
+	const bool bSuccess = Writer->Close();
+
+	UE_LOG(LogStaticObstacles, Display, TEXT("Saved %s: %dx%d cells, %lld blocked, %d tiles"), *Filename, GridSize, GridSize, NumBlockedCells, Tiles.Num());
+
+	return bSuccess;
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+class IMappedFileHandle;
+class IMappedFileRegion;
+
+/**
+ * Read-only static terrain (walls, blocked regions) backed by a memory mapped file.
+ *
+ * File layout: header, chunk directory with one tile index per 32x32 chunk (INDEX_NONE for empty chunks),
+ * then one 128 byte bit tile per non-empty chunk. Queries read the mapped pages directly,
+ * so loading costs no parsing and processes mapping the same file share its pages.
+ */
+class SIMBALLS_API FStaticObstacleMap
+{
+public:
+	static constexpr int32 ChunkSizeLog2 = 5;
+	static constexpr int32 ChunkSize = 1 << ChunkSizeLog2;
+	static constexpr int32 NumTileWords = ChunkSize * ChunkSize / 64;
+
+	struct FHeader
+	{
+		uint32 Magic = 0;
+		uint32 Version = 0;
+		int32 GridSize = 0;
+		int32 ChunkSizeLog2 = 0;
+		int32 NumChunksPerSide = 0;
+		int32 NumTiles = 0;
+		int64 DirectoryOffset = 0;
+		int64 TilesOffset = 0;
+	};
+
+	~FStaticObstacleMap();
+
+	/**
+	 * Returns the already mapped file or maps it, relative paths are resolved against the project directory.
+	 * The header and every directory entry are checked on load, so queries index the mapped tiles without bounds checks.
+	 * @return nullptr for an empty filename or a file that failed to map or to validate
+	 */
+	static TSharedPtr<const FStaticObstacleMap> FindOrLoad(const FString& Filename);
+
+	bool IsBlocked(const FIntPoint& Cell) const
+	{
+		if (Cell.X < 0 || Cell.Y < 0 || Cell.X >= GridSize || Cell.Y >= GridSize)
+		{
+			return false;
+		}
+
+		const int32 TileIndex = Directory[static_cast<int64>(Cell.X >> ChunkSizeLog2) * NumChunksPerSide + (Cell.Y >> ChunkSizeLog2)];
+		if (TileIndex == INDEX_NONE)
+		{
+			return false;
+		}
+
+		const int32 LocalIndex = ((Cell.X & (ChunkSize - 1)) << ChunkSizeLog2) | (Cell.Y & (ChunkSize - 1));
+		return (Tiles[static_cast<int64>(TileIndex) * NumTileWords + (LocalIndex >> 6)] >> (LocalIndex & 63)) & 1;
+	}
+
+	int32 GetGridSize() const { return GridSize; }
+	int32 GetNumTiles() const { return NumTiles; }
+	const FString& GetFilename() const { return Filename; }
+
+private:
+	bool Load(const FString& InFilename);
+
+	TUniquePtr<IMappedFileHandle> MappedHandle;
+	TUniquePtr<IMappedFileRegion> MappedRegion;
+
+	// Views into the mapped region
+	const int32* Directory = nullptr;
+	const uint64* Tiles = nullptr;
+
+	int32 GridSize = 0;
+	int32 NumChunksPerSide = 0;
+	int32 NumTiles = 0;
+
+	FString Filename;
+};
+
+/**
+ * Collects blocked cells and writes them as a static obstacle map file.
+ */
+class SIMBALLS_API FStaticObstacleMapBuilder
+{
+public:
+	explicit FStaticObstacleMapBuilder(int32 InGridSize);
+
+	void AddBlockedCell(const FIntPoint& Cell);
+	// Blocks all cells of the inclusive rectangle
+	void AddBlockedRect(const FIntPoint& Min, const FIntPoint& Max);
+
+	int64 GetNumBlockedCells() const { return NumBlockedCells; }
+
+	bool Save(const FString& Filename) const;
+
+private:
+	struct FTile
+	{
+		uint64 Bits[FStaticObstacleMap::NumTileWords] = {};
+	};
+
+	// Non-empty tiles by chunk coordinate
+	TMap<FIntPoint, FTile> Tiles;
+
+	int32 GridSize = 0;
+	int64 NumBlockedCells = 0;
+};